@@ -0,0 +1,198 @@
+/**
+ * @file acquire.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the pipelined SPI acquisition
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ *
+ * Buffers move around a loop: free -> filled by the transfer thread ->
+ * taken by acq_next() -> released back to free. The handoffs happen once
+ * per burst, not once per sample, so a mutex and condition variable are
+ * plenty cheap here.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <assert.h>
+
+#include "acquire.h"
+#include "spi.h"
+#include "timebase.h"
+#include "diag.h"
+#include "metrics.h"
+
+/**
+ * @brief A FIFO of buffer indices
+ */
+typedef struct acq_queue {
+    int items[ACQ_MAX_BUFS];
+    int head;
+    int count;
+} acq_queue_t;
+
+struct acq_pipeline {
+    int             fd;
+    int             nbufs;
+    int             frames;
+    const uint8_t  *tx_frame;
+    int             frame_len;
+    uint16_t        delay_usecs;
+
+    acq_buf_t       bufs[ACQ_MAX_BUFS];
+    acq_queue_t     free_q;
+    acq_queue_t     full_q;
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+    int             stopping;
+    pthread_t       thread;
+
+    acq_stats_t     stats;
+    int64_t         t_start;
+};
+
+// Time each transfer took, in nanoseconds
+static metric_t *m_transfer_ns;
+
+static void q_push(acq_queue_t *q, int item) {
+    q->items[(q->head + q->count) % ACQ_MAX_BUFS] = item;
+    q->count++;
+}
+
+static int q_pop(acq_queue_t *q) {
+    int item = q->items[q->head];
+    q->head = (q->head + 1) % ACQ_MAX_BUFS;
+    q->count--;
+    return item;
+}
+
+static void *acq_main(void *arg) {
+    acq_pipeline_t *acq = (acq_pipeline_t *) arg;
+
+    pthread_mutex_lock(&acq->lock);
+    while (!acq->stopping) {
+        if (acq->free_q.count == 0) {
+            acq->stats.stalls++;
+            while (acq->free_q.count == 0 && !acq->stopping) {
+                pthread_cond_wait(&acq->changed, &acq->lock);
+            }
+            continue;
+        }
+        acq_buf_t *b = &acq->bufs[q_pop(&acq->free_q)];
+        pthread_mutex_unlock(&acq->lock);
+
+        b->t_before = tb_mono_ns();
+        b->status = spi_transfer_frames(acq->fd, acq->tx_frame, b->raw, acq->frames, acq->frame_len, acq->delay_usecs);
+        b->t_after = tb_mono_ns();
+        metric_observe(m_transfer_ns, b->t_after - b->t_before);
+
+        pthread_mutex_lock(&acq->lock);
+        acq->stats.busy_ns += b->t_after - b->t_before;
+        if (b->status < 0) {
+            acq->stats.failed++;
+        } else {
+            acq->stats.frames += acq->frames;
+        }
+        q_push(&acq->full_q, (int)(b - acq->bufs));
+        pthread_cond_broadcast(&acq->changed);
+    }
+    pthread_mutex_unlock(&acq->lock);
+    return NULL;
+}
+
+acq_pipeline_t *acq_start(int fd, int nbufs, int frames, const uint8_t *tx_frame, int frame_len, uint16_t delay_usecs) {
+    assert(nbufs >= 2 && nbufs <= ACQ_MAX_BUFS);
+    assert(frames > 0 && frames <= SPI_BURST_MAX);
+
+    acq_pipeline_t *acq = (acq_pipeline_t *) calloc(1, sizeof(acq_pipeline_t));
+    if (acq == NULL) {
+        diag_error("out of memory");
+        return NULL;
+    }
+    acq->fd = fd;
+    acq->nbufs = nbufs;
+    acq->frames = frames;
+    acq->tx_frame = tx_frame;
+    acq->frame_len = frame_len;
+    acq->delay_usecs = delay_usecs;
+
+    // Each buffer gets its own whole pages, so that no two buffers (which
+    // are written and read by different threads) ever share a cache line
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t len = ((size_t)(frames * frame_len) + page - 1) / page * page;
+    for(int i = 0; i < nbufs; i++) {
+        void *p = NULL;
+        if (0 != posix_memalign(&p, page, len)) {
+            diag_error("out of memory");
+            for(int j = 0; j < i; j++) {
+                free(acq->bufs[j].raw);
+            }
+            free(acq);
+            return NULL;
+        }
+        memset(p, 0, len);
+        acq->bufs[i].raw = (uint8_t *) p;
+        q_push(&acq->free_q, i);
+    }
+
+    if (m_transfer_ns == NULL) {
+        m_transfer_ns = metrics_histogram("acq_transfer_ns");
+    }
+    pthread_mutex_init(&acq->lock, NULL);
+    pthread_cond_init(&acq->changed, NULL);
+    acq->t_start = tb_mono_ns();
+    if (0 != pthread_create(&acq->thread, NULL, acq_main, acq)) {
+        diag_error("could not start transfer thread");
+        for(int i = 0; i < nbufs; i++) {
+            free(acq->bufs[i].raw);
+        }
+        free(acq);
+        return NULL;
+    }
+    return acq;
+}
+
+acq_buf_t *acq_next(acq_pipeline_t *acq) {
+    pthread_mutex_lock(&acq->lock);
+    while (acq->full_q.count == 0) {
+        pthread_cond_wait(&acq->changed, &acq->lock);
+    }
+    acq_buf_t *b = &acq->bufs[q_pop(&acq->full_q)];
+    pthread_mutex_unlock(&acq->lock);
+    return b;
+}
+
+void acq_release(acq_pipeline_t *acq, acq_buf_t *buf) {
+    pthread_mutex_lock(&acq->lock);
+    q_push(&acq->free_q, (int)(buf - acq->bufs));
+    pthread_cond_broadcast(&acq->changed);
+    pthread_mutex_unlock(&acq->lock);
+}
+
+void acq_stop(acq_pipeline_t *acq, acq_stats_t *stats) {
+    pthread_mutex_lock(&acq->lock);
+    acq->stopping = 1;
+    pthread_cond_broadcast(&acq->changed);
+    pthread_mutex_unlock(&acq->lock);
+    pthread_join(acq->thread, NULL);
+
+    acq->stats.elapsed_ns = tb_mono_ns() - acq->t_start;
+    if (stats != NULL) {
+        *stats = acq->stats;
+    }
+    for(int i = 0; i < acq->nbufs; i++) {
+        free(acq->bufs[i].raw);
+    }
+    pthread_mutex_destroy(&acq->lock);
+    pthread_cond_destroy(&acq->changed);
+    free(acq);
+}
@@ -0,0 +1,140 @@
+/**
+ * @file acquire.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Pipelined SPI acquisition, overlapping bus transfers with processing
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * With plain burst reads, the CPU sits idle while the bus is busy, and
+ * the bus sits idle while the reader decodes, filters and writes. The
+ * acquisition pipeline runs the bus transfers on a dedicated thread
+ * which cycles through two or more page-aligned, reused buffers. While
+ * the kernel fills one buffer, the caller decodes and processes the
+ * previous one, so the bus can be kept busy nearly all of the time.
+ *
+ * Usage:
+ *
+ *     acq_pipeline_t *acq = acq_start(fd, 2, frames, NULL, 2, delay_usecs);
+ *     while (running) {
+ *         acq_buf_t *b = acq_next(acq);
+ *         ... decode b->raw ...
+ *         acq_release(acq, b);
+ *     }
+ *     acq_stop(acq, &stats);
+ *
+ * acq_next() waits for the next filled buffer, so the caller decides when
+ * to stop; a buffer is never NULL.
+ */
+
+#ifndef ACQUIRE_H
+#define ACQUIRE_H
+
+#include <stdint.h>
+
+/**
+ * @brief The most buffers a pipeline can cycle through
+ */
+#define ACQ_MAX_BUFS 8
+
+/**
+ * @brief One filled (or to-be-filled) transfer buffer
+ */
+typedef struct acq_buf {
+    /**
+     * @brief The raw frames, page-aligned and reused from burst to burst
+     */
+    uint8_t *raw;
+
+    /**
+     * @brief The number of bytes read, or -1 if the transfer failed
+     */
+    int      status;
+
+    /**
+     * @brief CLOCK_MONOTONIC time just before the transfer, in nanoseconds
+     */
+    int64_t  t_before;
+
+    /**
+     * @brief CLOCK_MONOTONIC time just after the transfer, in nanoseconds
+     */
+    int64_t  t_after;
+} acq_buf_t;
+
+/**
+ * @brief Throughput figures for a pipeline run
+ */
+typedef struct acq_stats {
+    /**
+     * @brief The number of frames transferred by successful bursts
+     */
+    uint64_t frames;
+
+    /**
+     * @brief The number of bursts whose transfer failed
+     */
+    uint64_t failed;
+
+    /**
+     * @brief The total time spent inside transfers, in nanoseconds
+     */
+    int64_t  busy_ns;
+
+    /**
+     * @brief The total time the pipeline ran for, in nanoseconds
+     */
+    int64_t  elapsed_ns;
+
+    /**
+     * @brief How often the transfer thread had to wait for a free buffer
+     *        (i.e. processing, not the bus, was the bottleneck)
+     */
+    uint64_t stalls;
+} acq_stats_t;
+
+typedef struct acq_pipeline acq_pipeline_t;
+
+/**
+ * @brief Starts a pipeline on its own transfer thread
+ *
+ * @param fd The SPI device file descriptor
+ * @param nbufs The number of buffers to cycle through (2 to ACQ_MAX_BUFS)
+ * @param frames The number of frames per buffer (at most SPI_BURST_MAX)
+ * @param tx_frame The bytes to send for each frame (see spi_transfer_frames()), or NULL
+ * @param frame_len The length of each frame, in bytes
+ * @param delay_usecs The delay after each frame, in microseconds
+ * @return acq_pipeline_t* The started pipeline, or NULL on failure
+ */
+acq_pipeline_t *acq_start(int fd, int nbufs, int frames, const uint8_t *tx_frame, int frame_len, uint16_t delay_usecs);
+
+/**
+ * @brief Waits for the next filled buffer
+ *
+ * @remarks Buffers are returned in the order they were filled. The
+ *          buffer must be handed back with acq_release() once the caller
+ *          is done with it.
+ *
+ * @param acq The pipeline to take a buffer from
+ * @return acq_buf_t* The filled buffer
+ */
+acq_buf_t *acq_next(acq_pipeline_t *acq);
+
+/**
+ * @brief Hands a buffer back to the pipeline to be refilled
+ *
+ * @param acq The pipeline the buffer came from
+ * @param buf The buffer to release
+ */
+void acq_release(acq_pipeline_t *acq, acq_buf_t *buf);
+
+/**
+ * @brief Stops the pipeline, waits for the transfer thread and frees it
+ *
+ * @param acq The pipeline to stop
+ * @param stats The location to write the run's throughput figures to (may be NULL)
+ */
+void acq_stop(acq_pipeline_t *acq, acq_stats_t *stats);
+
+#endif // ACQUIRE_H
@@ -0,0 +1,209 @@
+/**
+ * @file adc_model.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Compile-time traits and generated decoders for Microchip SPI ADCs
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * The perch was built around an MCP3301, but several of its siblings
+ * differ only in how the reading is laid out in the SPI frame. Each model
+ * here is described by a set of ADC_<MODEL>_* macros:
+ *
+ * - FRAME_LEN:   bytes clocked per conversion
+ * - DATA_OFFSET: the byte at which the 16-bit window holding the reading starts
+ * - SHIFT:       how far the reading sits above the bottom of that window
+ * - BITS:        the width of the reading, including any sign bit
+ * - SIGN:        ADC_SIGN_NONE, ADC_SIGN_TWOS or ADC_SIGN_MAGNITUDE
+ * - MAX_HZ:      the maximum SPI clock at VDD = 5 V, per the datasheet
+ * - COMMAND:     the bytes to send on MOSI (differential CH0+/CH1- where
+ *                the model has a channel mux; zeros when it has no input)
+ *
+ * ADC_DEFINE_DECODERS() turns a model's traits into a set of static
+ * inline functions, named adc_<model>_*, in which every trait is a
+ * compile-time constant. After inlining, the frame layout costs nothing:
+ * there is no runtime branching on the model, and the MCP3301 decoders
+ * compile to the same shift pair as the hand-written ones.
+ *
+ * The _simd bulk decoder uses GCC vector extensions, which compile to
+ * NEON on the Pi and SSE2 on x86, eight readings at a time. It is only
+ * vectorized for 2-byte frames; longer frames fall back to the scalar
+ * loop, since their readings don't sit at a fixed stride of words.
+ *
+ * To add a model, define its ADC_<MODEL>_* traits and instantiate
+ * ADC_DEFINE_DECODERS(<model>, ADC_<MODEL>) below.
+ */
+
+#ifndef ADC_MODEL_H
+#define ADC_MODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+////////////////////////////////////////////////////////
+/// Sign formats
+
+#define ADC_SIGN_NONE      0  // Unipolar straight binary
+#define ADC_SIGN_TWOS      1  // Two's complement
+#define ADC_SIGN_MAGNITUDE 2  // Sign bit above a magnitude
+
+////////////////////////////////////////////////////////
+/// Model traits
+
+// MCP3301: 13-bit differential, MISO only. Two sample clocks and a null
+// bit, then the sign bit and B11..B0 in the low 13 bits of the frame.
+#define ADC_MCP3301_FRAME_LEN   2
+#define ADC_MCP3301_DATA_OFFSET 0
+#define ADC_MCP3301_SHIFT       0
+#define ADC_MCP3301_BITS        13
+#define ADC_MCP3301_SIGN        ADC_SIGN_TWOS
+#define ADC_MCP3301_MAX_HZ      1700000
+#define ADC_MCP3301_COMMAND     { 0x00, 0x00 }
+
+// MCP3302 (4 channels) / MCP3304 (8 channels): 13-bit with an input mux.
+// Byte 0 carries the start bit, SGL/DIFF, D2 and D1; byte 1 carries D0.
+// The reply then has the sign bit and B11..B8 in the low bits of byte 1
+// and B7..B0 in byte 2.
+#define ADC_MCP3302_FRAME_LEN   3
+#define ADC_MCP3302_DATA_OFFSET 1
+#define ADC_MCP3302_SHIFT       0
+#define ADC_MCP3302_BITS        13
+#define ADC_MCP3302_SIGN        ADC_SIGN_TWOS
+#define ADC_MCP3302_MAX_HZ      2100000
+#define ADC_MCP3302_COMMAND     { 0x08, 0x00, 0x00 }
+
+#define ADC_MCP3304_FRAME_LEN   3
+#define ADC_MCP3304_DATA_OFFSET 1
+#define ADC_MCP3304_SHIFT       0
+#define ADC_MCP3304_BITS        13
+#define ADC_MCP3304_SIGN        ADC_SIGN_TWOS
+#define ADC_MCP3304_MAX_HZ      2100000
+#define ADC_MCP3304_COMMAND     { 0x08, 0x00, 0x00 }
+
+// MCP3201: 12-bit unipolar, MISO only. Two sample clocks and a null bit,
+// then B11..B0, so the 16th clock repeats B1 below the reading.
+#define ADC_MCP3201_FRAME_LEN   2
+#define ADC_MCP3201_DATA_OFFSET 0
+#define ADC_MCP3201_SHIFT       1
+#define ADC_MCP3201_BITS        12
+#define ADC_MCP3201_SIGN        ADC_SIGN_NONE
+#define ADC_MCP3201_MAX_HZ      1600000
+#define ADC_MCP3201_COMMAND     { 0x00, 0x00 }
+
+////////////////////////////////////////////////////////
+/// Generic extraction
+
+/**
+ * @brief Extracts a reading from the 16-bit window it sits in
+ *
+ * @remarks Meant to be called with constant shift, bits and sign, so
+ *          that the sign-format selection folds away at compile time.
+ *
+ * @param word The 16-bit window, in host order
+ * @param shift How far the reading sits above bit 0
+ * @param bits The width of the reading, including any sign bit
+ * @param sign The sign format (ADC_SIGN_*)
+ * @return int16_t The reading
+ */
+static inline int16_t adc_extract(uint16_t word, int shift, int bits, int sign) {
+    uint16_t w = (uint16_t)(word >> shift);
+    if (sign == ADC_SIGN_TWOS) {
+        return (int16_t)(w << (16 - bits)) >> (16 - bits);
+    }
+    if (sign == ADC_SIGN_MAGNITUDE) {
+        int16_t neg = (int16_t)(w << (16 - bits)) >> 15;
+        int16_t mag = (int16_t)(w & ((1u << (bits - 1)) - 1));
+        return (int16_t)((mag ^ neg) - neg);
+    }
+    return (int16_t)(w & ((1u << bits) - 1));
+}
+
+// Eight 16-bit lanes; NEON or SSE2 depending on the target
+typedef uint16_t adc_v8u16 __attribute__((vector_size(16)));
+typedef int16_t  adc_v8i16 __attribute__((vector_size(16)));
+
+/**
+ * @brief The vector form of adc_extract(), for eight windows at once
+ */
+static inline adc_v8i16 adc_extract_v8(adc_v8u16 word, int shift, int bits, int sign) {
+    adc_v8u16 w = word >> shift;
+    if (sign == ADC_SIGN_TWOS) {
+        return (adc_v8i16)(w << (16 - bits)) >> (16 - bits);
+    }
+    if (sign == ADC_SIGN_MAGNITUDE) {
+        adc_v8i16 neg = (adc_v8i16)(w << (16 - bits)) >> 15;
+        adc_v8i16 mag = (adc_v8i16)(w & (uint16_t)((1u << (bits - 1)) - 1));
+        return (mag ^ neg) - neg;
+    }
+    return (adc_v8i16)(w & (uint16_t)((1u << bits) - 1));
+}
+
+/**
+ * @brief Byte-swaps eight big-endian frames loaded as host words, where needed
+ */
+static inline adc_v8u16 adc_be16_v8(adc_v8u16 w) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return (w >> 8) | (w << 8);
+#else
+    return w;
+#endif
+}
+
+////////////////////////////////////////////////////////
+/// Decoder generator
+
+/**
+ * @brief Defines the adc_<model>_* functions from a model's traits
+ *
+ * - adc_<model>_command():     the bytes to send for one conversion
+ * - adc_<model>_decode():      decodes one frame as read from the bus
+ * - adc_<model>_decode_word(): decodes the 16-bit data window as one host-order word
+ * - adc_<model>_decode_bulk(): decodes n frames with a scalar loop
+ * - adc_<model>_decode_simd(): decodes n frames, eight at a time where possible
+ */
+#define ADC_DEFINE_DECODERS(model, T)                                               \
+    static inline const uint8_t *adc_##model##_command(void) {                      \
+        static const uint8_t cmd[T##_FRAME_LEN] = T##_COMMAND;                      \
+        return cmd;                                                                 \
+    }                                                                               \
+                                                                                    \
+    static inline int16_t adc_##model##_decode_word(uint16_t word) {                \
+        return adc_extract(word, T##_SHIFT, T##_BITS, T##_SIGN);                    \
+    }                                                                               \
+                                                                                    \
+    static inline int16_t adc_##model##_decode(const uint8_t *frame) {              \
+        uint16_t word = (uint16_t)((frame[T##_DATA_OFFSET] << 8) |                  \
+                                   frame[T##_DATA_OFFSET + 1]);                     \
+        return adc_##model##_decode_word(word);                                     \
+    }                                                                               \
+                                                                                    \
+    static inline void adc_##model##_decode_bulk(const uint8_t *restrict frames,    \
+                                                 int16_t *restrict out, size_t n) { \
+        for(size_t i = 0; i < n; i++) {                                             \
+            out[i] = adc_##model##_decode(frames + i * T##_FRAME_LEN);              \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    static inline void adc_##model##_decode_simd(const uint8_t *restrict frames,    \
+                                                 int16_t *restrict out, size_t n) { \
+        size_t i = 0;                                                               \
+        if (T##_FRAME_LEN == 2) {                                                   \
+            for(; i + 8 <= n; i += 8) {                                             \
+                adc_v8u16 w;                                                        \
+                memcpy(&w, frames + 2 * i, sizeof(w));                              \
+                adc_v8i16 v = adc_extract_v8(adc_be16_v8(w), T##_SHIFT, T##_BITS,   \
+                                             T##_SIGN);                             \
+                memcpy(out + i, &v, sizeof(v));                                     \
+            }                                                                       \
+        }                                                                           \
+        adc_##model##_decode_bulk(frames + i * T##_FRAME_LEN, out + i, n - i);      \
+    }
+
+ADC_DEFINE_DECODERS(mcp3301, ADC_MCP3301)
+ADC_DEFINE_DECODERS(mcp3302, ADC_MCP3302)
+ADC_DEFINE_DECODERS(mcp3304, ADC_MCP3304)
+ADC_DEFINE_DECODERS(mcp3201, ADC_MCP3201)
+
+#endif // ADC_MODEL_H
@@ -0,0 +1,181 @@
+/**
+ * @file archive.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the piecewise-linear archive
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "archive.h"
+#include "diag.h"
+
+// How far inside max_err the encoder keeps, in ADC counts, so that
+// rounding in the decoder's interpolation can't push a sample outside it
+#define ARC_SLACK 1e-6
+
+struct arc_writer {
+    FILE       *file;
+    double      err;
+    int         write_failed;
+
+    // The line being built: it starts at (t0, v0), and every slope between
+    // lo and hi (in counts per nanosecond) passes within err of each
+    // sample up to t_last
+    int         started;
+    int64_t     t0;
+    double      v0;
+    int64_t     t_last;
+    double      lo;
+    double      hi;
+
+    arc_stats_t stats;
+};
+
+static void arc_write(arc_writer_t *w, const void *data, size_t len) {
+    if (len != fwrite(data, 1, len, w->file)) {
+        w->write_failed = 1;
+    }
+    w->stats.bytes += len;
+}
+
+static void arc_vertex(arc_writer_t *w, int64_t t_ns, double value) {
+    uint8_t tag = ARC_TAG_VERTEX;
+    arc_write(w, &tag, 1);
+    arc_write(w, &t_ns, sizeof(t_ns));
+    arc_write(w, &value, sizeof(value));
+    w->stats.vertices++;
+}
+
+arc_writer_t *arc_open(const char *path, double max_err) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        diag_error("could not create %s", path);
+        return NULL;
+    }
+    arc_writer_t *w = (arc_writer_t *) calloc(1, sizeof(arc_writer_t));
+    if (w == NULL) {
+        diag_error("out of memory");
+        fclose(f);
+        remove(path);
+        return NULL;
+    }
+    w->file = f;
+    w->err = fmax(max_err - ARC_SLACK, 0.0);
+
+    arc_file_header_t h = { ARC_MAGIC, ARC_VERSION, 0, max_err };
+    arc_write(w, &h, sizeof(h));
+    return w;
+}
+
+void arc_sample(arc_writer_t *w, int64_t t_ns, double value) {
+    if (!w->started) {
+        w->started = 1;
+        w->t0 = t_ns;
+        w->v0 = value;
+        w->t_last = t_ns;
+        w->lo = -INFINITY;
+        w->hi = INFINITY;
+        arc_vertex(w, t_ns, value);
+        w->stats.samples++;
+        return;
+    }
+    if (t_ns <= w->t_last) {
+        return;
+    }
+    w->stats.samples++;
+
+    double dt = (double)(t_ns - w->t0);
+    double lo = fmax(w->lo, (value - w->err - w->v0) / dt);
+    double hi = fmin(w->hi, (value + w->err - w->v0) / dt);
+    if (lo <= hi) {
+        w->lo = lo;
+        w->hi = hi;
+        w->t_last = t_ns;
+        return;
+    }
+
+    // The door has closed: end the line at the last sample it covered,
+    // and start the next one from there
+    double v_end = w->v0 + (w->lo + w->hi) / 2 * (double)(w->t_last - w->t0);
+    arc_vertex(w, w->t_last, v_end);
+    w->t0 = w->t_last;
+    w->v0 = v_end;
+    dt = (double)(t_ns - w->t0);
+    w->lo = (value - w->err - w->v0) / dt;
+    w->hi = (value + w->err - w->v0) / dt;
+    w->t_last = t_ns;
+}
+
+void arc_anchor(arc_writer_t *w, const tb_anchor_t *anchor) {
+    uint8_t tag = ARC_TAG_ANCHOR;
+    arc_write(w, &tag, 1);
+    arc_write(w, &anchor->mono_ns, sizeof(int64_t));
+    arc_write(w, &anchor->real_ns, sizeof(int64_t));
+}
+
+int arc_close(arc_writer_t *w, arc_stats_t *stats) {
+    if (w->started && w->t_last > w->t0) {
+        arc_vertex(w, w->t_last, w->v0 + (w->lo + w->hi) / 2 * (double)(w->t_last - w->t0));
+    }
+    if (0 != fclose(w->file)) {
+        w->write_failed = 1;
+    }
+    int ret = w->write_failed ? -1 : 0;
+    if (stats != NULL) {
+        *stats = w->stats;
+    }
+    free(w);
+    return ret;
+}
+
+FILE *arc_read_open(const char *path, arc_file_header_t *header) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        diag_error("could not open %s", path);
+        return NULL;
+    }
+    if (1 != fread(header, sizeof(*header), 1, f) || header->magic != ARC_MAGIC ||
+        header->version != ARC_VERSION) {
+        diag_error("%s is not a supported archive", path);
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+arc_kind_t arc_next(FILE *f, arc_record_t *rec) {
+    int tag = fgetc(f);
+    if (tag == ARC_TAG_VERTEX) {
+        if (1 == fread(&rec->t_ns, sizeof(rec->t_ns), 1, f) && 1 == fread(&rec->value, sizeof(rec->value), 1, f)) {
+            rec->kind = ARC_VERTEX;
+            return rec->kind;
+        }
+    } else if (tag == ARC_TAG_ANCHOR) {
+        if (1 == fread(&rec->anchor.mono_ns, sizeof(int64_t), 1, f) &&
+            1 == fread(&rec->anchor.real_ns, sizeof(int64_t), 1, f)) {
+            rec->kind = ARC_ANCHOR;
+            return rec->kind;
+        }
+    } else if (tag != EOF) {
+        diag_error("corrupt archive record (tag 0x%02x)", tag);
+    }
+    rec->kind = ARC_EOF;
+    return rec->kind;
+}
+
+double arc_interp(const arc_record_t *a, const arc_record_t *b, int64_t t_ns) {
+    if (b->t_ns == a->t_ns) {
+        return a->value;
+    }
+    return a->value + (b->value - a->value) * (double)(t_ns - a->t_ns) / (double)(b->t_ns - a->t_ns);
+}
@@ -0,0 +1,165 @@
+/**
+ * @file archive.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Bounded-error piecewise-linear archive of the filtered weight
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * Keeping years of readings doesn't need every bit of their noise, only
+ * the weight to within a known tolerance. An archive holds the filtered
+ * weight as a chain of straight lines between vertices, chosen so that
+ * every sample lies within max_err of the line. While a bird sits still
+ * or the perch is empty, one line covers thousands of samples.
+ *
+ * The vertices are picked by the swinging door algorithm: from the last
+ * vertex, each sample narrows the range of slopes (the "door") that pass
+ * within max_err of every sample so far. When a sample closes the door,
+ * the line ends at the previous sample's time, at the middle slope of
+ * the door, and a new line starts from there. Each sample costs a
+ * constant amount of work, and every sample is within max_err of the
+ * archived line (the encoder keeps a hair inside it, for rounding).
+ * Unlike the classic algorithm, a vertex needn't lie on a sample; that
+ * lets each line run as long as the tolerance allows.
+ *
+ * The file is an arc_file_header_t followed by tagged records:
+ *
+ *     'V' i64 t_ns, f64 value          a vertex
+ *     'A' i64 mono_ns, i64 real_ns     an epoch anchor
+ *
+ * Between two vertices the weight is interpolated linearly; times are
+ * nanoseconds since the start of the run, as in the text output. All
+ * fields are in host byte order and unaligned. See spiarchive.c for the
+ * tool which encodes, decodes and verifies archives.
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "timebase.h"
+
+/**
+ * @brief Magic number at the start of an archive ("SPIA")
+ */
+#define ARC_MAGIC 0x41495053u
+
+/**
+ * @brief The archive format version this code reads and writes
+ */
+#define ARC_VERSION 1
+
+// Record tags
+#define ARC_TAG_VERTEX 'V'
+#define ARC_TAG_ANCHOR 'A'
+
+/**
+ * @brief The header at the start of an archive
+ */
+typedef struct arc_file_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    double   max_err;       // Largest difference from any sample, in ADC counts
+} arc_file_header_t;
+
+/**
+ * @brief Figures for a finished archive
+ */
+typedef struct arc_stats {
+    uint64_t samples;       // Samples encoded
+    uint64_t vertices;      // Vertices written
+    uint64_t bytes;         // Bytes written to the file
+} arc_stats_t;
+
+typedef struct arc_writer arc_writer_t;
+
+/**
+ * @brief Creates an archive
+ *
+ * @param path The path of the file to create (replaced if it exists)
+ * @param max_err The largest difference allowed from any sample, in ADC counts
+ * @return arc_writer_t* The writer, or NULL on failure
+ */
+arc_writer_t *arc_open(const char *path, double max_err);
+
+/**
+ * @brief Encodes one sample of the filtered weight
+ *
+ * @remarks Samples must be given in order of increasing time; a sample
+ *          which doesn't move time forward is dropped.
+ *
+ * @param w The writer to encode into
+ * @param t_ns The sample's time, in nanoseconds since the start of the run
+ * @param value The filtered weight, in ADC counts
+ */
+void arc_sample(arc_writer_t *w, int64_t t_ns, double value);
+
+/**
+ * @brief Records an epoch anchor
+ *
+ * @param w The writer to record into
+ * @param anchor The anchor (monotonic time relative to the start of the run)
+ */
+void arc_anchor(arc_writer_t *w, const tb_anchor_t *anchor);
+
+/**
+ * @brief Ends the last line, closes the file and frees the writer
+ *
+ * @param w The writer to close
+ * @param stats The location to write the archive's figures to, or NULL
+ * @return int 0 if everything was written, nonzero if a write failed
+ */
+int arc_close(arc_writer_t *w, arc_stats_t *stats);
+
+/**
+ * @brief The kinds of record an archive contains
+ */
+typedef enum arc_kind {
+    ARC_EOF = 0,
+    ARC_VERTEX,
+    ARC_ANCHOR
+} arc_kind_t;
+
+/**
+ * @brief A single record read from an archive
+ */
+typedef struct arc_record {
+    arc_kind_t  kind;
+    int64_t     t_ns;       // A vertex's time
+    double      value;      // A vertex's weight, in ADC counts
+    tb_anchor_t anchor;     // An anchor
+} arc_record_t;
+
+/**
+ * @brief Opens an archive for reading
+ *
+ * @param path The path of the archive
+ * @param header The location to write the archive's header to
+ * @return FILE* The archive, positioned at its first record, or NULL on failure
+ */
+FILE *arc_read_open(const char *path, arc_file_header_t *header);
+
+/**
+ * @brief Reads the next record from an archive
+ *
+ * @param f The archive
+ * @param rec The location to write the record to
+ * @return arc_kind_t The kind of record read, or ARC_EOF at the end of the archive
+ */
+arc_kind_t arc_next(FILE *f, arc_record_t *rec);
+
+/**
+ * @brief Interpolates the archived weight between two vertices
+ *
+ * @param a The vertex at or before t_ns
+ * @param b The vertex after a
+ * @param t_ns The time to interpolate at
+ * @return double The archived weight at t_ns
+ */
+double arc_interp(const arc_record_t *a, const arc_record_t *b, int64_t t_ns);
+
+#endif // ARCHIVE_H
@@ -0,0 +1,1121 @@
+/**
+ * @file bench.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Micro-benchmarks for the reader's per-sample hot paths
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * Times the CPU-side work done for every sample, independent of the SPI
+ * bus, so that alternatives can be compared on the Pi itself. Each
+ * benchmark runs over the same pseudo-random input, checks that every
+ * alternative gives the same answer, and reports the best of several
+ * passes in nanoseconds per sample.
+ *
+ * The RLE section instead checks that a synthetic stream, and each
+ * recorded file given (out.txt, if none are and it exists), come back
+ * from an RLE file with their readings and anchors intact and their
+ * times within the file's tolerance, and that searching the file through
+ * its zone index finds the same stretches as a scan of every sample.
+ *
+ * Usage:
+ *
+ *     ./bench [samples [recorded_file ...]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "mcp3301.h"
+#include "adc_model.h"
+#include "timebase.h"
+#include "metrics.h"
+#include "filter.h"
+#include "filter_chain.h"
+#include "history.h"
+#include "pack13.h"
+#include "dist.h"
+#include "rle.h"
+#include "replay.h"
+
+// Number of timed passes per benchmark; the fastest is reported
+#define BENCH_PASSES 7
+
+// Fewest samples to run with: a whole history block, so also several
+// packed tiles and plenty of valid readings for the percentiles
+#define BENCH_MIN_SAMPLES HS_BLOCK_LEN
+
+// Keeps the compiler from optimizing away benchmark results
+static volatile int64_t bench_sink;
+
+static uint64_t prng_state = 0x5EED0083;
+
+static uint32_t prng_next(void) {
+    prng_state ^= prng_state >> 12;
+    prng_state ^= prng_state << 25;
+    prng_state ^= prng_state >> 27;
+    return (uint32_t)((prng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static void report(const char *name, int64_t best_ns, size_t n) {
+    printf("  %-28s %8.3f ns/sample\n", name, (double) best_ns / n);
+}
+
+/**
+ * @brief Times a block of code over BENCH_PASSES passes, and reports the
+ *        fastest per sample
+ *
+ * @remarks setup runs before each pass, untimed. The block comes last so
+ *          that commas in it need no parentheses; variables it leaves
+ *          results in must be declared outside it.
+ */
+#define BENCH_TIME_SETUP(name, n, setup, ...)                                       \
+    do {                                                                            \
+        int64_t bench_best = INT64_MAX;                                             \
+        for(int bench_pass = 0; bench_pass < BENCH_PASSES; bench_pass++) {          \
+            setup                                                                   \
+            int64_t bench_t0 = tb_mono_ns();                                        \
+            __VA_ARGS__                                                             \
+            int64_t bench_dt = tb_mono_ns() - bench_t0;                             \
+            bench_best = bench_dt < bench_best ? bench_dt : bench_best;             \
+        }                                                                           \
+        report(name, bench_best, n);                                                \
+    } while (0)
+
+/**
+ * @brief As BENCH_TIME_SETUP(), with nothing to set up
+ */
+#define BENCH_TIME(name, n, ...) BENCH_TIME_SETUP(name, n, , __VA_ARGS__)
+
+static int check(const char *name, const int16_t *expect, const int16_t *got, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        if (expect[i] != got[i]) {
+            printf("  %s: MISMATCH at %zu (%d != %d)\n", name, i, got[i], expect[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////
+/// Frame decoding
+
+static int bench_decode(size_t n) {
+    uint8_t *bytes = (uint8_t *) malloc(2 * n);
+    uint16_t *words = (uint16_t *) malloc(sizeof(uint16_t) * n);
+    int16_t *expect = (int16_t *) malloc(sizeof(int16_t) * n);
+    int16_t *out = (int16_t *) malloc(sizeof(int16_t) * n);
+    int failures = 0;
+
+    // The same frames as they would arrive in byte mode and in word mode,
+    // including garbage in the three leading bits which must be ignored
+    for(size_t i = 0; i < n; i++) {
+        uint16_t frame = prng_next() & 0xFFFF;
+        bytes[2 * i] = frame >> 8;
+        bytes[2 * i + 1] = frame & 0xFF;
+        words[i] = frame;
+        expect[i] = mcp3301_decode(bytes + 2 * i);
+    }
+
+    printf("decode (%zu frames)\n", n);
+
+    BENCH_TIME("bytes, one at a time", n, {
+        for(size_t i = 0; i < n; i++) {
+            out[i] = mcp3301_decode(bytes + 2 * i);
+        }
+    });
+    failures += check("bytes, one at a time", expect, out, n);
+
+    BENCH_TIME("bytes, bulk", n, {
+        mcp3301_decode_frames(bytes, out, n);
+    });
+    failures += check("bytes, bulk", expect, out, n);
+
+    BENCH_TIME("16-bit words, one at a time", n, {
+        for(size_t i = 0; i < n; i++) {
+            out[i] = mcp3301_decode_word(words[i]);
+        }
+    });
+    failures += check("16-bit words, one at a time", expect, out, n);
+
+    BENCH_TIME("16-bit words, bulk", n, {
+        mcp3301_decode_words(words, out, n);
+    });
+    failures += check("16-bit words, bulk", expect, out, n);
+
+    bench_sink = out[n - 1];
+    free(bytes);
+    free(words);
+    free(expect);
+    free(out);
+    return failures;
+}
+
+////////////////////////////////////////////////////////
+/// ADC model decoders
+
+/**
+ * @brief Times one model's scalar and SIMD bulk decoders against its
+ *        per-frame decoder
+ */
+#define BENCH_ADC_MODEL(model, T)                                                   \
+    static int bench_adc_##model(size_t n) {                                        \
+        uint8_t *frames = (uint8_t *) malloc(T##_FRAME_LEN * n);                    \
+        int16_t *expect = (int16_t *) malloc(sizeof(int16_t) * n);                  \
+        int16_t *out = (int16_t *) malloc(sizeof(int16_t) * n);                     \
+        int failures = 0;                                                           \
+        for(size_t i = 0; i < T##_FRAME_LEN * n; i++) {                             \
+            frames[i] = (uint8_t) prng_next();                                      \
+        }                                                                           \
+        for(size_t i = 0; i < n; i++) {                                             \
+            expect[i] = adc_##model##_decode(frames + i * T##_FRAME_LEN);           \
+        }                                                                           \
+        printf("adc_" #model " (%d-byte frames)\n", T##_FRAME_LEN);                 \
+        BENCH_TIME("scalar bulk", n, {                                              \
+            adc_##model##_decode_bulk(frames, out, n);                              \
+        });                                                                         \
+        failures += check("scalar bulk", expect, out, n);                           \
+        BENCH_TIME("simd bulk", n, {                                                \
+            adc_##model##_decode_simd(frames, out, n);                              \
+        });                                                                         \
+        failures += check("simd bulk", expect, out, n);                             \
+        bench_sink = out[n - 1];                                                    \
+        free(frames);                                                               \
+        free(expect);                                                               \
+        free(out);                                                                  \
+        return failures;                                                            \
+    }
+
+BENCH_ADC_MODEL(mcp3301, ADC_MCP3301)
+BENCH_ADC_MODEL(mcp3302, ADC_MCP3302)
+BENCH_ADC_MODEL(mcp3201, ADC_MCP3201)
+
+/**
+ * @brief Checks the traits-generated MCP3301 decoder against the original
+ *        hand-written one over every possible frame
+ */
+static int check_adc_mcp3301(void) {
+    uint8_t frame[2];
+    for(uint32_t w = 0; w <= 0xFFFF; w++) {
+        frame[0] = w >> 8;
+        frame[1] = w & 0xFF;
+        if (adc_mcp3301_decode(frame) != mcp3301_decode(frame)) {
+            printf("adc_mcp3301: MISMATCH for frame %04x\n", w);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////
+/// Metrics
+
+// Number of threads recording at once in the contended benchmarks
+#define BENCH_THREADS 4
+
+static metric_t *bench_counter;
+static metric_t *bench_hist;
+static atomic_ullong bench_shared;
+static size_t bench_per_thread;
+
+static void *bench_sharded_thread(void *arg) {
+    (void) arg;
+    for(size_t i = 0; i < bench_per_thread; i++) {
+        metric_inc(bench_counter);
+    }
+    return NULL;
+}
+
+static void *bench_shared_thread(void *arg) {
+    (void) arg;
+    for(size_t i = 0; i < bench_per_thread; i++) {
+        atomic_fetch_add_explicit(&bench_shared, 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+// Runs fn on BENCH_THREADS threads at once, and waits for them all
+static void bench_threads(void *(*fn)(void *)) {
+    pthread_t th[BENCH_THREADS];
+    for(int i = 0; i < BENCH_THREADS; i++) {
+        pthread_create(&th[i], NULL, fn, NULL);
+    }
+    for(int i = 0; i < BENCH_THREADS; i++) {
+        pthread_join(th[i], NULL);
+    }
+}
+
+static int bench_metrics(size_t n) {
+    int failures = 0;
+    bench_counter = metrics_counter("bench_total");
+    bench_hist = metrics_histogram("bench_ns");
+
+    printf("metrics (%zu events)\n", n);
+
+    BENCH_TIME("counter, one thread", n, {
+        for(size_t i = 0; i < n; i++) {
+            metric_inc(bench_counter);
+        }
+    });
+
+    BENCH_TIME("histogram, one thread", n, {
+        for(size_t i = 0; i < n; i++) {
+            metric_observe(bench_hist, i);
+        }
+    });
+
+    // The same increments from several threads at once, against a single
+    // shared atomic counter
+    int64_t before = metric_read(bench_counter);
+    bench_per_thread = n / BENCH_THREADS;
+    BENCH_TIME("counter, sharded, 4 threads", bench_per_thread * BENCH_THREADS, {
+        bench_threads(bench_sharded_thread);
+    });
+    BENCH_TIME("counter, shared, 4 threads", bench_per_thread * BENCH_THREADS, {
+        bench_threads(bench_shared_thread);
+    });
+
+    uint64_t expect = (uint64_t) BENCH_PASSES * BENCH_THREADS * bench_per_thread;
+    if ((uint64_t)(metric_read(bench_counter) - before) != expect || atomic_load(&bench_shared) != expect) {
+        printf("  metrics: MISMATCH in totals\n");
+        failures++;
+    }
+    metrics_hist_t h;
+    metric_read_hist(bench_hist, &h);
+    if (h.count != (uint64_t) BENCH_PASSES * n) {
+        printf("  metrics: MISMATCH in histogram count\n");
+        failures++;
+    }
+    return failures;
+}
+
+////////////////////////////////////////////////////////
+/// Filter chains
+
+#define BENCH_CHAIN_WINDOW 16
+#define BENCH_CHAIN_DECIMATE 4
+#define BENCH_CHAIN_OFFSET 120.0
+#define BENCH_CHAIN_SCALE 0.05
+
+FC_DEFINE_TRIM(trim16, BENCH_CHAIN_WINDOW)
+FC_DEFINE_CHAIN(perch, reject, trim16, decimate, calibrate)
+
+static void bench_chain_init(fc_perch_t *c) {
+    fc_reject_init(&c->reject, -4096, 4095);
+    fc_trim16_init(&c->trim16);
+    fc_decimate_init(&c->decimate, BENCH_CHAIN_DECIMATE);
+    fc_calibrate_init(&c->calibrate, BENCH_CHAIN_OFFSET, BENCH_CHAIN_SCALE);
+}
+
+// The same chain written out by hand as one loop
+static size_t bench_chain_fused(const int16_t *restrict in, double *restrict out, size_t n) {
+    double data[BENCH_CHAIN_WINDOW] = { 0 };
+    size_t location = 0;
+    unsigned count = 0;
+    size_t k = 0;
+    for(size_t i = 0; i < n; i++) {
+        if (in[i] < -4096 || in[i] > 4095) {
+            continue;
+        }
+        data[location] = in[i];
+        location = (location + 1) % BENCH_CHAIN_WINDOW;
+        double max = data[0];
+        double min = data[0];
+        double sum = max;
+        for(size_t j = 1; j < BENCH_CHAIN_WINDOW; j++) {
+            max = data[j] > max ? data[j] : max;
+            min = data[j] < min ? data[j] : min;
+            sum += data[j];
+        }
+        double avg = (sum - max - min) / (BENCH_CHAIN_WINDOW - 2);
+        if (++count < BENCH_CHAIN_DECIMATE) {
+            continue;
+        }
+        count = 0;
+        out[k++] = (avg - BENCH_CHAIN_OFFSET) * BENCH_CHAIN_SCALE;
+    }
+    return k;
+}
+
+// The same chain as the reader runs it, through filter.c
+static size_t bench_chain_runtime(filter_buffer_t *fb, const int16_t *in, double *out, size_t n) {
+    unsigned count = 0;
+    size_t k = 0;
+    for(size_t i = 0; i < n; i++) {
+        if (in[i] < -4096 || in[i] > 4095) {
+            continue;
+        }
+        fb_push(fb, in[i]);
+        double avg = filter_avg(fb);
+        if (++count < BENCH_CHAIN_DECIMATE) {
+            continue;
+        }
+        count = 0;
+        out[k++] = (avg - BENCH_CHAIN_OFFSET) * BENCH_CHAIN_SCALE;
+    }
+    return k;
+}
+
+static int check_chain(const char *name, const double *expect, size_t expect_n, const double *got, size_t n) {
+    if (n != expect_n) {
+        printf("  %s: MISMATCH in output count (%zu != %zu)\n", name, n, expect_n);
+        return 1;
+    }
+    for(size_t i = 0; i < n; i++) {
+        if (expect[i] != got[i]) {
+            printf("  %s: MISMATCH at %zu (%f != %f)\n", name, i, got[i], expect[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Times a composed filter chain against the same stages fused by
+ *        hand, and run through filter.c
+ */
+static int bench_chain(size_t n) {
+    int16_t *in = (int16_t *) malloc(sizeof(int16_t) * n);
+    double *expect = (double *) malloc(sizeof(double) * n);
+    double *out = (double *) malloc(sizeof(double) * n);
+    int failures = 0;
+    size_t expect_n = 0, k = 0;
+    fc_perch_t chain;
+    filter_buffer_t *fb = NULL;
+
+    // A slow wander with noise, and the odd read error
+    int level = 1000;
+    for(size_t i = 0; i < n; i++) {
+        uint32_t r = prng_next();
+        if (r % 1000 == 0) {
+            in[i] = MCP3301_READ_ERROR;
+            continue;
+        }
+        level += (int)((r >> 30) % 3) - 1;
+        in[i] = (int16_t)(level + (int)((r >> 8) & 15) - 8);
+    }
+
+    printf("filter chain (reject, trimmed mean of %d, decimate by %d, calibrate)\n",
+           BENCH_CHAIN_WINDOW, BENCH_CHAIN_DECIMATE);
+
+    BENCH_TIME("hand-fused", n, {
+        expect_n = bench_chain_fused(in, expect, n);
+    });
+
+    BENCH_TIME_SETUP("composed chain", n, { bench_chain_init(&chain); }, {
+        k = fc_perch_run(&chain, in, out, n);
+    });
+    failures += check_chain("composed chain", expect, expect_n, out, k);
+
+    // A fresh buffer for each pass
+    BENCH_TIME_SETUP("filter.c", n, {
+        if (fb != NULL) {
+            fb_del(fb);
+        }
+        fb = fb_new(BENCH_CHAIN_WINDOW);
+    }, {
+        k = bench_chain_runtime(fb, in, out, n);
+    });
+    failures += check_chain("filter.c", expect, expect_n, out, k);
+
+    bench_sink = (int64_t) out[k - 1];
+    fb_del(fb);
+    free(in);
+    free(expect);
+    free(out);
+    return failures;
+}
+
+////////////////////////////////////////////////////////
+/// Order statistics
+
+// The median by insertion sort, as filter_median() did before the networks
+static double bench_median_insertion(filter_buffer_t *fb) {
+    int sorted[fb->data_len];
+    for(size_t i = 0; i < fb->data_len; i++) {
+        int v = fb->data[i];
+        size_t j = i;
+        while (j > 0 && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    size_t mid = fb->data_len / 2;
+    return (sorted[mid - 1] + sorted[mid]) / 2.0;
+}
+
+static double bench_p90(filter_buffer_t *fb) {
+    return filter_percentile(fb, 90.0);
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *) a;
+    int y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+// Times and reports one filter over n readings, writing its outputs to out
+static void bench_filter(const char *name, filter_buffer_t *fb, double (*filter)(filter_buffer_t *),
+                         const int16_t *in, double *out, size_t n) {
+    BENCH_TIME_SETUP(name, n, { memset(fb->data, 0, sizeof(int) * fb->data_len); }, {
+        for(size_t i = 0; i < n; i++) {
+            fb_push(fb, in[i]);
+            out[i] = filter(fb);
+        }
+    });
+}
+
+/**
+ * @brief Checks the sorting networks against qsort(), and times the
+ *        filters built on them against filter_avg() and insertion sort
+ */
+static int bench_order(size_t n) {
+    static const size_t lens[] = { 8, 16, 32 };
+    int16_t *in = (int16_t *) malloc(sizeof(int16_t) * n);
+    double *expect = (double *) malloc(sizeof(double) * n);
+    double *out = (double *) malloc(sizeof(double) * n);
+    int failures = 0;
+
+    // Full-range values, to exercise the signed comparisons
+    for(size_t i = 0; i < n; i++) {
+        in[i] = (int16_t) prng_next();
+    }
+
+    for(size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+        size_t len = lens[l];
+        filter_buffer_t *fb = fb_new(len);
+        int sorted[len], ref[len];
+
+        for(size_t i = 0; i < 10000; i++) {
+            for(size_t j = 0; j < len; j++) {
+                // Narrow ranges now and then, to get plenty of ties
+                fb->data[j] = (i % 2) ? (int) prng_next() : (int)(prng_next() % 4);
+            }
+            fb_sorted(fb, sorted);
+            memcpy(ref, fb->data, sizeof(ref));
+            qsort(ref, len, sizeof(int), cmp_int);
+            if (memcmp(sorted, ref, sizeof(ref)) != 0) {
+                printf("  sort%zu: MISMATCH in window %zu\n", len, i);
+                failures++;
+                break;
+            }
+        }
+
+        printf("order statistics (window of %zu)\n", len);
+        bench_filter("filter_avg", fb, filter_avg, in, expect, n);
+        bench_filter("trimmed mean, network", fb, filter_avg_sorted, in, out, n);
+        failures += check_chain("trimmed mean, network", expect, n, out, n);
+        bench_filter("median, insertion sort", fb, bench_median_insertion, in, expect, n);
+        bench_filter("median, network", fb, filter_median, in, out, n);
+        failures += check_chain("median, network", expect, n, out, n);
+        bench_filter("90th percentile, network", fb, bench_p90, in, out, n);
+        fb_del(fb);
+    }
+
+    bench_sink = (int64_t) out[n - 1];
+    free(in);
+    free(expect);
+    free(out);
+    return failures;
+}
+
+////////////////////////////////////////////////////////
+/// History
+
+/**
+ * @brief Times appending to and unpacking a history, checks that every
+ *        sample comes back, and that a range summary matches a scan
+ */
+static int bench_history(size_t n) {
+    int64_t *t = (int64_t *) malloc(sizeof(int64_t) * n);
+    int16_t *v = (int16_t *) malloc(sizeof(int16_t) * n);
+    int64_t tile_t[HS_BLOCK_LEN];
+    int16_t tile_v[HS_BLOCK_LEN];
+    int failures = 0;
+    history_t *h = NULL;
+
+    // Single reads every 60 us or so, with a few us of jitter, a slow
+    // wander with noise, the odd read error and the odd long pause
+    int level = 1000;
+    int64_t now = 0;
+    for(size_t i = 0; i < n; i++) {
+        uint32_t r = prng_next();
+        now += 60000 + (int64_t)(r & 4095) - 2048 + ((r % 100000 == 0) ? 5000000000LL : 0);
+        level += (int)((r >> 30) % 3) - 1;
+        t[i] = now;
+        v[i] = (r % 1000 == 0) ? MCP3301_READ_ERROR : (int16_t)(level + (int)((r >> 8) & 15) - 8);
+    }
+
+    printf("history (%zu samples)\n", n);
+
+    BENCH_TIME_SETUP("append", n, {
+        if (h != NULL) {
+            hs_del(h);
+        }
+        h = hs_new(SIZE_MAX);
+    }, {
+        for(size_t i = 0; i < n; i++) {
+            hs_append(h, t[i], v[i]);
+        }
+    });
+
+    BENCH_TIME("unpack", n, {
+        int64_t sum = 0;
+        for(size_t b = 0; b < hs_blocks(h); b++) {
+            size_t k = hs_decode(h, b, tile_t, tile_v);
+            sum += tile_v[k - 1];
+        }
+        bench_sink = sum;
+    });
+
+    size_t i = 0;
+    for(size_t b = 0; b < hs_blocks(h) && failures == 0; b++) {
+        size_t k = hs_decode(h, b, tile_t, tile_v);
+        for(size_t j = 0; j < k; j++, i++) {
+            if (i >= n || tile_t[j] != t[i] || tile_v[j] != v[i]) {
+                printf("  history: MISMATCH at sample %zu\n", i);
+                failures++;
+                break;
+            }
+        }
+    }
+    if (failures == 0 && i != n) {
+        printf("  history: MISMATCH in sample count (%zu != %zu)\n", i, n);
+        failures++;
+    }
+
+    // A range which starts and ends mid-block
+    int64_t from = t[n / 3] + 1, to = t[2 * n / 3];
+    hs_summary_t s;
+    BENCH_TIME("range summary", 2 * n / 3 - n / 3, {
+        hs_range_summary(h, from, to, &s);
+    });
+    int64_t sum = 0;
+    uint32_t count = 0;
+    for(size_t j = 0; j < n; j++) {
+        if (t[j] >= from && t[j] <= to) {
+            count++;
+            sum += (v[j] == MCP3301_READ_ERROR) ? 0 : v[j];
+        }
+    }
+    if (s.count != count || s.sum != sum) {
+        printf("  history: MISMATCH in range summary\n");
+        failures++;
+    }
+
+    hs_usage_t u;
+    hs_get_usage(h, &u);
+    printf("  %-28s %8.3f bits/sample (%llu blocks)\n", "packed size", 8.0 * u.bytes / n,
+           (unsigned long long) u.blocks);
+    hs_del(h);
+    free(t);
+    free(v);
+    return failures;
+}
+
+////////////////////////////////////////////////////////
+/// Packed arrays
+
+// Sums the readings and their squares, skipping read errors
+static void bench_sums(const int16_t *v, size_t n, int64_t *sum, int64_t *sum_sq) {
+    for(size_t i = 0; i < n; i++) {
+        int32_t x = (v[i] == MCP3301_READ_ERROR) ? 0 : v[i];
+        *sum += x;
+        *sum_sq += x * x;
+    }
+}
+
+/**
+ * @brief Times packing and unpacking 13-bit arrays against copying the
+ *        same readings as int16_t, and statistics over unpacked tiles
+ *        against the same over an int16_t array
+ */
+static int bench_pack13(size_t n) {
+    size_t tiles = n / P13_TILE;
+    size_t m = tiles * P13_TILE;
+    int16_t *v = (int16_t *) malloc(sizeof(int16_t) * m);
+    int16_t *out = (int16_t *) malloc(sizeof(int16_t) * m);
+    uint8_t *packed = (uint8_t *) malloc(tiles * P13_TILE_BYTES);
+    int16_t tile[P13_TILE];
+    int failures = 0;
+
+    // The whole range, the odd read error, and nothing below -4095 (which
+    // doesn't survive the round trip)
+    for(size_t i = 0; i < m; i++) {
+        uint32_t r = prng_next();
+        v[i] = (r % 1000 == 0) ? MCP3301_READ_ERROR : (int16_t)((r >> 8) % 8191) - 4095;
+    }
+
+    printf("packed 13-bit arrays (%zu readings)\n", m);
+
+    BENCH_TIME("int16 memcpy", m, {
+        memcpy(out, v, sizeof(int16_t) * m);
+    });
+    bench_sink = out[m - 1];
+
+    BENCH_TIME("pack", m, {
+        p13_pack(v, tiles, packed);
+    });
+
+    BENCH_TIME_SETUP("unpack", m, { memset(out, 0, sizeof(int16_t) * m); }, {
+        p13_unpack(packed, tiles, out);
+    });
+    failures += check("unpack", v, out, m);
+
+    for(size_t i = 0; i < m && failures == 0; i += 7) {
+        if (p13_read(packed, i) != v[i]) {
+            printf("  read: MISMATCH at %zu (%d != %d)\n", i, p13_read(packed, i), v[i]);
+            failures++;
+        }
+    }
+
+    int64_t sum = 0, sum_sq = 0;
+    BENCH_TIME_SETUP("sums, int16", m, { sum = sum_sq = 0; }, {
+        bench_sums(v, m, &sum, &sum_sq);
+    });
+
+    int64_t tsum = 0, tsum_sq = 0;
+    BENCH_TIME_SETUP("sums, packed tiles", m, { tsum = tsum_sq = 0; }, {
+        for(size_t t = 0; t < tiles; t++) {
+            p13_unpack(packed + t * P13_TILE_BYTES, 1, tile);
+            bench_sums(tile, P13_TILE, &tsum, &tsum_sq);
+        }
+    });
+    if (tsum != sum || tsum_sq != sum_sq) {
+        printf("  sums, packed tiles: MISMATCH\n");
+        failures++;
+    }
+
+    // Appending in uneven pieces, which leaves and tops up partial tiles
+    p13_array_t *a = p13_new();
+    for(size_t i = 0, k = 1; i < m; i += k, k = k % 300 + 37) {
+        p13_append(a, v + i, (i + k <= m) ? k : m - i);
+    }
+    size_t i = 0;
+    for(size_t t = 0; t < p13_tiles(a) && failures == 0; t++) {
+        size_t k = p13_tile(a, t, tile);
+        failures += check("array", v + i, tile, k);
+        i += k;
+    }
+    if (failures == 0 && (i != m || p13_len(a) != m || p13_get(a, m / 2) != v[m / 2])) {
+        printf("  array: MISMATCH in length or random access\n");
+        failures++;
+    }
+    printf("  %-28s %8.1f%% of int16\n", "packed size", 100.0 * p13_bytes(a) / (sizeof(int16_t) * m));
+    p13_del(a);
+
+    free(v);
+    free(out);
+    free(packed);
+    return failures;
+}
+
+////////////////////////////////////////////////////////
+/// Exact histograms
+
+static int cmp_int16(const void *a, const void *b) {
+    return *(const int16_t *) a - *(const int16_t *) b;
+}
+
+// A percentile of sorted readings, interpolated as dist_percentile() does
+static double sorted_percentile(const int16_t *sorted, size_t k, double p) {
+    double pos = p / 100.0 * (double)(k - 1);
+    size_t lo = (size_t) pos;
+    if (lo + 1 >= k) {
+        return sorted[lo];
+    }
+    return sorted[lo] + (pos - lo) * (sorted[lo + 1] - sorted[lo]);
+}
+
+/**
+ * @brief Times counting readings into per-interval histograms and
+ *        merging them, and checks the merged median, mode, percentiles
+ *        and trimmed mean against sorting the readings
+ */
+static int bench_dist(size_t n) {
+    int64_t *t = (int64_t *) malloc(sizeof(int64_t) * n);
+    int16_t *v = (int16_t *) malloc(sizeof(int16_t) * n);
+    int16_t *valid = (int16_t *) malloc(sizeof(int16_t) * n);
+    int16_t *sorted = (int16_t *) malloc(sizeof(int16_t) * n);
+    dist_t *d = (dist_t *) malloc(sizeof(dist_t));
+    int failures = 0;
+    dist_log_t *l = NULL;
+
+    // Readings every 60 us, noise around a level which now and then steps
+    // (a bird landing or leaving), and the odd read error; one-second
+    // intervals
+    int level = 200;
+    for(size_t i = 0; i < n; i++) {
+        uint32_t r = prng_next();
+        level = (r % 50000 == 0) ? 200 + (int)((r >> 8) % 3000) : level;
+        t[i] = (int64_t) i * 60000;
+        v[i] = (r % 1000 == 0) ? MCP3301_READ_ERROR : (int16_t)(level + (int)((r >> 8) & 31) - 16);
+    }
+
+    printf("exact histograms (%zu samples)\n", n);
+
+    BENCH_TIME_SETUP("count", n, {
+        if (l != NULL) {
+            dist_log_del(l);
+        }
+        l = dist_log_new(1000000000);
+    }, {
+        for(size_t i = 0; i < n; i++) {
+            dist_log_sample(l, t[i], v[i]);
+        }
+    });
+
+    double median = 0.0, p1 = 0.0, p99 = 0.0, trimmed = 0.0;
+    int16_t mode = 0;
+    BENCH_TIME("merge and query", n, {
+        dist_clear(d);
+        dist_log_merge_range(l, INT64_MIN, INT64_MAX, d);
+        median = dist_median(d);
+        mode = dist_mode(d);
+        p1 = dist_percentile(d, 1.0);
+        p99 = dist_percentile(d, 99.0);
+        trimmed = dist_trimmed(d, 0.1);
+    });
+
+    // The same figures by sorting the readings
+    size_t k = 0;
+    for(size_t i = 0; i < n; i++) {
+        if (v[i] != MCP3301_READ_ERROR) {
+            valid[k++] = v[i];
+        }
+    }
+    BENCH_TIME_SETUP("sort (for comparison)", n, { memcpy(sorted, valid, sizeof(int16_t) * k); }, {
+        qsort(sorted, k, sizeof(int16_t), cmp_int16);
+    });
+
+    double expect_median = sorted_percentile(sorted, k, 50.0);
+    double expect_p99 = sorted_percentile(sorted, k, 99.0);
+    double expect_p1 = sorted_percentile(sorted, k, 1.0);
+    size_t trim = (size_t)(0.1 * k);
+    int64_t sum = 0;
+    for(size_t i = trim; i < k - trim; i++) {
+        sum += sorted[i];
+    }
+    double expect_trimmed = (double) sum / (k - 2 * trim);
+    size_t run = 0, best_run = 0;
+    int16_t expect_mode = sorted[0];
+    for(size_t i = 0; i < k; i++) {
+        run = (i > 0 && sorted[i] == sorted[i - 1]) ? run + 1 : 1;
+        if (run > best_run) {
+            best_run = run;
+            expect_mode = sorted[i];
+        }
+    }
+    if (median != expect_median || p1 != expect_p1 || p99 != expect_p99 || trimmed != expect_trimmed ||
+        mode != expect_mode || d->total != k) {
+        printf("  histograms: MISMATCH against sorting\n");
+        failures++;
+    }
+
+    printf("  %-28s %8.1f bytes/interval (%zu intervals)\n", "stored size",
+           (double) dist_log_bytes(l) / dist_log_intervals(l), dist_log_intervals(l));
+    dist_log_del(l);
+
+    // An interval holding nothing but read errors is kept, with its count
+    l = dist_log_new(1000000000);
+    int ret = dist_log_sample(l, 0, MCP3301_READ_ERROR);
+    ret |= dist_log_sample(l, 500000000, MCP3301_READ_ERROR);
+    ret |= dist_log_sample(l, 1500000000, 100);
+    dist_clear(d);
+    dist_log_merge_range(l, INT64_MIN, INT64_MAX, d);
+    if (ret != 0 || dist_log_intervals(l) != 2 || d->errors != 2 || d->total != 1) {
+        printf("  histograms: MISMATCH for an interval of read errors only\n");
+        failures++;
+    }
+    dist_log_del(l);
+    free(d);
+    free(t);
+    free(v);
+    free(valid);
+    free(sorted);
+    return failures;
+}
+
+////////////////////////////////////////////////////////
+/// RLE round trip
+
+/**
+ * @brief A sample, or an anchor, to record
+ */
+typedef struct bench_rec {
+    int     is_anchor;
+    int64_t t_ns;           // A sample's time, or an anchor's monotonic time
+    int64_t real_ns;        // An anchor's real time
+    int16_t val;            // A sample's reading
+} bench_rec_t;
+
+/**
+ * @brief Stretches found by rle_find()
+ */
+typedef struct bench_spans {
+    rle_span_t *spans;
+    size_t      n;
+    size_t      cap;
+} bench_spans_t;
+
+static void bench_span(const rle_span_t *span, void *arg) {
+    bench_spans_t *found = (bench_spans_t *) arg;
+    if (found->n == found->cap) {
+        found->cap = found->cap ? 2 * found->cap : 64;
+        found->spans = (rle_span_t *) realloc(found->spans, sizeof(rle_span_t) * found->cap);
+    }
+    found->spans[found->n++] = *span;
+}
+
+/**
+ * @brief Checks that searching an RLE file through its zone index finds
+ *        the same stretches as a scan of every sample replayed
+ */
+static int check_rle_find(const char *path, int threshold, int above) {
+    rle_file_header_t h;
+    FILE *f = rle_read_open(path, &h);
+    size_t n_zones = 0;
+    rle_zone_t *zones = (f != NULL) ? rle_read_zones(f, &n_zones) : NULL;
+    bench_spans_t found = { NULL, 0, 0 };
+    rle_find_stats_t st;
+    char name[64];
+    snprintf(name, sizeof(name), "%s %d", above ? "above" : "below", threshold);
+    if (zones == NULL || 0 != rle_find(f, zones, n_zones, threshold, above, bench_span, &found, &st)) {
+        printf("  %s: no zone index\n", name);
+        if (f != NULL) {
+            fclose(f);
+        }
+        return 1;
+    }
+    free(zones);
+    fclose(f);
+
+    // The same search over every sample in turn
+    replay_t *r = replay_open(path);
+    replay_record_t *rec = (replay_record_t *) malloc(sizeof(replay_record_t));
+    rle_span_t s = { 0 };
+    size_t j = 0;
+    int failures = 0;
+    for(;;) {
+        replay_kind_t kind = replay_next(r, rec);
+        if (kind == REPLAY_ANCHOR) {
+            continue;
+        }
+        int match = (kind == REPLAY_SAMPLE && rec->int_val != MCP3301_READ_ERROR &&
+                     (above ? rec->int_val > threshold : rec->int_val < threshold));
+        if (match) {
+            if (s.count == 0) {
+                s.t_first = rec->t_ns;
+                s.peak = rec->int_val;
+            }
+            s.t_last = rec->t_ns;
+            s.count++;
+            s.peak = (above ? rec->int_val > s.peak : rec->int_val < s.peak) ? rec->int_val : s.peak;
+        } else if (s.count > 0) {
+            const rle_span_t *e = (j < found.n) ? &found.spans[j] : NULL;
+            if (e == NULL || e->t_first != s.t_first || e->t_last != s.t_last || e->count != s.count ||
+                e->peak != s.peak) {
+                printf("  %s: MISMATCH in stretch %zu\n", name, j);
+                failures++;
+                break;
+            }
+            j++;
+            s.count = 0;
+        }
+        if (kind == REPLAY_EOF) {
+            break;
+        }
+    }
+    if (failures == 0 && j != found.n) {
+        printf("  %s: MISMATCH in stretch count (%zu != %zu)\n", name, found.n, j);
+        failures++;
+    }
+    printf("  %-28s %zu of %zu zones decoded (%zu stretches)\n", name, st.zones_decoded, st.zones, found.n);
+    replay_close(r);
+    free(rec);
+    free(found.spans);
+    return failures;
+}
+
+/**
+ * @brief Records a stream to an RLE file and replays it, checking that
+ *        the readings and anchors come back exactly and in order, and
+ *        every time within the tolerance
+ */
+static int check_rle(const char *name, const bench_rec_t *recs, size_t n, int64_t tol_ns) {
+    char path[] = "/tmp/bench_rle_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        printf("  %s: could not create a temporary file\n", name);
+        return 1;
+    }
+    close(fd);
+    rle_writer_t *w = rle_open(path, tol_ns);
+    if (w == NULL) {
+        unlink(path);
+        return 1;
+    }
+    size_t samples = 0;
+    for(size_t i = 0; i < n; i++) {
+        if (recs[i].is_anchor) {
+            tb_anchor_t a = { recs[i].t_ns, recs[i].real_ns };
+            rle_anchor(w, &a);
+        } else {
+            rle_sample(w, recs[i].t_ns, recs[i].val);
+            samples++;
+        }
+    }
+    rle_stats_t st;
+    if (0 != rle_close(w, &st)) {
+        printf("  %s: write failed\n", name);
+        unlink(path);
+        return 1;
+    }
+
+    replay_t *r = replay_open(path);
+    replay_record_t *rec = (replay_record_t *) malloc(sizeof(replay_record_t));
+    int failures = (r == NULL || rec == NULL);
+    size_t i = 0;
+    while (failures == 0 && REPLAY_EOF != replay_next(r, rec)) {
+        if (i >= n) {
+            printf("  %s: MISMATCH in record count (more than %zu)\n", name, n);
+            failures++;
+            break;
+        }
+        const bench_rec_t *e = &recs[i];
+        if ((rec->kind == REPLAY_ANCHOR) != e->is_anchor ||
+            (e->is_anchor ? rec->anchor.mono_ns != e->t_ns || rec->anchor.real_ns != e->real_ns
+                          : rec->int_val != e->val || llabs(rec->t_ns - e->t_ns) > tol_ns)) {
+            printf("  %s: MISMATCH at record %zu\n", name, i);
+            failures++;
+        }
+        i++;
+    }
+    if (failures == 0 && i != n) {
+        printf("  %s: MISMATCH in record count (%zu != %zu)\n", name, i, n);
+        failures++;
+    }
+    printf("  %-28s %8.3f bytes/sample (%llu segments)\n", name, samples ? (double) st.bytes / samples : 0.0,
+           (unsigned long long) st.segments);
+
+    // Searches for the readings above and below the middle of their range
+    int lo = INT16_MAX, hi = INT16_MIN;
+    for(size_t j = 0; j < n; j++) {
+        if (!recs[j].is_anchor && recs[j].val != MCP3301_READ_ERROR) {
+            lo = recs[j].val < lo ? recs[j].val : lo;
+            hi = recs[j].val > hi ? recs[j].val : hi;
+        }
+    }
+    if (failures == 0 && lo <= hi) {
+        failures += check_rle_find(path, (lo + hi) / 2, 1);
+        failures += check_rle_find(path, (lo + hi) / 2, 0);
+    }
+    if (r != NULL) {
+        replay_close(r);
+    }
+    free(rec);
+    unlink(path);
+    return failures;
+}
+
+/**
+ * @brief Round-trips a synthetic stream, and any recorded files, through
+ *        RLE files with exact timestamps and with a 20 us tolerance
+ */
+static int bench_rle(size_t n, char **paths, int n_paths) {
+    bench_rec_t *recs = (bench_rec_t *) malloc(sizeof(bench_rec_t) * n);
+    int failures = 0;
+
+    // Bursts of exactly spaced readings and stretches of jittery single
+    // reads, sitting on one or two codes with the odd step, read error
+    // and long pause, and an anchor now and then
+    int level = 1000;
+    int64_t now = 0;
+    for(size_t i = 0; i < n; i++) {
+        uint32_t r = prng_next();
+        if (i % 10000 == 5000) {
+            recs[i] = (bench_rec_t) { 1, now, 1700000000000000000LL + now, 0 };
+            continue;
+        }
+        int burst = (i / 4096) % 2;
+        now += burst ? 20833 : 60000 + (int64_t)(r & 4095) - 2048;
+        now += (r % 50000 == 0) ? 5000000000LL : 0;
+        level += (r % 3000 == 0) ? (int)((r >> 8) & 255) - 128 : 0;
+        recs[i] = (bench_rec_t) { 0, now, 0,
+                                  (r % 1000 == 0) ? MCP3301_READ_ERROR : (int16_t)(level + ((r >> 16) % 7 == 0)) };
+    }
+
+    printf("rle round trip (%zu records)\n", n);
+    failures += check_rle("synthetic, exact", recs, n, 0);
+    failures += check_rle("synthetic, 20 us", recs, n, 20000);
+
+    for(int p = 0; p < n_paths; p++) {
+        replay_t *r = replay_open(paths[p]);
+        if (r == NULL) {
+            failures++;
+            continue;
+        }
+        replay_record_t *rec = (replay_record_t *) malloc(sizeof(replay_record_t));
+        size_t k = 0;
+        while (REPLAY_EOF != replay_next(r, rec)) {
+            if (rec->kind == REPLAY_FRAME) {
+                continue;
+            }
+            if (k == n) {
+                n *= 2;
+                recs = (bench_rec_t *) realloc(recs, sizeof(bench_rec_t) * n);
+            }
+            recs[k++] = (rec->kind == REPLAY_ANCHOR)
+                            ? (bench_rec_t) { 1, rec->anchor.mono_ns, rec->anchor.real_ns, 0 }
+                            : (bench_rec_t) { 0, rec->t_ns, 0, rec->int_val };
+        }
+        replay_close(r);
+        free(rec);
+
+        char name[64];
+        snprintf(name, sizeof(name), "%.20s, exact", paths[p]);
+        failures += check_rle(name, recs, k, 0);
+        snprintf(name, sizeof(name), "%.20s, 20 us", paths[p]);
+        failures += check_rle(name, recs, k, 20000);
+    }
+    free(recs);
+    return failures;
+}
+
+////////////////////////////////////////////////////////
+/// Entry point
+
+int main(int argc, char** argv) {
+    size_t n = (argc > 1) ? (size_t) atol(argv[1]) : 1000000;
+    if (n < BENCH_MIN_SAMPLES) {
+        printf("Usage: %s [samples [recorded_file ...]]\n", argv[0]);
+        printf("       (samples must be at least %d)\n", BENCH_MIN_SAMPLES);
+        return EXIT_FAILURE;
+    }
+    char *default_path = "out.txt";
+    char **paths = (argc > 2) ? argv + 2 : &default_path;
+    int n_paths = (argc > 2) ? argc - 2 : (0 == access(default_path, R_OK));
+
+    int failures = 0;
+    failures += bench_decode(n);
+    failures += check_adc_mcp3301();
+    failures += bench_adc_mcp3301(n);
+    failures += bench_adc_mcp3302(n);
+    failures += bench_adc_mcp3201(n);
+    failures += bench_metrics(n);
+    failures += bench_chain(n);
+    failures += bench_order(n);
+    failures += bench_history(n);
+    failures += bench_pack13(n);
+    failures += bench_dist(n);
+    failures += bench_rle(n, paths, n_paths);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,386 @@
+/**
+ * @file broker.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the cross-process SPI broker
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "broker.h"
+#include "timebase.h"
+#include "diag.h"
+
+// Marks an initialized region ("SPIB")
+#define BRK_MAGIC 0x42495053u
+
+// Takes the region lock, recovering it if its holder died
+static void brk_lock(brk_shared_t *shm) {
+    if (EOWNERDEAD == pthread_mutex_lock(&shm->lock)) {
+        // Slot state is only ever changed in whole steps under the lock,
+        // so there is nothing to repair; the dead client's slot is
+        // reaped by the broker like any other
+        pthread_mutex_consistent(&shm->lock);
+    }
+}
+
+static void brk_unlock(brk_shared_t *shm) {
+    pthread_mutex_unlock(&shm->lock);
+}
+
+// Waits on cond for at most BRK_POLL_MS milliseconds
+static void brk_wait(brk_shared_t *shm, pthread_cond_t *cond) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_nsec += BRK_POLL_MS * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    if (EOWNERDEAD == pthread_cond_timedwait(cond, &shm->lock, &ts)) {
+        pthread_mutex_consistent(&shm->lock);
+    }
+}
+
+static int process_alive(pid_t pid) {
+    return 0 == kill(pid, 0) || errno != ESRCH;
+}
+
+static int settings_equal(const spi_settings_t *a, const spi_settings_t *b) {
+    return a->mode == b->mode && a->is_lsb_first == b->is_lsb_first &&
+           a->bits_per_word == b->bits_per_word && a->max_speed_hz == b->max_speed_hz;
+}
+
+////////////////////////////////////////////////////////
+/// Client side
+
+brk_client_t *brk_connect(const char *name, const spi_settings_t *settings, uint32_t target_us) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (0 > fd) {
+        diag_error("no broker at %s", name);
+        return NULL;
+    }
+    struct stat sb;
+    if (0 != fstat(fd, &sb) || (size_t) sb.st_size < sizeof(brk_shared_t)) {
+        diag_error("%s is not a broker region", name);
+        close(fd);
+        return NULL;
+    }
+    brk_shared_t *shm = mmap(NULL, sizeof(brk_shared_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        diag_error("could not map %s", name);
+        return NULL;
+    }
+    if (shm->magic != BRK_MAGIC || shm->size != sizeof(brk_shared_t) || !shm->running) {
+        diag_error("broker at %s is not running or is a different version", name);
+        munmap(shm, sizeof(brk_shared_t));
+        return NULL;
+    }
+
+    brk_slot_t *slot = NULL;
+    brk_lock(shm);
+    for(int i = 0; i < BRK_MAX_CLIENTS; i++) {
+        if (shm->slots[i].state == BRK_SLOT_FREE) {
+            slot = &shm->slots[i];
+            slot->state = BRK_SLOT_IDLE;
+            slot->pid = getpid();
+            slot->settings = *settings;
+            slot->target_ns = (target_us != 0 ? target_us : BRK_DEFAULT_TARGET_US) * 1000u;
+            memset(&slot->stats, 0, sizeof(slot->stats));
+            break;
+        }
+    }
+    brk_unlock(shm);
+    if (slot == NULL) {
+        diag_error("broker has no free client slots");
+        munmap(shm, sizeof(brk_shared_t));
+        return NULL;
+    }
+
+    brk_client_t *c = malloc(sizeof(brk_client_t));
+    if (c == NULL) {
+        diag_error("out of memory");
+        brk_lock(shm);
+        slot->state = BRK_SLOT_FREE;
+        brk_unlock(shm);
+        munmap(shm, sizeof(brk_shared_t));
+        return NULL;
+    }
+    c->shm = shm;
+    c->slot = slot;
+    return c;
+}
+
+void brk_disconnect(brk_client_t *c) {
+    if (c == NULL) {
+        return;
+    }
+    brk_lock(c->shm);
+    // A request can only be outstanding here if the broker died mid-way
+    c->slot->state = BRK_SLOT_FREE;
+    brk_unlock(c->shm);
+    munmap(c->shm, sizeof(brk_shared_t));
+    free(c);
+}
+
+int brk_transfer_frames(brk_client_t *c, const uint8_t *tx_frame, uint8_t *out,
+                        int frames, int frame_len, uint16_t delay_usecs) {
+    brk_shared_t *shm = c->shm;
+    brk_slot_t *slot = c->slot;
+    if (frames < 1 || frames > SPI_BURST_MAX || frame_len < 1 || frame_len > BRK_FRAME_MAX) {
+        diag_error("%d frames of %d bytes is too large", frames, frame_len);
+        return -1;
+    }
+
+    brk_lock(shm);
+    slot->frames = (uint16_t) frames;
+    slot->frame_len = (uint16_t) frame_len;
+    slot->delay_usecs = delay_usecs;
+    slot->has_tx = (tx_frame != NULL);
+    if (tx_frame != NULL) {
+        memcpy(slot->tx_frame, tx_frame, frame_len);
+    }
+    slot->submit_ns = tb_mono_ns();
+    slot->deadline_ns = slot->submit_ns + slot->target_ns;
+    slot->state = BRK_SLOT_PENDING;
+    pthread_cond_signal(&shm->work);
+
+    while (slot->state != BRK_SLOT_DONE && shm->running && process_alive(shm->broker_pid)) {
+        brk_wait(shm, &slot->done);
+    }
+
+    int ret = -1;
+    if (slot->state == BRK_SLOT_DONE) {
+        ret = slot->result;
+        if (ret > 0) {
+            memcpy(out, slot->rx, ret);
+        }
+    }
+    slot->state = BRK_SLOT_IDLE;
+    brk_unlock(shm);
+    return ret;
+}
+
+////////////////////////////////////////////////////////
+/// Broker side
+
+// Whether a region of this name is served by a live broker; sets *pid
+// to the broker's process if so
+static int region_live(const char *name, pid_t *pid) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (0 > fd) {
+        return 0;
+    }
+    struct stat sb;
+    int live = 0;
+    if (0 == fstat(fd, &sb) && (size_t) sb.st_size >= sizeof(brk_shared_t)) {
+        brk_shared_t *shm = mmap(NULL, sizeof(brk_shared_t), PROT_READ, MAP_SHARED, fd, 0);
+        if (shm != MAP_FAILED) {
+            live = (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) == BRK_MAGIC && shm->running &&
+                    shm->broker_pid != getpid() && process_alive(shm->broker_pid));
+            *pid = shm->broker_pid;
+            munmap(shm, sizeof(brk_shared_t));
+        }
+    }
+    close(fd);
+    return live;
+}
+
+brk_shared_t *brk_create(const char *name) {
+    // Only a stale region (its broker exited without cleaning up) is
+    // replaced; clients of a live one would be left on an orphaned copy
+    pid_t pid;
+    if (region_live(name, &pid)) {
+        diag_error("a broker (pid %d) is already serving %s", (int) pid, name);
+        return NULL;
+    }
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0660);
+    if (0 > fd) {
+        diag_error("could not create %s", name);
+        return NULL;
+    }
+    if (0 != ftruncate(fd, sizeof(brk_shared_t))) {
+        diag_error("could not size %s", name);
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    brk_shared_t *shm = mmap(NULL, sizeof(brk_shared_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        diag_error("could not map %s", name);
+        shm_unlink(name);
+        return NULL;
+    }
+    memset(shm, 0, sizeof(brk_shared_t));
+
+    pthread_mutexattr_t ma;
+    pthread_mutexattr_init(&ma);
+    pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&shm->lock, &ma);
+    pthread_mutexattr_destroy(&ma);
+
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setpshared(&ca, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&shm->work, &ca);
+    for(int i = 0; i < BRK_MAX_CLIENTS; i++) {
+        pthread_cond_init(&shm->slots[i].done, &ca);
+    }
+    pthread_condattr_destroy(&ca);
+
+    shm->broker_pid = getpid();
+    shm->size = sizeof(brk_shared_t);
+    shm->running = 1;
+    // Publish the magic last, so clients never see a half-built region
+    __atomic_store_n(&shm->magic, BRK_MAGIC, __ATOMIC_RELEASE);
+    return shm;
+}
+
+// Frees the slots of clients that exited without disconnecting
+static void reap_clients(brk_shared_t *shm) {
+    for(int i = 0; i < BRK_MAX_CLIENTS; i++) {
+        brk_slot_t *slot = &shm->slots[i];
+        if (slot->state != BRK_SLOT_FREE && slot->state != BRK_SLOT_ACTIVE && !process_alive(slot->pid)) {
+            slot->state = BRK_SLOT_FREE;
+        }
+    }
+}
+
+// The pending request with the earliest deadline (the earliest submitted
+// on a tie), or NULL if there is none
+static brk_slot_t *next_request(brk_shared_t *shm) {
+    brk_slot_t *best = NULL;
+    for(int i = 0; i < BRK_MAX_CLIENTS; i++) {
+        brk_slot_t *slot = &shm->slots[i];
+        if (slot->state != BRK_SLOT_PENDING) {
+            continue;
+        }
+        if (best == NULL || slot->deadline_ns < best->deadline_ns ||
+            (slot->deadline_ns == best->deadline_ns && slot->submit_ns < best->submit_ns)) {
+            best = slot;
+        }
+    }
+    return best;
+}
+
+// The nominal bus time of a slot's request
+static int64_t request_ns(const brk_slot_t *slot) {
+    int64_t frame_ns = 8000000000LL * slot->frame_len / (slot->settings.max_speed_hz ? slot->settings.max_speed_hz : 1);
+    return slot->frames * (frame_ns + slot->delay_usecs * 1000LL);
+}
+
+// Avoids a settings change where it costs no deadline: if the EDF choice
+// needs different settings, a pending request that can use the current
+// settings goes first, provided it fits in the EDF choice's slack
+static brk_slot_t *prefer_current(brk_shared_t *shm, brk_slot_t *best, const spi_settings_t *current, int64_t now) {
+    int64_t slack = best->deadline_ns - now - request_ns(best);
+    brk_slot_t *pick = best;
+    for(int i = 0; i < BRK_MAX_CLIENTS; i++) {
+        brk_slot_t *slot = &shm->slots[i];
+        if (slot->state == BRK_SLOT_PENDING && settings_equal(&slot->settings, current) &&
+            request_ns(slot) <= slack && (pick == best || slot->deadline_ns < pick->deadline_ns)) {
+            pick = slot;
+        }
+    }
+    return pick;
+}
+
+void brk_serve(brk_shared_t *shm, int fd, const volatile sig_atomic_t *running) {
+    spi_settings_t current = {0, 0, 0, 0};
+    int have_current = 0;
+    int64_t last_reap = 0;
+
+    brk_lock(shm);
+    while (*running) {
+        int64_t now = tb_mono_ns();
+        if (now - last_reap > BRK_POLL_MS * 1000000LL) {
+            reap_clients(shm);
+            last_reap = now;
+        }
+
+        brk_slot_t *slot = next_request(shm);
+        if (slot == NULL) {
+            brk_wait(shm, &shm->work);
+            continue;
+        }
+        if (have_current && !settings_equal(&slot->settings, &current)) {
+            slot = prefer_current(shm, slot, &current, now);
+        }
+
+        // The slot is the broker's until it is marked done, so the
+        // transfer can run without holding up other clients' submissions
+        slot->state = BRK_SLOT_ACTIVE;
+        spi_settings_t settings = slot->settings;
+        int changed = !have_current || !settings_equal(&settings, &current);
+        brk_unlock(shm);
+
+        int ret = 0;
+        if (changed) {
+            if (0 == (ret = spi_write_settings(fd, &settings))) {
+                current = settings;
+                have_current = 1;
+            } else {
+                have_current = 0;
+            }
+        }
+        if (0 == ret) {
+            ret = spi_transfer_frames(fd, slot->has_tx ? slot->tx_frame : NULL, slot->rx,
+                                      slot->frames, slot->frame_len, slot->delay_usecs);
+        } else {
+            ret = -1;
+        }
+        int64_t done_ns = tb_mono_ns();
+
+        brk_lock(shm);
+        if (changed) {
+            shm->settings_changes++;
+        }
+        uint64_t latency_ns = (uint64_t)(done_ns - slot->submit_ns);
+        slot->result = ret;
+        slot->stats.requests++;
+        slot->stats.frames += (ret > 0) ? slot->frames : 0;
+        slot->stats.missed += (done_ns > slot->deadline_ns);
+        slot->stats.latency_ns += latency_ns;
+        if (latency_ns > slot->stats.max_latency_ns) {
+            slot->stats.max_latency_ns = latency_ns;
+        }
+        slot->state = BRK_SLOT_DONE;
+        pthread_cond_signal(&slot->done);
+    }
+    brk_unlock(shm);
+}
+
+void brk_destroy(brk_shared_t *shm, const char *name) {
+    brk_lock(shm);
+    shm->running = 0;
+    for(int i = 0; i < BRK_MAX_CLIENTS; i++) {
+        pthread_cond_broadcast(&shm->slots[i].done);
+    }
+    brk_unlock(shm);
+    munmap(shm, sizeof(brk_shared_t));
+    shm_unlink(name);
+}
@@ -0,0 +1,222 @@
+/**
+ * @file broker.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Cross-process broker for sharing one SPI controller between programs
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * When two programs each call spi_init() on devices behind the same
+ * controller, they overwrite each other's settings, and spi.c's single
+ * saved copy of the original settings makes restoring them a coin toss.
+ * Instead, one broker process (spibrokerd) owns the controller, and
+ * client programs hand it their transfers through shared memory.
+ *
+ * The shared region (a POSIX shm object) holds one slot per client. A
+ * client claims a slot with its own SPI settings and a latency target,
+ * then submits transfers in the same shape as spi_transfer_frames(): a
+ * batch of fixed-length frames, optionally with a command frame to send.
+ * The broker:
+ *
+ * - applies a client's settings to the controller only when they differ
+ *   from the settings of the previous transfer, so clients sharing
+ *   settings never cause a reconfiguration;
+ * - serves pending requests earliest-deadline-first, where a request's
+ *   deadline is its submission time plus its client's latency target, so
+ *   a client with a tight target is served ahead of bulk readers without
+ *   starving them (every request's deadline eventually comes up);
+ * - when the earliest deadline needs a settings change, first serves any
+ *   request that can use the current settings and still leave the
+ *   earliest-deadline request time to finish on target, which keeps
+ *   clients with different settings from thrashing the controller;
+ * - frees the slots of clients that have exited without disconnecting.
+ *
+ * The region is guarded by a single robust, process-shared mutex. Each
+ * slot has its own condition variable for its client to wait on, and
+ * the broker waits on a shared one for new work. The bus transfer itself
+ * runs without the lock held.
+ */
+
+#ifndef BROKER_H
+#define BROKER_H
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "spi.h"
+
+/**
+ * @brief The default name of the broker's shared memory object
+ */
+#define BRK_DEFAULT_NAME "/spi_broker"
+
+/**
+ * @brief Maximum number of simultaneous clients
+ */
+#define BRK_MAX_CLIENTS 8
+
+/**
+ * @brief Longest frame a request may use, in bytes
+ */
+#define BRK_FRAME_MAX 8
+
+/**
+ * @brief Latency target for clients that don't set one, in microseconds
+ */
+#define BRK_DEFAULT_TARGET_US 10000
+
+/**
+ * @brief How often the broker and waiting clients check on each other, in milliseconds
+ */
+#define BRK_POLL_MS 20
+
+/**
+ * @brief The states of a client slot
+ */
+enum brk_slot_state {
+    BRK_SLOT_FREE = 0,  // Not claimed by any client
+    BRK_SLOT_IDLE,      // Claimed, no request outstanding
+    BRK_SLOT_PENDING,   // Request waiting to be scheduled
+    BRK_SLOT_ACTIVE,    // Request being transferred by the broker
+    BRK_SLOT_DONE       // Request finished; result is valid
+};
+
+/**
+ * @brief Per-client counters, kept by the broker
+ */
+typedef struct brk_slot_stats {
+    uint64_t requests;     // Requests served
+    uint64_t frames;       // Frames transferred
+    uint64_t missed;       // Requests finished after their deadline
+    uint64_t latency_ns;      // Total time from submission to completion
+    uint64_t max_latency_ns;  // Longest time from submission to completion
+} brk_slot_stats_t;
+
+/**
+ * @brief One client's slot in the shared region
+ *
+ * @remarks Treat the members as private; use the brk_* functions.
+ */
+typedef struct brk_slot {
+    pthread_cond_t   done;           // Signalled when a request finishes
+    int32_t          state;          // enum brk_slot_state
+    pid_t            pid;            // The client process
+    spi_settings_t   settings;       // The client's SPI settings
+    uint32_t         target_ns;      // The client's latency target
+
+    // The current request
+    int64_t          deadline_ns;    // CLOCK_MONOTONIC time to finish by
+    int64_t          submit_ns;      // CLOCK_MONOTONIC time of submission
+    uint16_t         frames;
+    uint16_t         frame_len;
+    uint16_t         delay_usecs;
+    uint16_t         has_tx;
+    int32_t          result;         // Bytes transferred, or -1
+    uint8_t          tx_frame[BRK_FRAME_MAX];
+    uint8_t          rx[SPI_BURST_MAX * BRK_FRAME_MAX];
+
+    brk_slot_stats_t stats;
+} brk_slot_t;
+
+/**
+ * @brief The layout of the broker's shared memory object
+ *
+ * @remarks Treat the members as private; use the brk_* functions.
+ */
+typedef struct brk_shared {
+    uint32_t        magic;
+    uint32_t        size;            // sizeof(brk_shared_t), as a version check
+    int32_t         running;         // Cleared when the broker exits
+    pid_t           broker_pid;      // So clients can tell if the broker died
+    pthread_mutex_t lock;            // Guards everything below
+    pthread_cond_t  work;            // Signalled when a request is submitted
+    uint64_t        settings_changes;
+    brk_slot_t      slots[BRK_MAX_CLIENTS];
+} brk_shared_t;
+
+/**
+ * @brief A client's connection to the broker
+ */
+typedef struct brk_client {
+    brk_shared_t *shm;
+    brk_slot_t   *slot;
+} brk_client_t;
+
+////////////////////////////////////////////////////////
+/// Client side
+
+/**
+ * @brief Connects to a running broker and claims a client slot
+ *
+ * @param name The broker's shared memory object name (e.g. BRK_DEFAULT_NAME)
+ * @param settings The SPI settings this client's transfers need
+ * @param target_us The latency target for this client's requests, in
+ *                  microseconds (0 for BRK_DEFAULT_TARGET_US)
+ * @return brk_client_t* The connection, or NULL on failure
+ */
+brk_client_t *brk_connect(const char *name, const spi_settings_t *settings, uint32_t target_us);
+
+/**
+ * @brief Releases the client slot and disconnects from the broker
+ *
+ * @param c The connection to close
+ */
+void brk_disconnect(brk_client_t *c);
+
+/**
+ * @brief Transfers a burst of fixed-length frames through the broker
+ *
+ * @remarks Blocks until the broker has run the transfer. The arguments
+ *          mean the same as for spi_transfer_frames(), except that
+ *          frame_len may be at most BRK_FRAME_MAX.
+ *
+ * @param c The connection to transfer through
+ * @param tx_frame The frame_len bytes to send for each frame, or NULL to send zeros
+ * @param out The memory buffer to write the data to (frames * frame_len bytes)
+ * @param frames The number of frames to transfer (at most SPI_BURST_MAX)
+ * @param frame_len The length of each frame, in bytes
+ * @param delay_usecs The delay after each frame, in microseconds
+ * @return int The number of bytes read, or -1 for errors (including the broker exiting)
+ */
+int brk_transfer_frames(brk_client_t *c, const uint8_t *tx_frame, uint8_t *out,
+                        int frames, int frame_len, uint16_t delay_usecs);
+
+////////////////////////////////////////////////////////
+/// Broker side
+
+/**
+ * @brief Creates and initializes the broker's shared memory object
+ *
+ * @remarks A stale object with the same name (one whose broker has
+ *          exited) is replaced. If a live broker still serves the name,
+ *          this fails rather than take it over.
+ *
+ * @param name The shared memory object name
+ * @return brk_shared_t* The mapped region, or NULL on failure (including
+ *         when another broker is running)
+ */
+brk_shared_t *brk_create(const char *name);
+
+/**
+ * @brief Serves client requests on an open SPI device while *running is nonzero
+ *
+ * @param shm The region from brk_create()
+ * @param fd The SPI device file descriptor (from spi_init())
+ * @param running Checked at least every BRK_POLL_MS milliseconds (e.g. a
+ *                flag cleared by a signal handler)
+ */
+void brk_serve(brk_shared_t *shm, int fd, const volatile sig_atomic_t *running);
+
+/**
+ * @brief Wakes any waiting clients with an error, then unmaps and removes
+ *        the shared memory object
+ *
+ * @param shm The region from brk_create()
+ * @param name The shared memory object name
+ */
+void brk_destroy(brk_shared_t *shm, const char *name);
+
+#endif // BROKER_H
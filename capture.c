@@ -0,0 +1,301 @@
+/**
+ * @file capture.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of raw SPI frame capture
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "capture.h"
+#include "diag.h"
+#include "timebase.h"
+#include "latency.h"
+
+// Longest record: an anchor
+#define CAP_RECORD_MAX (1 + 2 * sizeof(int64_t))
+
+/**
+ * @brief A FIFO of buffer indices
+ */
+typedef struct cap_queue {
+    int items[CAP_BUFS];
+    int head;
+    int count;
+} cap_queue_t;
+
+struct capture {
+    int             fd;
+    int             frame_len;
+    int64_t         t_base_ns;
+
+    // The buffer being filled by the sampler, or -1 if none was free
+    int             cur;
+    uint8_t        *pos;
+    uint8_t        *end;
+    int64_t         last_t;
+
+    uint8_t        *bufs[CAP_BUFS];
+    size_t          lens[CAP_BUFS];
+    cap_queue_t     free_q;
+    cap_queue_t     full_q;
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+    int             stopping;
+    int             write_failed;
+    pthread_t       thread;
+
+    cap_stats_t     stats;
+};
+
+static void q_push(cap_queue_t *q, int item) {
+    q->items[(q->head + q->count) % CAP_BUFS] = item;
+    q->count++;
+}
+
+static int q_pop(cap_queue_t *q) {
+    int item = q->items[q->head];
+    q->head = (q->head + 1) % CAP_BUFS;
+    q->count--;
+    return item;
+}
+
+static int write_all(int fd, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Records the latency of every frame in a written buffer, walking its
+// records to recover each frame's time
+static void cap_observe(const capture_t *c, const uint8_t *p, size_t len, int64_t now_ns) {
+    const uint8_t *end = p + len;
+    int64_t t_ns = 0;
+    uint32_t dt;
+    while (p < end) {
+        uint8_t tag = *p++;
+        if (tag == CAP_TAG_TIME) {
+            memcpy(&t_ns, p, sizeof(t_ns));
+            p += sizeof(t_ns);
+        } else if (tag == CAP_TAG_FRAME) {
+            memcpy(&dt, p, sizeof(dt));
+            t_ns += dt;
+            p += sizeof(dt) + 1 + c->frame_len;
+            lat_observe(LAT_CAPTURE, now_ns, c->t_base_ns + t_ns);
+        } else {
+            p += 2 * sizeof(int64_t);
+        }
+    }
+}
+
+static void *cap_main(void *arg) {
+    capture_t *c = (capture_t *) arg;
+
+    pthread_mutex_lock(&c->lock);
+    for (;;) {
+        while (c->full_q.count == 0 && !c->stopping) {
+            pthread_cond_wait(&c->changed, &c->lock);
+        }
+        if (c->full_q.count == 0) {
+            break;
+        }
+        int i = q_pop(&c->full_q);
+        pthread_mutex_unlock(&c->lock);
+
+        int ret = write_all(c->fd, c->bufs[i], c->lens[i]);
+
+        if (0 == ret) {
+            cap_observe(c, c->bufs[i], c->lens[i], tb_mono_ns());
+        }
+
+        pthread_mutex_lock(&c->lock);
+        if (0 != ret) {
+            c->write_failed = 1;
+        } else {
+            c->stats.bytes += c->lens[i];
+        }
+        q_push(&c->free_q, i);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+// Starts filling a free buffer, beginning with a time base record
+static void cap_begin_buffer(capture_t *c, int64_t t_ns) {
+    pthread_mutex_lock(&c->lock);
+    c->cur = (c->free_q.count > 0) ? q_pop(&c->free_q) : -1;
+    pthread_mutex_unlock(&c->lock);
+    if (c->cur < 0) {
+        return;
+    }
+    c->pos = c->bufs[c->cur];
+    c->end = c->pos + CAP_BUF_LEN;
+    *c->pos++ = CAP_TAG_TIME;
+    memcpy(c->pos, &t_ns, sizeof(t_ns));
+    c->pos += sizeof(t_ns);
+    c->last_t = t_ns;
+}
+
+// Hands the current buffer (if any) to the writer thread
+static void cap_end_buffer(capture_t *c) {
+    if (c->cur < 0) {
+        return;
+    }
+    pthread_mutex_lock(&c->lock);
+    c->lens[c->cur] = c->pos - c->bufs[c->cur];
+    q_push(&c->full_q, c->cur);
+    pthread_cond_signal(&c->changed);
+    pthread_mutex_unlock(&c->lock);
+    c->cur = -1;
+}
+
+// Makes room for a record, moving on to a new buffer if needed. Returns
+// zero if there is nowhere to put it.
+static int cap_reserve(capture_t *c, int64_t t_ns) {
+    if (c->cur >= 0 && c->end - c->pos < (ptrdiff_t)(CAP_RECORD_MAX + c->frame_len + 1 + sizeof(int64_t))) {
+        cap_end_buffer(c);
+    }
+    if (c->cur < 0) {
+        cap_begin_buffer(c, t_ns);
+    }
+    return c->cur >= 0;
+}
+
+capture_t *cap_open(const char *path, int frame_len, uint32_t flags, uint32_t speed_hz, int64_t t_base_ns) {
+    if (frame_len < 1 || frame_len > CAP_FRAME_MAX) {
+        diag_error("frames of %d bytes are not supported", frame_len);
+        return NULL;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (0 > fd) {
+        diag_error("could not create %s", path);
+        return NULL;
+    }
+    cap_file_header_t h = { CAP_MAGIC, CAP_VERSION, (uint16_t) frame_len, flags, speed_hz };
+    if (0 != write_all(fd, (const uint8_t *) &h, sizeof(h))) {
+        diag_error("could not write to %s", path);
+        close(fd);
+        return NULL;
+    }
+
+    capture_t *c = calloc(1, sizeof(capture_t));
+    if (NULL == c) {
+        diag_error("out of memory");
+        close(fd);
+        remove(path);
+        return NULL;
+    }
+    c->fd = fd;
+    c->frame_len = frame_len;
+    c->t_base_ns = t_base_ns;
+    c->cur = -1;
+    c->stats.bytes = sizeof(h);
+    for(int i = 0; i < CAP_BUFS; i++) {
+        c->bufs[i] = malloc(CAP_BUF_LEN);
+        if (NULL == c->bufs[i]) {
+            diag_error("out of memory");
+            for(int j = 0; j < i; j++) {
+                free(c->bufs[j]);
+            }
+            close(fd);
+            remove(path);
+            free(c);
+            return NULL;
+        }
+        q_push(&c->free_q, i);
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->changed, NULL);
+    if (0 != pthread_create(&c->thread, NULL, cap_main, c)) {
+        diag_error("could not start writer thread");
+        for(int i = 0; i < CAP_BUFS; i++) {
+            free(c->bufs[i]);
+        }
+        close(fd);
+        remove(path);
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+void cap_frame(capture_t *c, int64_t t_ns, int status, const uint8_t *frame) {
+    if (!cap_reserve(c, t_ns)) {
+        c->stats.dropped++;
+        return;
+    }
+    // Out-of-order or widely spaced frames get a new time base
+    int64_t dt = t_ns - c->last_t;
+    if (dt < 0 || dt > UINT32_MAX) {
+        *c->pos++ = CAP_TAG_TIME;
+        memcpy(c->pos, &t_ns, sizeof(t_ns));
+        c->pos += sizeof(t_ns);
+        dt = 0;
+    }
+    uint32_t dt32 = (uint32_t) dt;
+    *c->pos++ = CAP_TAG_FRAME;
+    memcpy(c->pos, &dt32, sizeof(dt32));
+    c->pos += sizeof(dt32);
+    *c->pos++ = (uint8_t)(int8_t) status;
+    memcpy(c->pos, frame, c->frame_len);
+    c->pos += c->frame_len;
+    c->last_t = t_ns;
+    c->stats.frames++;
+}
+
+void cap_anchor(capture_t *c, const tb_anchor_t *anchor) {
+    if (!cap_reserve(c, anchor->mono_ns)) {
+        return;
+    }
+    *c->pos++ = CAP_TAG_ANCHOR;
+    memcpy(c->pos, &anchor->mono_ns, sizeof(int64_t));
+    memcpy(c->pos + sizeof(int64_t), &anchor->real_ns, sizeof(int64_t));
+    c->pos += 2 * sizeof(int64_t);
+}
+
+int cap_close(capture_t *c, cap_stats_t *stats) {
+    cap_end_buffer(c);
+    pthread_mutex_lock(&c->lock);
+    c->stopping = 1;
+    pthread_cond_signal(&c->changed);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->thread, NULL);
+
+    int failed = c->write_failed;
+    if (0 != close(c->fd)) {
+        failed = 1;
+    }
+    if (stats != NULL) {
+        *stats = c->stats;
+    }
+    for(int i = 0; i < CAP_BUFS; i++) {
+        free(c->bufs[i]);
+    }
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->changed);
+    free(c);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * @file capture.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Raw SPI frame capture to a compact binary file
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * The text output only holds decoded readings, so a decoding or filter
+ * bug can't be reproduced from it. A capture file instead holds the
+ * frames exactly as they came off the bus, with their timestamps and the
+ * status of the transfer that read them; replaying one (see replay.h)
+ * runs the very same bytes back through decoding.
+ *
+ * The file is a cap_file_header_t followed by tagged records:
+ *
+ *     'F' u32 dt_ns, i8 status, frame[frame_len]   a frame
+ *     'T' i64 t_ns                                 sets the time base
+ *     'A' i64 mono_ns, i64 real_ns                 an epoch anchor
+ *
+ * A frame's time is the previous frame's time (or the last 'T') plus
+ * dt_ns; times are nanoseconds since the start of the run, as in the
+ * text output. status is the byte count the transfer returned, or -1.
+ * All fields are in host byte order and unaligned. A frame record for
+ * the MCP3301 is 8 bytes, against 20 or more for a line of text.
+ *
+ * Records are appended to one of a few large buffers in memory. When a
+ * buffer fills, it is handed to a writer thread and the sampler carries
+ * on in the next one, so the sampler never waits on the disk. Each
+ * buffer starts with a 'T' record, which makes every buffer decodable
+ * on its own; if the disk falls so far behind that no buffer is free,
+ * frames are dropped (and counted) rather than stalling the sampler.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+
+#include "timebase.h"
+
+/**
+ * @brief Magic number at the start of a capture file ("SPIC")
+ */
+#define CAP_MAGIC 0x43495053u
+
+/**
+ * @brief The capture format version this code reads and writes
+ */
+#define CAP_VERSION 1
+
+/**
+ * @brief Set in the header's flags when frames were read as 16-bit words
+ *        (in host byte order) rather than bytes in bus order
+ */
+#define CAP_FLAG_WORDS 0x1u
+
+/**
+ * @brief Longest frame a capture can hold, in bytes
+ */
+#define CAP_FRAME_MAX 8
+
+/**
+ * @brief Size of each capture buffer, in bytes
+ */
+#define CAP_BUF_LEN (256 * 1024)
+
+/**
+ * @brief Number of capture buffers
+ */
+#define CAP_BUFS 4
+
+// Record tags
+#define CAP_TAG_FRAME  'F'
+#define CAP_TAG_TIME   'T'
+#define CAP_TAG_ANCHOR 'A'
+
+/**
+ * @brief The header at the start of a capture file
+ */
+typedef struct cap_file_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t frame_len;     // Bytes per frame
+    uint32_t flags;         // CAP_FLAG_*
+    uint32_t speed_hz;      // The bus speed the frames were read at
+} cap_file_header_t;
+
+/**
+ * @brief Figures for a finished capture
+ */
+typedef struct cap_stats {
+    uint64_t frames;        // Frames written
+    uint64_t dropped;       // Frames dropped because no buffer was free
+    uint64_t bytes;         // Bytes written to the file
+} cap_stats_t;
+
+typedef struct capture capture_t;
+
+/**
+ * @brief Creates a capture file and starts its writer thread
+ *
+ * @param path The path of the file to create (replaced if it exists)
+ * @param frame_len The length of each frame, in bytes (at most CAP_FRAME_MAX)
+ * @param flags CAP_FLAG_* describing the frames
+ * @param speed_hz The bus speed, recorded for reference
+ * @param t_base_ns The CLOCK_MONOTONIC time (in nanoseconds) of the start of the
+ *                  run, to measure how long frames wait before being written
+ * @return capture_t* The capture, or NULL on failure
+ */
+capture_t *cap_open(const char *path, int frame_len, uint32_t flags, uint32_t speed_hz, int64_t t_base_ns);
+
+/**
+ * @brief Records one raw frame
+ *
+ * @remarks Only one thread may record into a capture.
+ *
+ * @param c The capture to record into
+ * @param t_ns The frame's time, in nanoseconds since the start of the run
+ * @param status The byte count the transfer returned, or -1
+ * @param frame The frame_len bytes of the frame
+ */
+void cap_frame(capture_t *c, int64_t t_ns, int status, const uint8_t *frame);
+
+/**
+ * @brief Records an epoch anchor
+ *
+ * @param c The capture to record into
+ * @param anchor The anchor (monotonic time relative to the start of the run)
+ */
+void cap_anchor(capture_t *c, const tb_anchor_t *anchor);
+
+/**
+ * @brief Writes out everything recorded, closes the file and frees the capture
+ *
+ * @param c The capture to close
+ * @param stats The location to write the capture's figures to, or NULL
+ * @return int 0 if everything was written, nonzero if a write failed
+ */
+int cap_close(capture_t *c, cap_stats_t *stats);
+
+#endif // CAPTURE_H
@@ -0,0 +1,68 @@
+/**
+ * @file clocksrc.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the pluggable clock source
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <time.h>
+
+#include <stdint.h>
+
+#include <assert.h>
+
+#include "clocksrc.h"
+#include "timebase.h"
+
+void clk_init_real(clock_source_t *clk) {
+    clk->kind = CLOCK_KIND_REAL;
+    clk->speed = 1.0;
+    clk->virt_ns = 0;
+    clk->paced = 0;
+    clk->pace_virt0 = 0;
+    clk->pace_real0 = 0;
+}
+
+void clk_init_virtual(clock_source_t *clk, double speed) {
+    assert(speed >= 0.0);
+    clk_init_real(clk);
+    clk->kind = CLOCK_KIND_VIRTUAL;
+    clk->speed = speed;
+}
+
+int64_t clk_now_ns(const clock_source_t *clk) {
+    if (clk->kind == CLOCK_KIND_REAL) {
+        return tb_mono_ns();
+    }
+    return clk->virt_ns;
+}
+
+void clk_advance_to(clock_source_t *clk, int64_t virt_ns) {
+    if (clk->kind != CLOCK_KIND_VIRTUAL || virt_ns <= clk->virt_ns) {
+        return;
+    }
+    clk->virt_ns = virt_ns;
+    if (clk->speed == 0.0) {
+        return;
+    }
+
+    // Pacing is measured from the first advance rather than from time 0,
+    // so that a recording which starts late doesn't stall at startup
+    if (!clk->paced) {
+        clk->paced = 1;
+        clk->pace_virt0 = virt_ns;
+        clk->pace_real0 = tb_mono_ns();
+        return;
+    }
+
+    int64_t due = clk->pace_real0 + (int64_t)((double)(virt_ns - clk->pace_virt0) / clk->speed);
+    struct timespec ts = { (time_t)(due / 1000000000LL), (long)(due % 1000000000LL) };
+    // An interrupted sleep (e.g. ctrl-C) returns early on purpose, so that
+    // the caller gets a chance to notice the signal
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
@@ -0,0 +1,84 @@
+/**
+ * @file clocksrc.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Pluggable clock source: real monotonic time or virtual replay time
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * Everything in the reader that needs "now" asks a clock_source_t rather
+ * than the system. A real clock source reads CLOCK_MONOTONIC. A virtual
+ * clock source only moves when the replay backend advances it to the
+ * timestamp of the next recorded sample, so a replayed run produces the
+ * same output every time regardless of how fast the machine is.
+ *
+ * When advancing, a virtual clock can optionally pace itself against the
+ * real clock: a speed of 1 replays in real time, a speed of N replays N
+ * times faster, and a speed of 0 doesn't wait at all.
+ */
+
+#ifndef CLOCKSRC_H
+#define CLOCKSRC_H
+
+#include <stdint.h>
+
+/**
+ * @brief The kind of time a clock_source_t provides
+ */
+typedef enum clock_kind {
+    CLOCK_KIND_REAL,
+    CLOCK_KIND_VIRTUAL
+} clock_kind_t;
+
+/**
+ * @brief A source of "now" for the reader
+ *
+ * @remarks Treat the members as private.
+ */
+typedef struct clock_source {
+    clock_kind_t kind;
+    double       speed;
+    int64_t      virt_ns;
+    int          paced;
+    int64_t      pace_virt0;
+    int64_t      pace_real0;
+} clock_source_t;
+
+/**
+ * @brief Initializes a clock source backed by CLOCK_MONOTONIC
+ *
+ * @param clk The clock source to initialize
+ */
+void clk_init_real(clock_source_t *clk);
+
+/**
+ * @brief Initializes a virtual clock source, starting at time 0
+ *
+ * @param clk The clock source to initialize
+ * @param speed The replay speed relative to real time, or 0 for unbounded
+ */
+void clk_init_virtual(clock_source_t *clk, double speed);
+
+/**
+ * @brief Reads the current time of the clock source
+ *
+ * @param clk The clock source to read
+ * @return int64_t The current time, in nanoseconds
+ */
+int64_t clk_now_ns(const clock_source_t *clk);
+
+/**
+ * @brief Moves a virtual clock forward to the given time
+ *
+ * @remarks If the clock is paced, this sleeps until the corresponding
+ *          real time has been reached. Virtual time never moves backwards;
+ *          earlier times leave the clock unchanged. This has no effect on
+ *          a real clock source.
+ *
+ * @param clk The clock source to advance
+ * @param virt_ns The virtual time to advance to, in nanoseconds
+ */
+void clk_advance_to(clock_source_t *clk, int64_t virt_ns);
+
+#endif // CLOCKSRC_H
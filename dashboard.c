@@ -0,0 +1,129 @@
+/**
+ * @file dashboard.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the live terminal dashboard
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <pthread.h>
+#include <time.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <math.h>
+
+#include "dashboard.h"
+#include "timebase.h"
+#include "diag.h"
+#include "latency.h"
+
+// Sparkline glyphs, lowest to highest
+static const char *spark_glyphs[] = { "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█" };
+
+// State of the (single) dashboard thread
+static pthread_t        dash_thread;
+static atomic_int       dash_running;
+static live_snapshot_t *dash_snap;
+static FILE            *dash_out;
+
+static double history[DASH_HISTORY_LEN];
+static int    history_len = 0;
+
+static void history_push(double v) {
+    if (history_len == DASH_HISTORY_LEN) {
+        memmove(history, history + 1, sizeof(double) * (DASH_HISTORY_LEN - 1));
+        history_len--;
+    }
+    history[history_len++] = v;
+}
+
+static void draw_sparkline(FILE *out) {
+    double lo = history[0];
+    double hi = history[0];
+    for(int i = 1; i < history_len; i++) {
+        lo = fmin(lo, history[i]);
+        hi = fmax(hi, history[i]);
+    }
+    for(int i = 0; i < history_len; i++) {
+        int g = (hi > lo) ? (int)((history[i] - lo) / (hi - lo) * 7.0 + 0.5) : 0;
+        fputs(spark_glyphs[g], out);
+    }
+    fprintf(out, "\033[K\n  range %.1f .. %.1f\033[K\n", lo, hi);
+}
+
+static void draw(FILE *out, const live_values_t *v, double rate) {
+    // Jitter as a fraction of the sampling interval, shown as a 20-cell bar
+    double jitter = (v->interval_ns > 0) ? v->jitter_ns / v->interval_ns : 0.0;
+    int bar = (int)(fmin(jitter, 1.0) * 20.0 + 0.5);
+
+    fprintf(out, "\033[H");
+    fprintf(out, "MCP3301 scale reader\033[K\n\033[K\n");
+    fprintf(out, "  weight    %10.3f   (raw %d)\033[K\n", v->filtered, v->raw);
+    fprintf(out, "  time      %10.3f s\033[K\n", v->t_ns / 1e9);
+    fprintf(out, "  rate      %10.1f samples/s\033[K\n", rate);
+    fprintf(out, "  samples   %10llu\033[K\n", (unsigned long long) v->samples);
+    fprintf(out, "  errors    %10llu\033[K\n", (unsigned long long) v->errors);
+    fprintf(out, "  interval  %10.1f us\033[K\n", v->interval_ns / 1e3);
+    fprintf(out, "  jitter    %10.1f us [", v->jitter_ns / 1e3);
+    for(int i = 0; i < 20; i++) {
+        fputc(i < bar ? '#' : ' ', out);
+    }
+    fprintf(out, "] %3.0f%%\033[K\n\033[K\n  ", jitter * 100.0);
+    if (history_len > 0) {
+        draw_sparkline(out);
+    }
+    fflush(out);
+}
+
+static void *dash_main(void *arg) {
+    (void) arg;
+    live_values_t v;
+    uint64_t last_samples = 0;
+    int64_t last_t = tb_mono_ns();
+    struct timespec period = { 0, 1000000000L / DASH_REFRESH_HZ };
+
+    fprintf(dash_out, "\033[2J");
+    while (atomic_load(&dash_running)) {
+        nanosleep(&period, NULL);
+        snap_read(dash_snap, &v);
+
+        int64_t now = tb_mono_ns();
+        double rate = (double)(v.samples - last_samples) * 1e9 / (double)(now - last_t);
+        int fresh = (v.samples != last_samples);
+        last_samples = v.samples;
+        last_t = now;
+
+        if (v.samples > 0) {
+            history_push(v.filtered);
+        }
+        draw(dash_out, &v, rate);
+        if (fresh) {
+            lat_observe(LAT_DASHBOARD, tb_mono_ns(), v.acq_ns);
+        }
+    }
+    return NULL;
+}
+
+int dash_start(live_snapshot_t *snap, FILE *out) {
+    dash_snap = snap;
+    dash_out = out;
+    history_len = 0;
+    atomic_store(&dash_running, 1);
+    if (0 != pthread_create(&dash_thread, NULL, dash_main, NULL)) {
+        diag_error("could not start dashboard thread");
+        return -1;
+    }
+    return 0;
+}
+
+void dash_stop(void) {
+    atomic_store(&dash_running, 0);
+    pthread_join(dash_thread, NULL);
+}
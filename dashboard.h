@@ -0,0 +1,50 @@
+/**
+ * @file dashboard.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Live terminal dashboard, decoupled from the sampling rate
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * The dashboard runs on its own thread and reads the sampler's values
+ * through a live_snapshot_t, so the sampler never waits on (or writes to)
+ * the terminal. It redraws at a fixed, low refresh rate and shows the
+ * current weight, a sparkline of recent history, the sample rate, the
+ * error count and a jitter indicator.
+ */
+
+#ifndef DASHBOARD_H
+#define DASHBOARD_H
+
+#include <stdio.h>
+
+#include "snapshot.h"
+
+/**
+ * @brief How many times per second the dashboard redraws
+ */
+#define DASH_REFRESH_HZ 4
+
+/**
+ * @brief How many history points the sparkline shows (one per redraw)
+ */
+#define DASH_HISTORY_LEN 60
+
+/**
+ * @brief Starts the dashboard thread
+ *
+ * @remarks Only one dashboard may run at a time.
+ *
+ * @param snap The snapshot the sampler publishes into
+ * @param out The terminal stream to draw on (e.g. stderr)
+ * @return int 0 on success, nonzero otherwise
+ */
+int dash_start(live_snapshot_t *snap, FILE *out);
+
+/**
+ * @brief Stops the dashboard thread and waits for it to finish
+ */
+void dash_stop(void);
+
+#endif // DASHBOARD_H
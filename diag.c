@@ -0,0 +1,203 @@
+/**
+ * @file diag.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the rate-limited diagnostics channel
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ *
+ * The ring is a bounded multi-producer queue in which every entry carries
+ * a sequence number. A producer claims an entry by advancing the enqueue
+ * position, and publishes it by setting the entry's sequence to one past
+ * that position; the (single) drain thread only reads entries which have
+ * been published. No thread ever takes a lock or waits on another.
+ */
+
+#include <pthread.h>
+#include <time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "diag.h"
+#include "timebase.h"
+
+// How often the drain thread wakes up, in nanoseconds
+#define DIAG_DRAIN_NS 10000000L
+
+/**
+ * @brief One message in the ring
+ */
+typedef struct diag_entry {
+    atomic_size_t seq;
+    int64_t       t_ns;
+    const char   *func;
+    unsigned      suppressed;
+    diag_level_t  level;
+    char          msg[DIAG_MSG_LEN];
+} diag_entry_t;
+
+static diag_entry_t   ring[DIAG_RING_LEN];
+static atomic_size_t  enqueue_pos;
+static size_t         dequeue_pos;
+
+static atomic_int     diag_running;
+static pthread_t      diag_thread;
+static FILE          *diag_out;
+
+static atomic_ullong  total_logged;
+static atomic_ullong  total_suppressed;
+static atomic_ullong  total_dropped;
+
+static const char *level_names[] = { "ERROR", "WARN", "INFO" };
+
+static void write_line(FILE *out, int64_t t_ns, diag_level_t level, const char *func,
+                       const char *msg, unsigned suppressed) {
+    if (suppressed > 0) {
+        fprintf(out, "%.6f\t%s\t%s\t%s\t(%u suppressed)\n", t_ns / 1e9, level_names[level], func, msg, suppressed);
+    } else {
+        fprintf(out, "%.6f\t%s\t%s\t%s\n", t_ns / 1e9, level_names[level], func, msg);
+    }
+    atomic_fetch_add_explicit(&total_logged, 1, memory_order_relaxed);
+}
+
+// Applies the call site's rate limit. Returns nonzero if the message may
+// be logged, and sets *suppressed to the count suppressed before it.
+static int rate_limit(diag_site_t *site, int64_t now, unsigned *suppressed) {
+    int64_t window = atomic_load_explicit(&site->window_ns, memory_order_relaxed);
+    if (now - window >= DIAG_WINDOW_NS &&
+        atomic_compare_exchange_strong(&site->window_ns, &window, now)) {
+        atomic_store_explicit(&site->count, 0, memory_order_relaxed);
+    }
+    if (atomic_fetch_add_explicit(&site->count, 1, memory_order_relaxed) >= DIAG_BURST) {
+        atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&total_suppressed, 1, memory_order_relaxed);
+        return 0;
+    }
+    *suppressed = atomic_exchange_explicit(&site->suppressed, 0, memory_order_relaxed);
+    return 1;
+}
+
+void diag_log(diag_site_t *site, diag_level_t level, const char *func, const char *fmt, ...) {
+    int64_t now = tb_mono_ns();
+    unsigned suppressed;
+    if (!rate_limit(site, now, &suppressed)) {
+        return;
+    }
+
+    va_list ap;
+    va_start(ap, fmt);
+    if (!atomic_load_explicit(&diag_running, memory_order_acquire)) {
+        char msg[DIAG_MSG_LEN];
+        vsnprintf(msg, sizeof(msg), fmt, ap);
+        va_end(ap);
+        write_line(stderr, now, level, func, msg, suppressed);
+        return;
+    }
+
+    // Claim an entry, or give up if the ring is full
+    size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    diag_entry_t *e;
+    for (;;) {
+        e = &ring[pos & (DIAG_RING_LEN - 1)];
+        size_t seq = atomic_load_explicit(&e->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            va_end(ap);
+            atomic_fetch_add_explicit(&total_dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    e->t_ns = now;
+    e->func = func;
+    e->level = level;
+    e->suppressed = suppressed;
+    vsnprintf(e->msg, sizeof(e->msg), fmt, ap);
+    va_end(ap);
+    atomic_store_explicit(&e->seq, pos + 1, memory_order_release);
+}
+
+// Writes out every published message
+static void drain(void) {
+    for (;;) {
+        diag_entry_t *e = &ring[dequeue_pos & (DIAG_RING_LEN - 1)];
+        if (atomic_load_explicit(&e->seq, memory_order_acquire) != dequeue_pos + 1) {
+            break;
+        }
+        write_line(diag_out, e->t_ns, e->level, e->func, e->msg, e->suppressed);
+        atomic_store_explicit(&e->seq, dequeue_pos + DIAG_RING_LEN, memory_order_release);
+        dequeue_pos++;
+    }
+    fflush(diag_out);
+}
+
+static void *diag_main(void *arg) {
+    (void) arg;
+    struct timespec ts = { 0, DIAG_DRAIN_NS };
+    while (atomic_load_explicit(&diag_running, memory_order_acquire)) {
+        drain();
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+int diag_start(const char *path) {
+    if (atomic_load(&diag_running)) {
+        return -1;
+    }
+    diag_out = stderr;
+    if (path != NULL && NULL == (diag_out = fopen(path, "a"))) {
+        diag_out = stderr;
+        diag_error("could not open %s", path);
+        return -1;
+    }
+    for(size_t i = 0; i < DIAG_RING_LEN; i++) {
+        atomic_store_explicit(&ring[i].seq, i, memory_order_relaxed);
+    }
+    atomic_store(&enqueue_pos, 0);
+    dequeue_pos = 0;
+
+    atomic_store(&diag_running, 1);
+    if (0 != pthread_create(&diag_thread, NULL, diag_main, NULL)) {
+        atomic_store(&diag_running, 0);
+        if (diag_out != stderr) {
+            fclose(diag_out);
+        }
+        diag_error("could not start the diagnostics thread");
+        return -1;
+    }
+    return 0;
+}
+
+void diag_stop(void) {
+    if (!atomic_load(&diag_running)) {
+        return;
+    }
+    atomic_store(&diag_running, 0);
+    pthread_join(diag_thread, NULL);
+    drain();
+    if (diag_out != stderr) {
+        fclose(diag_out);
+    }
+}
+
+void diag_get_stats(diag_stats_t *stats) {
+    stats->logged = atomic_load(&total_logged);
+    stats->suppressed = atomic_load(&total_suppressed);
+    stats->dropped = atomic_load(&total_dropped);
+}
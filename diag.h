@@ -0,0 +1,135 @@
+/**
+ * @file diag.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Rate-limited diagnostics, kept out of the data stream
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * Error messages used to be printed to STDOUT, in between data lines.
+ * During an error storm (e.g. an unplugged ADC) they flooded the output
+ * and the printing itself slowed down the read loop. Diagnostics now go
+ * through this channel instead:
+ *
+ * - Each call site is rate limited on its own: at most DIAG_BURST
+ *   messages per DIAG_WINDOW_NS, after which further messages from that
+ *   site are only counted. The next message that gets through says how
+ *   many were suppressed before it.
+ * - Messages are formatted into a lock-free ring by the calling thread,
+ *   and written out by a background thread, so no caller ever waits on
+ *   a terminal or disk. If the ring is full, the message is dropped and
+ *   counted.
+ * - Each line is tab-separated: seconds of CLOCK_MONOTONIC time, level,
+ *   the function that logged it, the message, and (if any) the number
+ *   of suppressed messages before it.
+ *
+ * Until diag_start() is called (e.g. in the standalone tools), messages
+ * are still rate limited but are written straight to STDERR.
+ *
+ * Usage:
+ *
+ *     diag_error("failed to read value");
+ *     diag_warn("%u Hz is above the ADC's maximum", hz);
+ */
+
+#ifndef DIAG_H
+#define DIAG_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * @brief Messages a call site may log per window before being suppressed
+ */
+#define DIAG_BURST 5
+
+/**
+ * @brief The rate limiting window, in nanoseconds
+ */
+#define DIAG_WINDOW_NS 1000000000LL
+
+/**
+ * @brief Longest message kept, in bytes (longer ones are truncated)
+ */
+#define DIAG_MSG_LEN 192
+
+/**
+ * @brief Number of messages the ring can hold (a power of two)
+ */
+#define DIAG_RING_LEN 256
+
+/**
+ * @brief Message severities
+ */
+typedef enum diag_level {
+    DIAG_ERROR = 0,
+    DIAG_WARN,
+    DIAG_INFO
+} diag_level_t;
+
+/**
+ * @brief The rate limiting state of one call site
+ *
+ * @remarks One of these is declared (zeroed) at every call site by the
+ *          diag_* macros. Treat the members as private.
+ */
+typedef struct diag_site {
+    _Atomic int64_t window_ns;   // Start of the current window
+    atomic_uint     count;       // Messages in the current window
+    atomic_uint     suppressed;  // Suppressed since the last message logged
+} diag_site_t;
+
+/**
+ * @brief Totals for the channel
+ */
+typedef struct diag_stats {
+    uint64_t logged;             // Messages written out
+    uint64_t suppressed;         // Messages suppressed by rate limiting
+    uint64_t dropped;            // Messages lost because the ring was full
+} diag_stats_t;
+
+#define DIAG_LOG(level, ...)                                  \
+    do {                                                      \
+        static diag_site_t diag_site_;                        \
+        diag_log(&diag_site_, (level), __func__, __VA_ARGS__); \
+    } while (0)
+
+#define diag_error(...) DIAG_LOG(DIAG_ERROR, __VA_ARGS__)
+#define diag_warn(...)  DIAG_LOG(DIAG_WARN, __VA_ARGS__)
+#define diag_info(...)  DIAG_LOG(DIAG_INFO, __VA_ARGS__)
+
+/**
+ * @brief Logs a message from a call site (use the diag_* macros instead)
+ *
+ * @param site The call site's rate limiting state
+ * @param level The message's severity
+ * @param func The name of the function logging the message
+ * @param fmt The printf-style format of the message (no trailing newline)
+ */
+void diag_log(diag_site_t *site, diag_level_t level, const char *func, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+/**
+ * @brief Starts the background thread which writes out logged messages
+ *
+ * @param path The file to append messages to, or NULL for STDERR
+ * @return int 0 on success, nonzero otherwise
+ */
+int diag_start(const char *path);
+
+/**
+ * @brief Writes out any remaining messages and stops the background thread
+ *
+ * @remarks Messages logged afterwards are written straight to STDERR.
+ */
+void diag_stop(void);
+
+/**
+ * @brief Reads the channel's totals so far
+ *
+ * @param stats The location to write the totals to
+ */
+void diag_get_stats(diag_stats_t *stats);
+
+#endif // DIAG_H
@@ -0,0 +1,318 @@
+/**
+ * @file dist.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the per-interval exact distributions
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "dist.h"
+
+////////////////////////////////////////////////////////
+/// Histograms
+
+// The bin for a reading, or -1 for a read error or anything out of range
+static int dist_bin(int16_t val) {
+    int bin = val - DIST_MIN;
+    return (bin >= 0 && bin < DIST_BINS) ? bin : -1;
+}
+
+void dist_clear(dist_t *d) {
+    memset(d, 0, sizeof(*d));
+}
+
+void dist_add(dist_t *d, int16_t val) {
+    int bin = dist_bin(val);
+    if (bin < 0) {
+        d->errors++;
+        return;
+    }
+    d->count[bin]++;
+    d->total++;
+}
+
+// The reading at rank r, counting from 0 at the smallest
+static int dist_at(const dist_t *d, uint64_t r) {
+    uint64_t seen = 0;
+    for(int bin = 0; bin < DIST_BINS; bin++) {
+        seen += d->count[bin];
+        if (seen > r) {
+            return bin + DIST_MIN;
+        }
+    }
+    return DIST_BINS - 1 + DIST_MIN;
+}
+
+// The mean of the readings at ranks lo up to (not including) hi
+static double dist_rank_mean(const dist_t *d, uint64_t lo, uint64_t hi) {
+    int64_t sum = 0;
+    uint64_t seen = 0;
+    for(int bin = 0; bin < DIST_BINS && seen < hi; bin++) {
+        uint64_t from = seen > lo ? seen : lo;
+        seen += d->count[bin];
+        uint64_t to = seen < hi ? seen : hi;
+        if (to > from) {
+            sum += (int64_t)(to - from) * (bin + DIST_MIN);
+        }
+    }
+    return (double) sum / (double)(hi - lo);
+}
+
+double dist_mean(const dist_t *d) {
+    assert(d->total > 0);
+    return dist_rank_mean(d, 0, d->total);
+}
+
+double dist_percentile(const dist_t *d, double p) {
+    assert(d->total > 0 && p >= 0.0 && p <= 100.0);
+    double pos = p / 100.0 * (double)(d->total - 1);
+    uint64_t lo = (uint64_t) pos;
+    int a = dist_at(d, lo);
+    if (lo + 1 >= d->total) {
+        return a;
+    }
+    return a + (pos - (double) lo) * (dist_at(d, lo + 1) - a);
+}
+
+double dist_median(const dist_t *d) {
+    return dist_percentile(d, 50.0);
+}
+
+int16_t dist_mode(const dist_t *d) {
+    assert(d->total > 0);
+    int best = 0;
+    for(int bin = 1; bin < DIST_BINS; bin++) {
+        best = d->count[bin] > d->count[best] ? bin : best;
+    }
+    return (int16_t)(best + DIST_MIN);
+}
+
+double dist_trimmed(const dist_t *d, double frac) {
+    assert(d->total > 0 && frac >= 0.0 && frac < 0.5);
+    uint64_t trim = (uint64_t)(frac * (double) d->total);
+    if (2 * trim >= d->total) {
+        trim = (d->total - 1) / 2;
+    }
+    return dist_rank_mean(d, trim, d->total - trim);
+}
+
+////////////////////////////////////////////////////////
+/// Logs
+
+/**
+ * @brief A closed interval
+ *
+ * @remarks bytes holds, for each bin used in increasing order, the number
+ *          of unused bins since the previous one (or since bin 0), then
+ *          the bin's count, each as a little-endian base-128 integer.
+ */
+typedef struct dist_interval {
+    dist_span_t span;
+    size_t      len;
+    uint8_t     bytes[];
+} dist_interval_t;
+
+// Longest a count or gap can be, as a base-128 integer
+#define DIST_VARINT_MAX 10
+
+struct dist_log {
+    int64_t           interval_ns;
+
+    // The closed intervals, oldest first
+    dist_interval_t **intervals;
+    size_t            count;
+    size_t            cap;
+    size_t            bytes;
+
+    // The open interval, with the range of bins it has used, and the
+    // time at which it ends
+    uint64_t          open[DIST_BINS];
+    dist_span_t       span;
+    int64_t           t_end;
+    int               lo;
+    int               hi;
+};
+
+static size_t varint_put(uint8_t *out, uint64_t x) {
+    size_t n = 0;
+    while (x >= 0x80) {
+        out[n++] = (uint8_t)(x | 0x80);
+        x >>= 7;
+    }
+    out[n++] = (uint8_t) x;
+    return n;
+}
+
+static uint64_t varint_get(const uint8_t **in) {
+    uint64_t x = 0;
+    int shift = 0;
+    uint8_t b;
+    do {
+        b = *(*in)++;
+        x |= (uint64_t)(b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return x;
+}
+
+static void dist_log_reset(dist_log_t *l) {
+    memset(&l->span, 0, sizeof(l->span));
+    l->lo = DIST_BINS;
+    l->hi = -1;
+}
+
+dist_log_t *dist_log_new(int64_t interval_ns) {
+    dist_log_t *l = (dist_log_t *) calloc(1, sizeof(dist_log_t));
+    if (l == NULL) {
+        return NULL;
+    }
+    l->interval_ns = interval_ns;
+    dist_log_reset(l);
+    return l;
+}
+
+void dist_log_del(dist_log_t *l) {
+    for(size_t i = 0; i < l->count; i++) {
+        free(l->intervals[i]);
+    }
+    free(l->intervals);
+    free(l);
+}
+
+int dist_log_close(dist_log_t *l) {
+    if (l->span.total + l->span.errors == 0) {
+        return 0;
+    }
+    int ret = -1;
+
+    // An interval of nothing but read errors has no bins, so an empty body
+    // (the spare byte keeps the malloc() from being of 0 bytes)
+    size_t bins = (l->hi >= l->lo) ? (size_t)(l->hi - l->lo + 1) : 0;
+    uint8_t *buf = (uint8_t *) malloc(bins * 2 * DIST_VARINT_MAX + 1);
+    if (l->count == l->cap) {
+        size_t cap = l->cap ? 2 * l->cap : 64;
+        dist_interval_t **intervals = (dist_interval_t **) realloc(l->intervals, cap * sizeof(dist_interval_t *));
+        if (intervals != NULL) {
+            l->intervals = intervals;
+            l->cap = cap;
+        }
+    }
+    if (buf != NULL && l->count < l->cap) {
+        size_t len = 0;
+        int next = 0;
+        for(int bin = l->lo; bin <= l->hi; bin++) {
+            if (l->open[bin] != 0) {
+                len += varint_put(buf + len, (uint64_t)(bin - next));
+                len += varint_put(buf + len, l->open[bin]);
+                next = bin + 1;
+            }
+        }
+        dist_interval_t *iv = (dist_interval_t *) malloc(sizeof(dist_interval_t) + len);
+        if (iv != NULL) {
+            iv->span = l->span;
+            iv->len = len;
+            memcpy(iv->bytes, buf, len);
+            l->intervals[l->count++] = iv;
+            l->bytes += sizeof(dist_interval_t) + len;
+            ret = 0;
+        }
+    }
+    free(buf);
+
+    if (l->hi >= l->lo) {
+        memset(l->open + l->lo, 0, (size_t)(l->hi - l->lo + 1) * sizeof(uint64_t));
+    }
+    dist_log_reset(l);
+    return ret;
+}
+
+int dist_log_sample(dist_log_t *l, int64_t t_ns, int16_t val) {
+    int ret = 0;
+    uint64_t n = l->span.total + l->span.errors;
+    if (n > 0 && t_ns >= l->t_end) {
+        ret = dist_log_close(l);
+        n = 0;
+    }
+    if (n == 0) {
+        l->span.t_first = t_ns;
+        l->t_end = (l->interval_ns > 0) ? (t_ns / l->interval_ns + 1) * l->interval_ns : INT64_MAX;
+    }
+    l->span.t_last = t_ns;
+    int bin = dist_bin(val);
+    if (bin < 0) {
+        l->span.errors++;
+        return ret;
+    }
+    l->open[bin]++;
+    l->span.total++;
+    l->lo = bin < l->lo ? bin : l->lo;
+    l->hi = bin > l->hi ? bin : l->hi;
+    return ret;
+}
+
+size_t dist_log_intervals(const dist_log_t *l) {
+    return l->count + (l->span.total + l->span.errors > 0);
+}
+
+void dist_log_span(const dist_log_t *l, size_t i, dist_span_t *span) {
+    *span = (i < l->count) ? l->intervals[i]->span : l->span;
+}
+
+void dist_log_merge(const dist_log_t *l, size_t i, dist_t *d) {
+    if (i >= l->count) {
+        for(int bin = l->lo; bin <= l->hi; bin++) {
+            d->count[bin] += l->open[bin];
+        }
+        d->total += l->span.total;
+        d->errors += l->span.errors;
+        return;
+    }
+    const dist_interval_t *iv = l->intervals[i];
+    const uint8_t *p = iv->bytes, *end = iv->bytes + iv->len;
+    uint64_t bin = 0;
+    while (p < end) {
+        bin += varint_get(&p);
+        d->count[bin++] += varint_get(&p);
+    }
+    d->total += iv->span.total;
+    d->errors += iv->span.errors;
+}
+
+size_t dist_log_merge_range(const dist_log_t *l, int64_t t_from, int64_t t_to, dist_t *d) {
+    // Intervals are in order of time, so a binary search finds the first
+    size_t lo = 0, hi = dist_log_intervals(l);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        dist_span_t s;
+        dist_log_span(l, mid, &s);
+        if (s.t_first < t_from) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    size_t merged = 0;
+    for(size_t i = lo; i < dist_log_intervals(l); i++) {
+        dist_span_t s;
+        dist_log_span(l, i, &s);
+        if (s.t_last > t_to) {
+            break;
+        }
+        dist_log_merge(l, i, d);
+        merged++;
+    }
+    return merged;
+}
+
+size_t dist_log_bytes(const dist_log_t *l) {
+    return l->bytes;
+}
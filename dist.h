@@ -0,0 +1,224 @@
+/**
+ * @file dist.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Exact distributions of the raw readings, per interval
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * The MCP3301 can only give 8192 different readings, so a histogram with
+ * a bin for each is an exact record of how the readings were distributed:
+ * the median, mode, any percentile or trimmed mean read from it is the
+ * same as from sorting every reading, and two histograms merge by adding
+ * their counts.
+ *
+ * A dist_log_t keeps one such histogram per interval of time (a minute,
+ * say, or one bird's visit to the perch). Adding a reading to the open
+ * interval is a single increment. When an interval closes, its
+ * histogram is stored sparsely: only the bins it used, each as the gap
+ * from the previous bin and the count, in variable-length integers.
+ * Noise spreads a steady weight over a few dozen bins, so an interval
+ * takes tens of bytes whatever its length, and months of intervals fit
+ * in a few megabytes. The distribution over any run of intervals then
+ * comes from merging their histograms into a dist_t, without the
+ * readings themselves.
+ *
+ * A log is not thread-safe; the sampler owns it.
+ */
+
+#ifndef DIST_H
+#define DIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Bins in a histogram, one for each possible reading
+ */
+#define DIST_BINS 8192
+
+/**
+ * @brief The reading counted in bin 0
+ */
+#define DIST_MIN (-4096)
+
+/**
+ * @brief A full histogram of readings
+ *
+ * @remarks Read errors (MCP3301_READ_ERROR), and anything else outside
+ *          the ADC's range, are counted in errors and nowhere else. At
+ *          64 KB, this is better kept off the stack.
+ */
+typedef struct dist {
+    uint64_t count[DIST_BINS];      // Readings of each value, from DIST_MIN up
+    uint64_t total;                 // Readings counted in the bins
+    uint64_t errors;                // Read errors
+} dist_t;
+
+/**
+ * @brief Empties a histogram
+ *
+ * @param d The histogram
+ */
+void dist_clear(dist_t *d);
+
+/**
+ * @brief Counts one reading
+ *
+ * @param d The histogram
+ * @param val The reading
+ */
+void dist_add(dist_t *d, int16_t val);
+
+/**
+ * @brief Computes the mean of a histogram's readings
+ *
+ * @param d The histogram (with at least one reading)
+ * @return double The mean
+ */
+double dist_mean(const dist_t *d);
+
+/**
+ * @brief Computes a percentile of a histogram's readings
+ *
+ * @remarks Interpolates linearly between the two nearest ranks, as
+ *          filter_percentile() does, so the 50th percentile is the median.
+ *
+ * @param d The histogram (with at least one reading)
+ * @param p The percentile, from 0 (the smallest reading) to 100 (the largest)
+ * @return double The percentile
+ */
+double dist_percentile(const dist_t *d, double p);
+
+/**
+ * @brief Computes the median of a histogram's readings
+ *
+ * @param d The histogram (with at least one reading)
+ * @return double The median
+ */
+double dist_median(const dist_t *d);
+
+/**
+ * @brief Finds the most common reading
+ *
+ * @param d The histogram (with at least one reading)
+ * @return int16_t The most common reading (the smallest, if several tie)
+ */
+int16_t dist_mode(const dist_t *d);
+
+/**
+ * @brief Computes the mean of a histogram's readings, ignoring a fraction
+ *        of the smallest and of the largest
+ *
+ * @param d The histogram (with at least one reading)
+ * @param frac The fraction to drop from each end, from 0 to below 0.5
+ *             (rounded down to a whole number of readings)
+ * @return double The trimmed mean
+ */
+double dist_trimmed(const dist_t *d, double frac);
+
+/**
+ * @brief The time span and size of an interval
+ */
+typedef struct dist_span {
+    int64_t  t_first;       // Time of the first reading, in nanoseconds since the start of the run
+    int64_t  t_last;        // Time of the last reading
+    uint64_t total;         // Readings, excluding read errors
+    uint64_t errors;        // Read errors
+} dist_span_t;
+
+typedef struct dist_log dist_log_t;
+
+/**
+ * @brief Creates an empty log
+ *
+ * @param interval_ns The length of each interval, in nanoseconds; an
+ *                    interval closes when a reading falls in the next one
+ *                    (intervals start at multiples of interval_ns). With
+ *                    0, intervals are only closed by dist_log_close().
+ * @return dist_log_t* The log, or NULL on failure
+ */
+dist_log_t *dist_log_new(int64_t interval_ns);
+
+/**
+ * @brief Frees a log
+ *
+ * @param l The log to free
+ */
+void dist_log_del(dist_log_t *l);
+
+/**
+ * @brief Counts one reading in the open interval
+ *
+ * @remarks Readings must be given in order of time.
+ *
+ * @param l The log
+ * @param t_ns The reading's time, in nanoseconds since the start of the run
+ * @param val The raw reading
+ * @return int 0 on success, nonzero if memory ran out closing the
+ *         previous interval (its readings are lost)
+ */
+int dist_log_sample(dist_log_t *l, int64_t t_ns, int16_t val);
+
+/**
+ * @brief Closes the open interval, if it has any readings, and starts
+ *        another
+ *
+ * @remarks For intervals marked by events rather than the clock, e.g. a
+ *          bird landing and leaving.
+ *
+ * @param l The log
+ * @return int 0 on success, nonzero if memory ran out (the interval's
+ *         readings are lost)
+ */
+int dist_log_close(dist_log_t *l);
+
+/**
+ * @brief The number of intervals held, the oldest being interval 0 and
+ *        the open one (if it has any readings) the last
+ *
+ * @param l The log
+ * @return size_t The number of intervals
+ */
+size_t dist_log_intervals(const dist_log_t *l);
+
+/**
+ * @brief Reads the span of an interval
+ *
+ * @param l The log
+ * @param i The interval's index
+ * @param span The location to write the span to
+ */
+void dist_log_span(const dist_log_t *l, size_t i, dist_span_t *span);
+
+/**
+ * @brief Adds an interval's histogram to a histogram
+ *
+ * @param l The log
+ * @param i The interval's index
+ * @param d The histogram to add to
+ */
+void dist_log_merge(const dist_log_t *l, size_t i, dist_t *d);
+
+/**
+ * @brief Adds the histogram of every interval lying wholly within a span
+ *        of time to a histogram
+ *
+ * @param l The log
+ * @param t_from The start of the span
+ * @param t_to The end of the span, inclusive
+ * @param d The histogram to add to
+ * @return size_t The number of intervals added
+ */
+size_t dist_log_merge_range(const dist_log_t *l, int64_t t_from, int64_t t_to, dist_t *d);
+
+/**
+ * @brief The bytes used by a log's closed intervals
+ *
+ * @param l The log
+ * @return size_t The bytes used
+ */
+size_t dist_log_bytes(const dist_log_t *l);
+
+#endif // DIST_H
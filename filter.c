@@ -0,0 +1,414 @@
+/**
+ * @file filter.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the filter buffer class and filters
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+#include <assert.h>
+
+#include "filter.h"
+
+filter_buffer_t *fb_new(size_t len) {
+    filter_buffer_t *fb = (filter_buffer_t *) malloc(sizeof(filter_buffer_t));
+    fb->data = (int*) malloc(sizeof(int) * len);
+    memset(fb->data, 0, sizeof(int) * len);
+    fb->data_len = len;
+    fb->location = 0;
+    return fb;
+}
+
+void fb_del(filter_buffer_t *fb) {
+    free(fb->data);
+    free(fb);
+}
+
+int fb_resize(filter_buffer_t *fb, size_t len) {
+    int *data = (int*) malloc(sizeof(int) * len);
+    if (data == NULL) {
+        return -1;
+    }
+    // data[len - 1] is the newest value; older slots count back from it,
+    // cycling through the kept history if the buffer grows
+    size_t keep = (len < fb->data_len) ? len : fb->data_len;
+    for(size_t i = 0; i < len; i++) {
+        size_t age = i % keep;
+        data[len - 1 - i] = fb->data[(fb->location + fb->data_len - 1 - age) % fb->data_len];
+    }
+    free(fb->data);
+    fb->data = data;
+    fb->data_len = len;
+    fb->location = 0;
+    return 0;
+}
+
+/**
+ * @brief [PRIVATE] Increment the filter_buffer_t's location
+ * 
+ * @remarks The location field tells the filter_buffer_t where in the
+ *          data array new data should be written to.
+ * 
+ * @param fb The filter_buffer_t to increment the location of
+ */
+static void fb_incr_loc(filter_buffer_t *fb) {
+    fb->location = (fb->location + 1) % fb->data_len;
+}
+
+void fb_push(filter_buffer_t *fb, int val) {
+    fb->data[fb->location] = val;
+    fb_incr_loc(fb);
+}
+
+double filter_avg(filter_buffer_t *fb) {
+    int max = fb->data[0];
+    int min = fb->data[0];
+    int sum = max;
+    int data;
+    for(size_t i = 1; i < fb->data_len; i++) {
+        data = fb->data[i];
+        if (data > max) {
+            max = data;
+        }
+        if (data < min) {
+            min = data;
+        }
+        sum += data;
+    }
+    sum = sum - max - min;
+    return ((double) sum) / (fb->data_len - 2);
+}
+
+double filter_mean(filter_buffer_t *fb) {
+    int sum = 0;
+    for(size_t i = 0; i < fb->data_len; i++) {
+        sum += fb->data[i];
+    }
+    return ((double) sum) / fb->data_len;
+}
+
+// Four 32-bit lanes; NEON or SSE2 depending on the target, or plain
+// scalar code (still branchless) where there is neither
+typedef int32_t sn_v4i32 __attribute__((vector_size(16)));
+
+static inline sn_v4i32 sn_min(sn_v4i32 a, sn_v4i32 b) {
+    sn_v4i32 m = a < b;
+    return (a & m) | (b & ~m);
+}
+
+static inline sn_v4i32 sn_max(sn_v4i32 a, sn_v4i32 b) {
+    sn_v4i32 m = a < b;
+    return (b & m) | (a & ~m);
+}
+
+/**
+ * @brief [PRIVATE] One step of a bitonic sorting network over 4 * regs
+ *        values held in regs vectors
+ *
+ * @remarks Element i is compared with element i ^ j, and keeps the smaller
+ *          if i is the lower of the pair in an ascending run (i & k
+ *          clear), or the larger if it is in a descending one. With j of 4
+ *          or more the partners are whole vectors; below that they are
+ *          lanes of the same vector, brought together with a shuffle.
+ *          Meant to be called with constant regs, k and j, so that the
+ *          loop unrolls and the masks fold away.
+ *
+ * @param r The vectors, in lane order
+ * @param regs The number of vectors
+ * @param k The length of the runs being merged
+ * @param j The distance between the elements compared
+ */
+static inline __attribute__((always_inline)) void sn_step(sn_v4i32 *r, int regs, int k, int j) {
+    #pragma GCC unroll 8
+    for(int a = 0; a < regs; a++) {
+        if (j >= 4) {
+            int b = a ^ (j / 4);
+            if (b > a) {
+                sn_v4i32 lo = sn_min(r[a], r[b]);
+                sn_v4i32 hi = sn_max(r[a], r[b]);
+                int up = ((4 * a) & k) == 0;
+                r[a] = up ? lo : hi;
+                r[b] = up ? hi : lo;
+            }
+            continue;
+        }
+        sn_v4i32 p;
+        if (j == 1) {
+            p = __builtin_shuffle(r[a], (sn_v4i32) { 1, 0, 3, 2 });
+        } else {
+            p = __builtin_shuffle(r[a], (sn_v4i32) { 2, 3, 0, 1 });
+        }
+        sn_v4i32 idx = (sn_v4i32) { 0, 1, 2, 3 } + 4 * a;
+        sn_v4i32 keep_min = ((idx & k) == 0) == ((idx & j) == 0);
+        r[a] = (sn_min(r[a], p) & keep_min) | (sn_max(r[a], p) & ~keep_min);
+    }
+}
+
+// Merges runs of k / 2 into sorted runs of k, one step per halving of j
+#define SN_MERGE_2(r, regs)  sn_step(r, regs, 2, 1)
+#define SN_MERGE_4(r, regs)  sn_step(r, regs, 4, 2); sn_step(r, regs, 4, 1)
+#define SN_MERGE_8(r, regs)  sn_step(r, regs, 8, 4); sn_step(r, regs, 8, 2); \
+                             sn_step(r, regs, 8, 1)
+#define SN_MERGE_16(r, regs) sn_step(r, regs, 16, 8); SN_MERGE_8_TAIL(r, regs, 16)
+#define SN_MERGE_32(r, regs) sn_step(r, regs, 32, 16); sn_step(r, regs, 32, 8); \
+                             SN_MERGE_8_TAIL(r, regs, 32)
+#define SN_MERGE_8_TAIL(r, regs, k) sn_step(r, regs, k, 4); sn_step(r, regs, k, 2); \
+                                    sn_step(r, regs, k, 1)
+
+// The specialised kernels, one per supported window length
+static void sn_sort8(const int *in, int *out) {
+    sn_v4i32 r[2];
+    memcpy(r, in, sizeof(r));
+    SN_MERGE_2(r, 2);
+    SN_MERGE_4(r, 2);
+    SN_MERGE_8(r, 2);
+    memcpy(out, r, sizeof(r));
+}
+
+static void sn_sort16(const int *in, int *out) {
+    sn_v4i32 r[4];
+    memcpy(r, in, sizeof(r));
+    SN_MERGE_2(r, 4);
+    SN_MERGE_4(r, 4);
+    SN_MERGE_8(r, 4);
+    SN_MERGE_16(r, 4);
+    memcpy(out, r, sizeof(r));
+}
+
+static void sn_sort32(const int *in, int *out) {
+    sn_v4i32 r[8];
+    memcpy(r, in, sizeof(r));
+    SN_MERGE_2(r, 8);
+    SN_MERGE_4(r, 8);
+    SN_MERGE_8(r, 8);
+    SN_MERGE_16(r, 8);
+    SN_MERGE_32(r, 8);
+    memcpy(out, r, sizeof(r));
+}
+
+void fb_sorted(const filter_buffer_t *fb, int *out) {
+    _Static_assert(sizeof(int) == sizeof(int32_t), "the sorting networks work on 32-bit ints");
+    switch (fb->data_len) {
+    case 8:
+        sn_sort8(fb->data, out);
+        return;
+    case 16:
+        sn_sort16(fb->data, out);
+        return;
+    case 32:
+        sn_sort32(fb->data, out);
+        return;
+    }
+    // Insertion sort for any other length; the buffers here are short
+    for(size_t i = 0; i < fb->data_len; i++) {
+        int v = fb->data[i];
+        size_t j = i;
+        while (j > 0 && out[j - 1] > v) {
+            out[j] = out[j - 1];
+            j--;
+        }
+        out[j] = v;
+    }
+}
+
+double filter_median(filter_buffer_t *fb) {
+    int sorted[fb->data_len];
+    fb_sorted(fb, sorted);
+    size_t mid = fb->data_len / 2;
+    if (fb->data_len % 2) {
+        return sorted[mid];
+    }
+    return (sorted[mid - 1] + sorted[mid]) / 2.0;
+}
+
+double filter_trimmed(filter_buffer_t *fb, size_t trim) {
+    assert(2 * trim < fb->data_len);
+    int sorted[fb->data_len];
+    fb_sorted(fb, sorted);
+    int sum = 0;
+    for(size_t i = trim; i < fb->data_len - trim; i++) {
+        sum += sorted[i];
+    }
+    return ((double) sum) / (fb->data_len - 2 * trim);
+}
+
+double filter_percentile(filter_buffer_t *fb, double p) {
+    assert(p >= 0.0 && p <= 100.0);
+    int sorted[fb->data_len];
+    fb_sorted(fb, sorted);
+    double pos = p / 100.0 * (fb->data_len - 1);
+    size_t lo = (size_t) pos;
+    if (lo + 1 >= fb->data_len) {
+        return sorted[fb->data_len - 1];
+    }
+    return sorted[lo] + (pos - lo) * (sorted[lo + 1] - sorted[lo]);
+}
+
+double filter_avg_sorted(filter_buffer_t *fb) {
+    return filter_trimmed(fb, 1);
+}
+
+void ema_init(ema_filter_t *ema, double alpha) {
+    assert(alpha > 0.0 && alpha <= 1.0);
+    ema->alpha = alpha;
+    ema->value = 0.0;
+}
+
+double ema_push(ema_filter_t *ema, int val) {
+    ema->value += ema->alpha * (val - ema->value);
+    return ema->value;
+}
+
+// The candidate window lengths, shortest first
+static const size_t tune_ladder[TUNE_LADDER_LEN] = { 4, 6, 8, 12, 16, 24, 32, 48, 64 };
+
+// A block is steady if the mean of the last TUNE_MAX_WINDOW readings
+// stays within this many of its expected standard deviations, plus one
+// count for quantization
+#define TUNE_STEADY_SIGMAS 8.0
+
+// Weight of each new steady block in the averaged variances
+#define TUNE_VAR_ALPHA 0.25
+
+// A shorter window than the current one must beat the target by this
+// factor, so that a perch right at the target doesn't flip between two
+#define TUNE_SHRINK_MARGIN 0.9
+
+// Steady blocks in a row that must agree on a new window before it is used
+#define TUNE_CONFIRM_BLOCKS 3
+
+static void tune_block_reset(filter_tuner_t *t, int ref) {
+    t->block_len = 0;
+    t->block_ref = ref;
+    t->diff_sq = 0;
+    t->long_min = INFINITY;
+    t->long_max = -INFINITY;
+    for(int k = 0; k < TUNE_LADDER_LEN; k++) {
+        t->out_sum[k] = 0;
+        t->out_sq[k] = 0;
+    }
+}
+
+void tune_init(filter_tuner_t *t, double target, size_t max_window, size_t window) {
+    memset(t, 0, sizeof(*t));
+    t->target = target;
+    t->max_window = max_window < TUNE_MIN_WINDOW ? TUNE_MIN_WINDOW
+                  : max_window > TUNE_MAX_WINDOW ? TUNE_MAX_WINDOW : max_window;
+    t->window = window;
+    t->noise = NAN;
+    tune_block_reset(t, 0);
+}
+
+// Picks the window from the averaged variances
+static size_t tune_choose(const filter_tuner_t *t) {
+    size_t best = 0;
+    for(int k = 0; k < TUNE_LADDER_LEN && tune_ladder[k] <= t->max_window; k++) {
+        best = tune_ladder[k];
+        double target = (best < t->window) ? t->target * TUNE_SHRINK_MARGIN : t->target;
+        if (sqrt(t->var[k]) <= target) {
+            break;
+        }
+    }
+    return best;
+}
+
+// Judges a finished block, and folds it in if it was steady
+static void tune_end_block(filter_tuner_t *t) {
+    double n = (double) t->block_len;
+    double noise = sqrt(t->diff_sq / (2 * (n - 1)));
+    double band = TUNE_STEADY_SIGMAS * noise / sqrt((double) TUNE_MAX_WINDOW) + 1.0;
+    t->blocks++;
+    if (t->long_max - t->long_min > band) {
+        return;
+    }
+    for(int k = 0; k < TUNE_LADDER_LEN; k++) {
+        double mean = t->out_sum[k] / n;
+        double var = t->out_sq[k] / n - mean * mean;
+        t->var[k] = (t->steady_blocks == 0) ? var : t->var[k] + TUNE_VAR_ALPHA * (var - t->var[k]);
+    }
+    t->noise = (t->steady_blocks == 0) ? noise : t->noise + TUNE_VAR_ALPHA * (noise - t->noise);
+    t->steady_blocks++;
+
+    size_t window = tune_choose(t);
+    if (window == t->window || window != t->pending) {
+        t->pending = window;
+        t->pending_blocks = 1;
+    } else if (++t->pending_blocks >= TUNE_CONFIRM_BLOCKS) {
+        t->window = window;
+        t->changes++;
+    }
+}
+
+size_t tune_push(filter_tuner_t *t, int val) {
+    // Each reading goes in twice, so that the last TUNE_MAX_WINDOW lie in
+    // order, newest last, ending at hist[pos + TUNE_MAX_WINDOW]
+    size_t pos = t->seen % TUNE_MAX_WINDOW;
+    t->hist[pos] = val;
+    t->hist[pos + TUNE_MAX_WINDOW] = val;
+    t->seen++;
+
+    // Only measure once every candidate window is full
+    if (t->seen < TUNE_MAX_WINDOW) {
+        t->prev = val;
+        return t->window;
+    }
+    if (t->block_len == 0) {
+        tune_block_reset(t, val);
+    } else {
+        double d = val - t->prev;
+        t->diff_sq += d * d;
+    }
+    t->prev = val;
+
+    // Each candidate's output as filter_avg() gives it, dropping the
+    // largest and smallest reading, from one pass back over the readings
+    const int *last = t->hist + pos + TUNE_MAX_WINDOW;
+    int64_t sum = 0;
+    int lo = INT_MAX, hi = INT_MIN;
+    for(size_t k = 0, j = 0; k < TUNE_LADDER_LEN; k++) {
+        for(; j < tune_ladder[k]; j++) {
+            int x = last[-(ptrdiff_t) j];
+            sum += x;
+            lo = x < lo ? x : lo;
+            hi = x > hi ? x : hi;
+        }
+        double m = (double)(sum - lo - hi) / (tune_ladder[k] - 2) - t->block_ref;
+        t->out_sum[k] += m;
+        t->out_sq[k] += m * m;
+    }
+    double m_long = (double) sum / TUNE_MAX_WINDOW;
+    if (m_long < t->long_min) {
+        t->long_min = m_long;
+    }
+    if (m_long > t->long_max) {
+        t->long_max = m_long;
+    }
+    if (++t->block_len == TUNE_BLOCK) {
+        tune_end_block(t);
+        t->block_len = 0;
+    }
+    return t->window;
+}
+
+void tune_get_stats(const filter_tuner_t *t, tune_stats_t *st) {
+    st->window = t->window;
+    st->noise = t->noise;
+    st->output_sd = NAN;
+    for(int k = 0; k < TUNE_LADDER_LEN && t->steady_blocks > 0; k++) {
+        if (tune_ladder[k] == t->window) {
+            st->output_sd = sqrt(t->var[k]);
+        }
+    }
+    st->steady_blocks = t->steady_blocks;
+    st->blocks = t->blocks;
+    st->changes = t->changes;
+}
@@ -0,0 +1,311 @@
+/**
+ * @file filter.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Filter buffer class and the filters which run over it
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * The filter_buffer_t started out inside main.c. It lives here so that
+ * the filter evaluation harness (filter_eval.c) can run exactly the same
+ * filters as the reader does.
+ *
+ * Besides the original trimmed mean (filter_avg()), a few alternative
+ * filters are provided so they can be compared on accuracy and cost.
+ * Those built on order statistics (medians, trimmed means with any trim,
+ * percentiles) sort the window with fb_sorted(), which has SIMD sorting
+ * networks for the common window lengths of 8, 16 and 32.
+ *
+ * A fixed window of 16 is a compromise: a perch with little noise could
+ * respond faster with a shorter window, and a noisy one needs a longer
+ * window to hold its weight steady. A filter_tuner_t watches the raw
+ * readings, measures the noise while the perch is steady, and picks the
+ * shortest window whose output meets a target uncertainty; fb_resize()
+ * then changes the window without losing the buffered history.
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A simple circular data buffer which enables simple data filtering
+ * 
+ * @remarks As this is a C-style class, one should treat all members
+ *          as private and only use the given functions to access the
+ *          class.
+ */
+typedef struct filter_buffer {
+    int    *data;
+    size_t  data_len;
+    int     location;
+} filter_buffer_t;
+
+/**
+ * @brief Creates a new filter_buffer_t with the given buffer length
+ * 
+ * @param len The length of the buffer to allocate
+ * @return filter_buffer_t* The newly-created filter_buffer_t
+ */
+filter_buffer_t *fb_new(size_t len);
+
+/**
+ * @brief Deletes a given filter_buffer_t
+ * 
+ * @param fb The filter_buffer_t to delete
+ */
+void fb_del(filter_buffer_t *fb);
+
+/**
+ * @brief Changes the length of a filter_buffer_t, keeping its history
+ *
+ * @remarks The newest values are kept, in order. When growing, the new
+ *          (oldest) slots are filled by repeating the buffered history
+ *          rather than with zeros, so the filter output doesn't jump.
+ *
+ * @param fb The filter_buffer_t to resize
+ * @param len The new buffer length
+ * @return int 0 on success, nonzero (leaving the buffer unchanged) otherwise
+ */
+int fb_resize(filter_buffer_t *fb, size_t len);
+
+/**
+ * @brief Push a new value into the filter_buffer_t
+ * 
+ * @remarks The filter_buffer_t's location is incremented in this operation.
+ * 
+ * @param fb The filter_buffer_t to push a value into
+ * @param val The value to push into the filter_buffer_t
+ */
+void fb_push(filter_buffer_t *fb, int val);
+
+/**
+ * @brief Computes the average of the filter_buffer_t's data, ignoring 
+ *        the largest and smallest vlues
+ * 
+ * @param fb The filter_buffer_t to compute the average for
+ * @return double The average of the data values (sans max and min) in the given filter_buffer_t
+ */
+double filter_avg(filter_buffer_t *fb);
+
+/**
+ * @brief Computes the plain average of the filter_buffer_t's data
+ *
+ * @param fb The filter_buffer_t to compute the average for
+ * @return double The average of all data values in the given filter_buffer_t
+ */
+double filter_mean(filter_buffer_t *fb);
+
+/**
+ * @brief Computes the median of the filter_buffer_t's data
+ *
+ * @remarks For an even buffer length, the average of the two middle
+ *          values is returned.
+ *
+ * @param fb The filter_buffer_t to compute the median for
+ * @return double The median of the data values in the given filter_buffer_t
+ */
+double filter_median(filter_buffer_t *fb);
+
+/**
+ * @brief Writes the filter_buffer_t's data to out in ascending order
+ *
+ * @remarks Windows of 8, 16 and 32 values are sorted by a bitonic sorting
+ *          network written with GCC vector extensions, which compile to
+ *          NEON on the Pi and SSE2 on x86 (and to branchless scalar code
+ *          elsewhere). With no branches on the data, its cost is the same
+ *          for every window, unlike a comparison sort's. Other lengths
+ *          fall back to an insertion sort. filter_median(),
+ *          filter_trimmed() and filter_percentile() all sort through here.
+ *
+ * @param fb The filter_buffer_t to sort the data of (left unchanged)
+ * @param out The location to write the data_len sorted values to
+ */
+void fb_sorted(const filter_buffer_t *fb, int *out);
+
+/**
+ * @brief Computes the mean of the filter_buffer_t's data, ignoring the
+ *        trim smallest and trim largest values
+ *
+ * @remarks filter_trimmed(fb, 1) gives the same result as filter_avg().
+ *
+ * @param fb The filter_buffer_t to compute the mean for
+ * @param trim The number of values to drop from each end (less than half the length)
+ * @return double The trimmed mean
+ */
+double filter_trimmed(filter_buffer_t *fb, size_t trim);
+
+/**
+ * @brief Computes a percentile of the filter_buffer_t's data
+ *
+ * @remarks Interpolates linearly between the two nearest ranks, so the
+ *          50th percentile is the median.
+ *
+ * @param fb The filter_buffer_t to compute the percentile for
+ * @param p The percentile, from 0 (the smallest value) to 100 (the largest)
+ * @return double The percentile
+ */
+double filter_percentile(filter_buffer_t *fb, double p);
+
+/**
+ * @brief filter_avg() computed by sorting, for use where a filter
+ *        function is expected
+ *
+ * @param fb The filter_buffer_t to compute the average for
+ * @return double The same value as filter_avg(fb)
+ */
+double filter_avg_sorted(filter_buffer_t *fb);
+
+/**
+ * @brief An exponential moving average filter
+ *
+ * @remarks Treat the members as private.
+ */
+typedef struct ema_filter {
+    double alpha;
+    double value;
+} ema_filter_t;
+
+/**
+ * @brief Initializes an exponential moving average filter
+ *
+ * @remarks The filter starts at 0, matching a freshly-created filter_buffer_t.
+ *
+ * @param ema The filter to initialize
+ * @param alpha The weight of each new value, between 0 and 1
+ */
+void ema_init(ema_filter_t *ema, double alpha);
+
+/**
+ * @brief Pushes a new value into an exponential moving average filter
+ *
+ * @param ema The filter to push a value into
+ * @param val The value to push
+ * @return double The new filter output
+ */
+double ema_push(ema_filter_t *ema, int val);
+
+/**
+ * @brief Shortest window a filter_tuner_t picks (filter_avg() needs at least 3)
+ */
+#define TUNE_MIN_WINDOW 4
+
+/**
+ * @brief Longest window a filter_tuner_t picks
+ */
+#define TUNE_MAX_WINDOW 64
+
+/**
+ * @brief Number of readings in each block the noise is measured over
+ */
+#define TUNE_BLOCK 512
+
+/**
+ * @brief Number of window lengths a filter_tuner_t considers
+ */
+#define TUNE_LADDER_LEN 9
+
+/**
+ * @brief Picks the trimmed-mean window length from the measured noise
+ *
+ * @remarks Every reading is fed through trimmed means of each candidate
+ *          length (4 to 64, roughly in steps of 1.5x) at once, as
+ *          filter_avg() computes them, in one pass over the last
+ *          TUNE_MAX_WINDOW readings, so the cost per reading is fixed. At
+ *          the end of each block of TUNE_BLOCK readings, the block is
+ *          judged steady if the plain mean of the last TUNE_MAX_WINDOW
+ *          readings stayed within a few of its own standard deviations (as
+ *          estimated from the raw noise); blocks with a bird landing or
+ *          leaving are skipped. The
+ *          variance of each candidate's output over steady blocks is
+ *          averaged, and the shortest candidate whose standard deviation
+ *          is within the target is chosen, once it has been the choice
+ *          for a few steady blocks in a row. Measuring the outputs directly,
+ *          rather than assuming independent noise, accounts for
+ *          correlated noise (e.g. mains hum), which averaging reduces
+ *          more slowly, and for the trimming, which for Gaussian noise
+ *          leaves a short window noisier than a plain mean would be.
+ *
+ *          The window is never longer than max_window, the longest
+ *          settling time (in readings) allowed after a step; a trimmed
+ *          mean of N readings settles within N. If no allowed window
+ *          meets the target, the longest allowed one is used.
+ *
+ *          Treat the members as private.
+ */
+typedef struct filter_tuner {
+    double   target;                        // Output standard deviation wanted, in counts
+    size_t   max_window;
+    size_t   window;                        // The current choice
+
+    int      hist[2 * TUNE_MAX_WINDOW];     // The last TUNE_MAX_WINDOW readings, stored twice
+    size_t   seen;
+
+    // The block being measured, relative to its first reading
+    size_t   block_len;
+    int      block_ref;
+    int      prev;
+    double   out_sum[TUNE_LADDER_LEN];
+    double   out_sq[TUNE_LADDER_LEN];
+    double   diff_sq;
+    double   long_min;
+    double   long_max;
+
+    // Averages over the steady blocks so far
+    double   var[TUNE_LADDER_LEN];
+    double   noise;                         // Raw noise standard deviation, in counts
+    uint64_t steady_blocks;
+    uint64_t blocks;
+    uint64_t changes;
+
+    // A new window waits for TUNE_CONFIRM_BLOCKS steady blocks to agree
+    size_t   pending;
+    int      pending_blocks;
+} filter_tuner_t;
+
+/**
+ * @brief What a filter_tuner_t has measured so far
+ */
+typedef struct tune_stats {
+    size_t   window;                        // The current choice
+    double   noise;                         // Raw noise standard deviation (NAN until measured)
+    double   output_sd;                     // Expected output standard deviation at that window
+    uint64_t steady_blocks;                 // Blocks the noise was measured over
+    uint64_t blocks;                        // Blocks seen
+    uint64_t changes;                       // Times the window changed
+} tune_stats_t;
+
+/**
+ * @brief Initializes a filter tuner
+ *
+ * @param t The tuner to initialize
+ * @param target The standard deviation of the filter output wanted, in ADC counts
+ * @param max_window The longest window allowed (clamped to TUNE_MIN_WINDOW..TUNE_MAX_WINDOW)
+ * @param window The window to start with, until the noise has been measured
+ */
+void tune_init(filter_tuner_t *t, double target, size_t max_window, size_t window);
+
+/**
+ * @brief Feeds a raw reading to the tuner
+ *
+ * @remarks Failed reads should not be fed in. The result only changes at
+ *          the end of a block.
+ *
+ * @param t The tuner
+ * @param val The raw reading
+ * @return size_t The window the filter should now use
+ */
+size_t tune_push(filter_tuner_t *t, int val);
+
+/**
+ * @brief Reads what a tuner has measured so far
+ *
+ * @param t The tuner
+ * @param st The location to write the measurements to
+ */
+void tune_get_stats(const filter_tuner_t *t, tune_stats_t *st);
+
+#endif // FILTER_H
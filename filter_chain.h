@@ -0,0 +1,247 @@
+/**
+ * @file filter_chain.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Filter stages which compose at compile time into one inlined function
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * Processing a reading usually takes several steps: throw out read errors,
+ * smooth it, perhaps keep only every Nth value, and convert counts to
+ * grams. Done through separate calls on separate objects, each step costs
+ * a call and a trip through memory, and the compiler can't see across
+ * them. Written out by hand in one loop, the steps are fast but can't be
+ * rearranged or reused.
+ *
+ * Here each stage is a small state struct, fc_<stage>_t, and a static
+ * inline step function:
+ *
+ *     static inline int fc_<stage>_step(fc_<stage>_t *s, double *v);
+ *
+ * which transforms *v in place and returns nonzero to pass it on to the
+ * next stage, or zero to drop it. FC_DEFINE_CHAIN() strings a list of
+ * stages together into a chain:
+ *
+ *     FC_DEFINE_TRIM(trim16, 16)
+ *     FC_DEFINE_CHAIN(perch, reject, trim16, decimate, calibrate)
+ *
+ * defines fc_perch_t, holding one of each stage's state as a member named
+ * after the stage, and:
+ *
+ * - fc_perch_push(): runs one raw reading through every stage in order
+ * - fc_perch_run():  runs a batch of raw readings, collecting the outputs
+ *
+ * Each stage is initialized through its member (e.g.
+ * fc_reject_init(&chain.reject, lo, hi)) before the chain is used. As
+ * every step is inline, and the trimmed mean's window is a compile-time
+ * constant, the whole chain compiles to one loop with no calls, just like
+ * the hand-fused code; `./bench` checks that it is as fast. A stage may
+ * appear only once in a chain; define a second trimmed mean under another
+ * name to use two.
+ *
+ * To add a stage, define its fc_<stage>_t and fc_<stage>_step() in the
+ * same form. Chains may have up to FC_MAX_STAGES stages.
+ */
+
+#ifndef FILTER_CHAIN_H
+#define FILTER_CHAIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Most stages a chain may have
+ */
+#define FC_MAX_STAGES 8
+
+////////////////////////////////////////////////////////
+/// Stages
+
+/**
+ * @brief Drops readings outside a valid range, e.g. read errors
+ *
+ * @remarks Treat the members as private.
+ */
+typedef struct fc_reject {
+    double lo;
+    double hi;
+} fc_reject_t;
+
+/**
+ * @brief Initializes a reject stage
+ *
+ * @param s The stage to initialize
+ * @param lo The lowest reading passed on
+ * @param hi The highest reading passed on
+ */
+static inline void fc_reject_init(fc_reject_t *s, double lo, double hi) {
+    s->lo = lo;
+    s->hi = hi;
+}
+
+static inline int fc_reject_step(fc_reject_t *s, double *v) {
+    return *v >= s->lo && *v <= s->hi;
+}
+
+/**
+ * @brief Passes on one value out of every factor
+ *
+ * @remarks Treat the members as private.
+ */
+typedef struct fc_decimate {
+    unsigned factor;
+    unsigned count;
+} fc_decimate_t;
+
+/**
+ * @brief Initializes a decimation stage
+ *
+ * @remarks The last value of every group of factor is the one passed on.
+ *
+ * @param s The stage to initialize
+ * @param factor How many values make one output (1 passes every value)
+ */
+static inline void fc_decimate_init(fc_decimate_t *s, unsigned factor) {
+    s->factor = factor;
+    s->count = 0;
+}
+
+static inline int fc_decimate_step(fc_decimate_t *s, double *v) {
+    (void) v;
+    if (++s->count < s->factor) {
+        return 0;
+    }
+    s->count = 0;
+    return 1;
+}
+
+/**
+ * @brief Converts counts to engineering units: (v - offset) * scale
+ *
+ * @remarks Treat the members as private.
+ */
+typedef struct fc_calibrate {
+    double offset;
+    double scale;
+} fc_calibrate_t;
+
+/**
+ * @brief Initializes a calibration stage
+ *
+ * @param s The stage to initialize
+ * @param offset The reading with nothing on the perch, in counts
+ * @param scale Units per count
+ */
+static inline void fc_calibrate_init(fc_calibrate_t *s, double offset, double scale) {
+    s->offset = offset;
+    s->scale = scale;
+}
+
+static inline int fc_calibrate_step(fc_calibrate_t *s, double *v) {
+    *v = (*v - s->offset) * s->scale;
+    return 1;
+}
+
+/**
+ * @brief Defines a trimmed-mean stage, fc_<name>_t, with a fixed window
+ *
+ * @remarks The stage keeps a circular buffer like a filter_buffer_t's, and
+ *          outputs the same value as filter_avg() over it: the mean of the
+ *          window without its largest and smallest values. Like
+ *          fb_new(), the window starts out full of zeros. The window
+ *          length is a constant, so the loop over it can be unrolled and
+ *          vectorized; a power of two also makes the wrap a mask.
+ *
+ * @param name The stage's name
+ * @param len The window length, at least 3
+ */
+#define FC_DEFINE_TRIM(name, len)                                                   \
+    typedef struct fc_##name {                                                      \
+        double data[len];                                                           \
+        size_t location;                                                            \
+    } fc_##name##_t;                                                                \
+                                                                                    \
+    static inline void fc_##name##_init(fc_##name##_t *s) {                         \
+        _Static_assert((len) >= 3, "a trimmed mean needs at least 3 values");       \
+        memset(s, 0, sizeof(*s));                                                   \
+    }                                                                               \
+                                                                                    \
+    static inline int fc_##name##_step(fc_##name##_t *s, double *v) {               \
+        s->data[s->location] = *v;                                                  \
+        s->location = (s->location + 1) % (len);                                    \
+        double max = s->data[0];                                                    \
+        double min = s->data[0];                                                    \
+        double sum = max;                                                           \
+        for(size_t i = 1; i < (len); i++) {                                         \
+            double d = s->data[i];                                                  \
+            max = d > max ? d : max;                                                \
+            min = d < min ? d : min;                                                \
+            sum += d;                                                               \
+        }                                                                           \
+        *v = (sum - max - min) / ((len) - 2);                                       \
+        return 1;                                                                   \
+    }
+
+////////////////////////////////////////////////////////
+/// Chain generator
+
+// Applies m to each of up to FC_MAX_STAGES arguments
+#define FC_NARGS(...) FC_NARGS_(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define FC_NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define FC_CAT(a, b) FC_CAT_(a, b)
+#define FC_CAT_(a, b) a##b
+#define FC_EACH(m, ...) FC_CAT(FC_EACH_, FC_NARGS(__VA_ARGS__))(m, __VA_ARGS__)
+#define FC_EACH_1(m, a)      m(a)
+#define FC_EACH_2(m, a, ...) m(a) FC_EACH_1(m, __VA_ARGS__)
+#define FC_EACH_3(m, a, ...) m(a) FC_EACH_2(m, __VA_ARGS__)
+#define FC_EACH_4(m, a, ...) m(a) FC_EACH_3(m, __VA_ARGS__)
+#define FC_EACH_5(m, a, ...) m(a) FC_EACH_4(m, __VA_ARGS__)
+#define FC_EACH_6(m, a, ...) m(a) FC_EACH_5(m, __VA_ARGS__)
+#define FC_EACH_7(m, a, ...) m(a) FC_EACH_6(m, __VA_ARGS__)
+#define FC_EACH_8(m, a, ...) m(a) FC_EACH_7(m, __VA_ARGS__)
+
+#define FC_MEMBER_(stage) fc_##stage##_t stage;
+#define FC_STEP_(stage)                                                             \
+    if (!fc_##stage##_step(&c->stage, &v)) {                                        \
+        return 0;                                                                   \
+    }
+
+/**
+ * @brief Defines the chain fc_<name>_t and its functions from a list of stages
+ *
+ * - fc_<name>_push(): runs one reading through the chain
+ * - fc_<name>_run():  runs n readings through the chain
+ *
+ * @param name The chain's name
+ * @param ... The stages, in the order a reading passes through them
+ */
+#define FC_DEFINE_CHAIN(name, ...)                                                  \
+    typedef struct fc_##name {                                                      \
+        FC_EACH(FC_MEMBER_, __VA_ARGS__)                                            \
+    } fc_##name##_t;                                                                \
+                                                                                    \
+    /* Returns 1 with the output in *out, or 0 if a stage dropped it */             \
+    static inline int fc_##name##_push(fc_##name##_t *c, int val, double *out) {    \
+        double v = val;                                                             \
+        FC_EACH(FC_STEP_, __VA_ARGS__)                                              \
+        *out = v;                                                                   \
+        return 1;                                                                   \
+    }                                                                               \
+                                                                                    \
+    /* Returns the number of outputs written to out, at most n. Works on a */       \
+    /* copy of the state, so that it can stay in registers through the loop */      \
+    static inline size_t fc_##name##_run(fc_##name##_t *c,                          \
+                                         const int16_t *restrict in,                \
+                                         double *restrict out, size_t n) {          \
+        fc_##name##_t s = *c;                                                       \
+        size_t k = 0;                                                               \
+        for(size_t i = 0; i < n; i++) {                                             \
+            k += fc_##name##_push(&s, in[i], out + k);                              \
+        }                                                                           \
+        *c = s;                                                                     \
+        return k;                                                                   \
+    }
+
+#endif // FILTER_CHAIN_H
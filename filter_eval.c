@@ -0,0 +1,534 @@
+/**
+ * @file filter_eval.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Quality-vs-cost comparison of the reader's filters, with golden outputs
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * Runs every candidate filter over a set of corpora and prints one table
+ * comparing them. The corpora are recorded reader output files (e.g.
+ * out.txt), plus a few synthetic signals whose ground truth is known:
+ *
+ * - step:   a flat baseline which jumps up half way through
+ * - ramp:   a slow linear climb, like a bird settling its weight
+ * - spikes: a flat baseline with occasional large impulses
+ *
+ * The synthetic signals are generated from a fixed-seed integer PRNG, so
+ * they are identical on every machine. For each corpus and filter the
+ * table reports:
+ *
+ * - rmse:      root-mean-square error against the ground truth
+ * - step_lat:  samples until the output covers 90% of the step
+ * - noise_red: noise standard deviation in / out (higher is better)
+ * - ns/sample: CPU cost of the filter (best of several passes)
+ *
+ * Each filter output stream is also hashed (as it would be printed by the
+ * reader) and compared against golden/filters.golden, so that a change
+ * which silently alters filter output is caught. Run with -u to update
+ * the golden file after an intentional change; entries for corpora not
+ * evaluated on that run are kept.
+ *
+ * Usage:
+ *
+ *     ./filter_eval [-u] [-g golden_file] [recorded_file ...]
+ *
+ * With no recorded files given, out.txt is used. Exits nonzero if any
+ * output differs from its golden hash.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "filter.h"
+#include "replay.h"
+#include "timebase.h"
+#include "diag.h"
+
+// Samples at the start of a corpus (and after a step) excluded from the error metrics
+#define EVAL_WARMUP 64
+
+// Number of timed passes per filter; the fastest is reported
+#define EVAL_TIMING_PASSES 5
+
+// Maximum number of entries in a golden file
+#define EVAL_MAX_GOLDEN 256
+
+////////////////////////////////////////////////////////
+/// Corpora
+
+/**
+ * @brief A signal to evaluate the filters over
+ */
+typedef struct corpus {
+    char    name[64];
+    int    *in;
+    double *truth;     // NULL when the ground truth is unknown
+    size_t  len;
+    size_t  step_at;   // 0 when the corpus has no step
+    double  step_size;
+} corpus_t;
+
+static uint64_t prng_state;
+
+static uint64_t prng_next(void) {
+    // xorshift64*
+    prng_state ^= prng_state >> 12;
+    prng_state ^= prng_state << 25;
+    prng_state ^= prng_state >> 27;
+    return prng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Approximately normal noise with the given standard deviation
+ *
+ * @remarks Sums twelve uniforms rather than using Box-Muller, so that no
+ *          libm transcendental functions are involved and the corpora are
+ *          bit-identical everywhere.
+ */
+static double prng_noise(double sigma) {
+    double sum = 0;
+    for(int i = 0; i < 12; i++) {
+        sum += (double)(prng_next() >> 11) / (double)(1ULL << 53);
+    }
+    return (sum - 6.0) * sigma;
+}
+
+static int clamp_adc(double v) {
+    long r = lround(v);
+    if (r > 4095) {
+        return 4095;
+    }
+    if (r < -4096) {
+        return -4096;
+    }
+    return (int) r;
+}
+
+static void corpus_alloc(corpus_t *c, const char *name, size_t len) {
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    c->in = (int *) malloc(sizeof(int) * len);
+    c->truth = (double *) malloc(sizeof(double) * len);
+    c->len = len;
+    c->step_at = 0;
+    c->step_size = 0;
+}
+
+static void corpus_free(corpus_t *c) {
+    free(c->in);
+    free(c->truth);
+}
+
+static void make_step(corpus_t *c) {
+    corpus_alloc(c, "step", 20000);
+    prng_state = 0x5EED0001;
+    c->step_at = c->len / 2;
+    c->step_size = 400;
+    for(size_t i = 0; i < c->len; i++) {
+        c->truth[i] = 480 + (i >= c->step_at ? c->step_size : 0);
+        c->in[i] = clamp_adc(c->truth[i] + prng_noise(3.0));
+    }
+}
+
+static void make_ramp(corpus_t *c) {
+    corpus_alloc(c, "ramp", 20000);
+    prng_state = 0x5EED0002;
+    for(size_t i = 0; i < c->len; i++) {
+        c->truth[i] = 480 + 400.0 * i / c->len;
+        c->in[i] = clamp_adc(c->truth[i] + prng_noise(3.0));
+    }
+}
+
+static void make_spikes(corpus_t *c) {
+    corpus_alloc(c, "spikes", 20000);
+    prng_state = 0x5EED0003;
+    for(size_t i = 0; i < c->len; i++) {
+        c->truth[i] = 480;
+        double v = c->truth[i] + prng_noise(3.0);
+        if (prng_next() % 100 == 0) {
+            v += (prng_next() & 1) ? 300 : -300;
+        }
+        c->in[i] = clamp_adc(v);
+    }
+}
+
+static int load_recorded(corpus_t *c, const char *path) {
+    replay_t *r = replay_open(path);
+    if (r == NULL) {
+        return -1;
+    }
+    const char *base = strrchr(path, '/');
+    snprintf(c->name, sizeof(c->name), "%s", base ? base + 1 : path);
+    c->truth = NULL;
+    c->step_at = 0;
+    c->step_size = 0;
+    c->len = 0;
+
+    size_t cap = 4096;
+    c->in = (int *) malloc(sizeof(int) * cap);
+    replay_record_t rec;
+    replay_kind_t kind;
+    while (REPLAY_EOF != (kind = replay_next(r, &rec))) {
+        if (kind != REPLAY_SAMPLE) {
+            continue;
+        }
+        if (c->len == cap) {
+            cap *= 2;
+            c->in = (int *) realloc(c->in, sizeof(int) * cap);
+        }
+        c->in[c->len++] = rec.int_val;
+    }
+    replay_close(r);
+    return 0;
+}
+
+////////////////////////////////////////////////////////
+/// Candidate filters
+
+/**
+ * @brief A filter under evaluation
+ */
+typedef struct candidate {
+    const char      *name;
+    size_t           window;
+    double         (*fb_filter)(filter_buffer_t *);  // NULL for the EMA
+    double           alpha;
+    filter_buffer_t *fb;
+    ema_filter_t     ema;
+    double           tune_target;                    // Nonzero to auto-tune the window
+    filter_tuner_t  *tuner;
+} candidate_t;
+
+static candidate_t candidates[] = {
+    { "trimmed16", 16, filter_avg,    0,      NULL, {0, 0}, 0,   NULL },
+    { "mean16",    16, filter_mean,   0,      NULL, {0, 0}, 0,   NULL },
+    { "median16",  16, filter_median, 0,      NULL, {0, 0}, 0,   NULL },
+    { "ema1/8",    0,  NULL,          0.125,  NULL, {0, 0}, 0,   NULL },
+    { "trim-auto", 16, filter_avg,    0,      NULL, {0, 0}, 1.0, NULL },
+};
+
+#define NUM_CANDIDATES (sizeof(candidates) / sizeof(candidates[0]))
+
+static void cand_reset(candidate_t *c) {
+    if (c->fb_filter != NULL) {
+        if (c->fb != NULL) {
+            fb_del(c->fb);
+        }
+        c->fb = fb_new(c->window);
+        if (c->tune_target > 0) {
+            if (c->tuner == NULL) {
+                c->tuner = (filter_tuner_t *) malloc(sizeof(filter_tuner_t));
+            }
+            tune_init(c->tuner, c->tune_target, TUNE_MAX_WINDOW, c->window);
+        }
+    } else {
+        ema_init(&c->ema, c->alpha);
+    }
+}
+
+static double cand_step(candidate_t *c, int val) {
+    if (c->fb_filter != NULL) {
+        if (c->tune_target > 0) {
+            size_t window = tune_push(c->tuner, val);
+            if (window != c->fb->data_len) {
+                fb_resize(c->fb, window);
+            }
+        }
+        fb_push(c->fb, val);
+        return c->fb_filter(c->fb);
+    }
+    return ema_push(&c->ema, val);
+}
+
+static void cand_free(candidate_t *c) {
+    if (c->fb != NULL) {
+        fb_del(c->fb);
+        c->fb = NULL;
+    }
+    free(c->tuner);
+    c->tuner = NULL;
+}
+
+////////////////////////////////////////////////////////
+/// Metrics
+
+/**
+ * @brief The results of running one filter over one corpus
+ */
+typedef struct result {
+    double   rmse;        // NAN when there is no ground truth
+    long     step_lat;    // -1 when there is no step (or it is never reached)
+    double   noise_red;
+    double   ns_per_sample;
+    uint64_t hash;
+} result_t;
+
+/**
+ * @brief Whether sample i should count towards the noise metrics
+ */
+static int is_settled(const corpus_t *c, size_t i) {
+    if (i < EVAL_WARMUP) {
+        return 0;
+    }
+    return c->step_at == 0 || i < c->step_at || i >= c->step_at + EVAL_WARMUP;
+}
+
+static double stdev_of(const double *v, const corpus_t *c) {
+    double sum = 0, sumsq = 0;
+    size_t n = 0;
+    for(size_t i = 0; i < c->len; i++) {
+        if (is_settled(c, i)) {
+            sum += v[i];
+            sumsq += v[i] * v[i];
+            n++;
+        }
+    }
+    double mean = sum / n;
+    return sqrt(sumsq / n - mean * mean);
+}
+
+static uint64_t fnv1a(uint64_t h, const char *s) {
+    for(; *s; s++) {
+        h ^= (uint8_t) *s;
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+static void evaluate(const corpus_t *c, candidate_t *cand, result_t *res) {
+    double *out = (double *) malloc(sizeof(double) * c->len);
+    double *resid = (double *) malloc(sizeof(double) * c->len);
+
+    // Timed passes
+    res->ns_per_sample = INFINITY;
+    for(int pass = 0; pass < EVAL_TIMING_PASSES; pass++) {
+        cand_reset(cand);
+        int64_t t0 = tb_mono_ns();
+        for(size_t i = 0; i < c->len; i++) {
+            out[i] = cand_step(cand, c->in[i]);
+        }
+        double ns = (double)(tb_mono_ns() - t0) / c->len;
+        if (ns < res->ns_per_sample) {
+            res->ns_per_sample = ns;
+        }
+    }
+
+    // Golden hash of the output, formatted the same way the reader prints it
+    char buf[64];
+    res->hash = 0xCBF29CE484222325ULL;
+    for(size_t i = 0; i < c->len; i++) {
+        snprintf(buf, sizeof(buf), "%4.3f\n", out[i]);
+        res->hash = fnv1a(res->hash, buf);
+    }
+
+    // Accuracy against the ground truth, or plain spread without one
+    res->rmse = NAN;
+    if (c->truth != NULL) {
+        double sq = 0;
+        size_t n = 0;
+        for(size_t i = EVAL_WARMUP; i < c->len; i++) {
+            double e = out[i] - c->truth[i];
+            sq += e * e;
+            n++;
+        }
+        res->rmse = sqrt(sq / n);
+
+        for(size_t i = 0; i < c->len; i++) {
+            resid[i] = c->in[i] - c->truth[i];
+        }
+        double sd_in = stdev_of(resid, c);
+        for(size_t i = 0; i < c->len; i++) {
+            resid[i] = out[i] - c->truth[i];
+        }
+        res->noise_red = sd_in / stdev_of(resid, c);
+    } else {
+        for(size_t i = 0; i < c->len; i++) {
+            resid[i] = c->in[i];
+        }
+        double sd_in = stdev_of(resid, c);
+        res->noise_red = sd_in / stdev_of(out, c);
+    }
+
+    res->step_lat = -1;
+    if (c->step_at != 0) {
+        double target = c->truth[c->step_at - 1] + 0.9 * c->step_size;
+        for(size_t i = c->step_at; i < c->len; i++) {
+            if (out[i] >= target) {
+                res->step_lat = (long)(i - c->step_at);
+                break;
+            }
+        }
+    }
+
+    free(out);
+    free(resid);
+}
+
+////////////////////////////////////////////////////////
+/// Golden file
+
+typedef struct golden_entry {
+    char     corpus[64];
+    char     filter[32];
+    size_t   len;
+    uint64_t hash;
+} golden_entry_t;
+
+static golden_entry_t golden[EVAL_MAX_GOLDEN];
+static size_t golden_count = 0;
+
+static void golden_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return;
+    }
+    char line[256];
+    while (golden_count < EVAL_MAX_GOLDEN && NULL != fgets(line, sizeof(line), f)) {
+        golden_entry_t *g = &golden[golden_count];
+        if (line[0] != '#' && 4 == sscanf(line, "%63s %31s %zu %" SCNx64, g->corpus, g->filter, &g->len, &g->hash)) {
+            golden_count++;
+        }
+    }
+    fclose(f);
+}
+
+static golden_entry_t *golden_find(const char *corpus, const char *filter) {
+    for(size_t i = 0; i < golden_count; i++) {
+        if (0 == strcmp(golden[i].corpus, corpus) && 0 == strcmp(golden[i].filter, filter)) {
+            return &golden[i];
+        }
+    }
+    return NULL;
+}
+
+// Replaces an entry, or adds it after the others; entries for corpora not
+// evaluated this run are kept as they were
+static int golden_set(const char *corpus, const char *filter, size_t len, uint64_t hash) {
+    golden_entry_t *g = golden_find(corpus, filter);
+    if (g == NULL) {
+        if (golden_count == EVAL_MAX_GOLDEN) {
+            return -1;
+        }
+        g = &golden[golden_count++];
+        snprintf(g->corpus, sizeof(g->corpus), "%s", corpus);
+        snprintf(g->filter, sizeof(g->filter), "%s", filter);
+    }
+    g->len = len;
+    g->hash = hash;
+    return 0;
+}
+
+static int golden_save(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    fprintf(f, "# corpus\tfilter\tsamples\tfnv1a64 of printed output\n");
+    for(size_t i = 0; i < golden_count; i++) {
+        fprintf(f, "%s\t%s\t%zu\t%016" PRIx64 "\n", golden[i].corpus, golden[i].filter, golden[i].len, golden[i].hash);
+    }
+    return (0 == fclose(f)) ? 0 : -1;
+}
+
+////////////////////////////////////////////////////////
+/// Entry point
+
+int main(int argc, char** argv) {
+    const char *golden_path = "golden/filters.golden";
+    int update = 0;
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "ug:h"))) {
+        switch (opt) {
+        case 'u':
+            update = 1;
+            break;
+        case 'g':
+            golden_path = optarg;
+            break;
+        default:
+            printf("Usage: %s [-u] [-g golden_file] [recorded_file ...]\n", argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    corpus_t corpora[3 + argc];
+    size_t num_corpora = 0;
+    make_step(&corpora[num_corpora++]);
+    make_ramp(&corpora[num_corpora++]);
+    make_spikes(&corpora[num_corpora++]);
+    if (optind == argc) {
+        if (0 == load_recorded(&corpora[num_corpora], "out.txt")) {
+            num_corpora++;
+        }
+    }
+    for(int i = optind; i < argc; i++) {
+        if (0 != load_recorded(&corpora[num_corpora], argv[i])) {
+            return EXIT_FAILURE;
+        }
+        num_corpora++;
+    }
+
+    golden_load(golden_path);
+
+    int failures = 0;
+    printf("%-10s %-10s %9s %9s %9s %10s  %s\n", "corpus", "filter", "rmse", "step_lat", "noise_red", "ns/sample", "golden");
+    for(size_t ci = 0; ci < num_corpora; ci++) {
+        corpus_t *c = &corpora[ci];
+        for(size_t fi = 0; fi < NUM_CANDIDATES; fi++) {
+            candidate_t *cand = &candidates[fi];
+            result_t res;
+            evaluate(c, cand, &res);
+
+            const char *status;
+            const golden_entry_t *g = golden_find(c->name, cand->name);
+            if (update) {
+                if (0 != golden_set(c->name, cand->name, c->len, res.hash)) {
+                    diag_error("too many golden entries (at most %d)", EVAL_MAX_GOLDEN);
+                    failures++;
+                }
+                status = "updated";
+            } else if (g == NULL) {
+                status = "MISSING";
+                failures++;
+            } else if (g->len != c->len || g->hash != res.hash) {
+                status = "CHANGED";
+                failures++;
+            } else {
+                status = "ok";
+            }
+
+            char rmse[24] = "-";
+            char lat[24] = "-";
+            if (!isnan(res.rmse)) {
+                snprintf(rmse, sizeof(rmse), "%.3f", res.rmse);
+            }
+            if (res.step_lat >= 0) {
+                snprintf(lat, sizeof(lat), "%ld", res.step_lat);
+            }
+            printf("%-10s %-10s %9s %9s %9.2f %10.1f  %s\n", c->name, cand->name, rmse, lat, res.noise_red, res.ns_per_sample, status);
+        }
+    }
+
+    if (update && failures == 0 && 0 != golden_save(golden_path)) {
+        diag_error("could not write %s", golden_path);
+        failures++;
+    }
+    for(size_t fi = 0; fi < NUM_CANDIDATES; fi++) {
+        cand_free(&candidates[fi]);
+    }
+    for(size_t ci = 0; ci < num_corpora; ci++) {
+        corpus_free(&corpora[ci]);
+    }
+
+    if (failures) {
+        printf("%d output(s) differ from %s\n", failures, golden_path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,442 @@
+/**
+ * @file history.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the compressed in-memory history
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "history.h"
+#include "mcp3301.h"
+
+/**
+ * @brief A packed block
+ *
+ * @remarks bits holds the count - 1 reading differences, then the
+ *          count - 2 time delta-of-deltas, then the positions of the
+ *          block's read errors (s.errors of them, HS_POS_BITS each), least
+ *          significant bit first. The differences and delta-of-deltas are
+ *          zigzag-encoded and each packed as a patched list (see
+ *          pfor_put()). A read error would need a 17-bit difference either
+ *          side of it, so instead it repeats the previous reading in the
+ *          differences (the first valid reading, at the start of the
+ *          block), and is put back from its listed position.
+ */
+typedef struct hs_block {
+    hs_summary_t s;
+    int16_t      v_first;
+    int64_t      dt_first;      // Spacing of the first two samples
+    uint8_t      v_bits;
+    uint8_t      v_exc_bits;
+    uint16_t     v_exc;
+    uint8_t      dod_bits;
+    uint8_t      dod_exc_bits;
+    uint16_t     dod_exc;
+    size_t       words;
+    uint64_t     bits[];
+} hs_block_t;
+
+// Bits to hold a position within a block
+#define HS_POS_BITS 10
+
+struct history {
+    size_t        max_bytes;
+
+    // The packed blocks, oldest first, from blocks[first]
+    hs_block_t  **blocks;
+    size_t        first;
+    size_t        count;
+    size_t        cap;
+
+    // The block being filled
+    int64_t       t[HS_BLOCK_LEN];
+    int16_t       v[HS_BLOCK_LEN];
+    size_t        n;
+    hs_summary_t  open;
+
+    hs_usage_t    usage;
+};
+
+static uint64_t zigzag(int64_t x) {
+    return ((uint64_t) x << 1) ^ (uint64_t)(x >> 63);
+}
+
+static int64_t unzigzag(uint64_t x) {
+    return (int64_t)(x >> 1) ^ -(int64_t)(x & 1);
+}
+
+static int bit_width(uint64_t x) {
+    return x ? 64 - __builtin_clzll(x) : 0;
+}
+
+////////////////////////////////////////////////////////
+/// Bit packing
+
+typedef struct bit_writer {
+    uint64_t *out;
+    uint64_t  acc;
+    int       n;
+} bit_writer_t;
+
+static void bw_put(bit_writer_t *w, uint64_t x, int width) {
+    if (width == 0) {
+        return;
+    }
+    w->acc |= x << w->n;
+    if (w->n + width >= 64) {
+        *w->out++ = w->acc;
+        w->acc = w->n ? x >> (64 - w->n) : 0;
+        w->n += width - 64;
+    } else {
+        w->n += width;
+    }
+}
+
+static void bw_flush(bit_writer_t *w) {
+    if (w->n > 0) {
+        *w->out++ = w->acc;
+    }
+}
+
+typedef struct bit_reader {
+    const uint64_t *in;
+    int             n;          // Bits of *in already read
+} bit_reader_t;
+
+static uint64_t br_get(bit_reader_t *r, int width) {
+    if (width == 0) {
+        return 0;
+    }
+    uint64_t x = r->in[0] >> r->n;
+    if (r->n + width >= 64) {
+        r->in++;
+        if (r->n + width > 64) {
+            x |= r->in[0] << (64 - r->n);
+        }
+        r->n += width - 64;
+    } else {
+        r->n += width;
+    }
+    return (width == 64) ? x : x & ((UINT64_C(1) << width) - 1);
+}
+
+////////////////////////////////////////////////////////
+/// Patched lists
+///
+/// A few large values (a bird landing, the gap between two bursts) would
+/// widen every value in a block if all were packed at one width. A
+/// patched list packs every value at a narrower width, writing 0 for the
+/// ones which don't fit, and follows them with those exceptions as a
+/// position and the full value each.
+
+typedef struct pfor {
+    int    bits;                // Width of each value
+    int    exc_bits;            // Width of each exception
+    size_t exc;                 // Number of exceptions
+} pfor_t;
+
+// Picks the widths which pack z[0..n) smallest
+static pfor_t pfor_choose(const uint64_t *z, size_t n) {
+    size_t at_width[65] = { 0 };
+    int widest = 0;
+    for(size_t i = 0; i < n; i++) {
+        int w = bit_width(z[i]);
+        at_width[w]++;
+        widest = w > widest ? w : widest;
+    }
+    pfor_t best = { widest, widest, 0 };
+    size_t best_bits = n * widest;
+    size_t exc = 0;
+    for(int w = widest - 1; w >= 0; w--) {
+        exc += at_width[w + 1];
+        size_t bits = n * w + exc * (HS_POS_BITS + widest);
+        if (bits < best_bits) {
+            best = (pfor_t){ w, widest, exc };
+            best_bits = bits;
+        }
+    }
+    return best;
+}
+
+static size_t pfor_bits(const pfor_t *p, size_t n) {
+    return n * p->bits + p->exc * (HS_POS_BITS + p->exc_bits);
+}
+
+static void pfor_put(bit_writer_t *w, const uint64_t *z, size_t n, const pfor_t *p) {
+    for(size_t i = 0; i < n; i++) {
+        bw_put(w, bit_width(z[i]) <= p->bits ? z[i] : 0, p->bits);
+    }
+    for(size_t i = 0; p->exc && i < n; i++) {
+        if (bit_width(z[i]) > p->bits) {
+            bw_put(w, i, HS_POS_BITS);
+            bw_put(w, z[i], p->exc_bits);
+        }
+    }
+}
+
+static void pfor_get(bit_reader_t *r, uint64_t *z, size_t n, int bits, int exc_bits, size_t exc) {
+    for(size_t i = 0; i < n; i++) {
+        z[i] = br_get(r, bits);
+    }
+    for(size_t i = 0; i < exc; i++) {
+        size_t pos = br_get(r, HS_POS_BITS);
+        z[pos] = br_get(r, exc_bits);
+    }
+}
+
+////////////////////////////////////////////////////////
+/// Summaries
+
+static void summary_reset(hs_summary_t *s) {
+    memset(s, 0, sizeof(*s));
+    s->min = INT16_MAX;
+    s->max = INT16_MIN;
+}
+
+static void summary_add(hs_summary_t *s, int64_t t_ns, int16_t val) {
+    if (s->count == 0) {
+        s->t_first = t_ns;
+    }
+    s->t_last = t_ns;
+    s->count++;
+    if (val == MCP3301_READ_ERROR) {
+        s->errors++;
+        return;
+    }
+    s->min = val < s->min ? val : s->min;
+    s->max = val > s->max ? val : s->max;
+    s->sum += val;
+    s->sum_sq += (uint64_t)((int32_t) val * val);
+}
+
+static void summary_merge(hs_summary_t *s, const hs_summary_t *b) {
+    if (b->count == 0) {
+        return;
+    }
+    if (s->count == 0) {
+        s->t_first = b->t_first;
+    }
+    s->t_last = b->t_last;
+    s->count += b->count;
+    s->errors += b->errors;
+    s->min = b->min < s->min ? b->min : s->min;
+    s->max = b->max > s->max ? b->max : s->max;
+    s->sum += b->sum;
+    s->sum_sq += b->sum_sq;
+}
+
+////////////////////////////////////////////////////////
+/// Appending
+
+history_t *hs_new(size_t max_bytes) {
+    history_t *h = (history_t *) calloc(1, sizeof(history_t));
+    if (h == NULL) {
+        return NULL;
+    }
+    h->max_bytes = max_bytes;
+    summary_reset(&h->open);
+    return h;
+}
+
+void hs_del(history_t *h) {
+    for(size_t i = 0; i < h->count; i++) {
+        free(h->blocks[h->first + i]);
+    }
+    free(h->blocks);
+    free(h);
+}
+
+static size_t block_bytes(const hs_block_t *b) {
+    return sizeof(hs_block_t) + b->words * sizeof(uint64_t);
+}
+
+// Drops the oldest blocks until the rest fit the budget
+static void hs_evict(history_t *h) {
+    while (h->usage.bytes > h->max_bytes && h->count > 0) {
+        hs_block_t *b = h->blocks[h->first];
+        h->usage.bytes -= block_bytes(b);
+        h->usage.samples -= b->s.count;
+        h->usage.evicted += b->s.count;
+        free(b);
+        h->first++;
+        h->count--;
+    }
+}
+
+// Packs the block being filled and starts a new one
+static int hs_seal(history_t *h) {
+    size_t n = h->n;
+    int16_t c[HS_BLOCK_LEN];
+    c[0] = 0;
+    for(size_t i = 0; i < n; i++) {
+        if (h->v[i] != MCP3301_READ_ERROR) {
+            c[0] = h->v[i];
+            break;
+        }
+    }
+    for(size_t i = 0; i < n; i++) {
+        c[i] = (h->v[i] != MCP3301_READ_ERROR) ? h->v[i] : c[i ? i - 1 : 0];
+    }
+
+    uint64_t zv[HS_BLOCK_LEN], zd[HS_BLOCK_LEN];
+    size_t nv = n - 1, nd = n > 2 ? n - 2 : 0;
+    for(size_t i = 1; i < n; i++) {
+        zv[i - 1] = zigzag(c[i] - c[i - 1]);
+    }
+    for(size_t i = 2; i < n; i++) {
+        zd[i - 2] = zigzag((h->t[i] - h->t[i - 1]) - (h->t[i - 1] - h->t[i - 2]));
+    }
+    pfor_t pv = pfor_choose(zv, nv);
+    pfor_t pd = pfor_choose(zd, nd);
+    size_t bits = pfor_bits(&pv, nv) + pfor_bits(&pd, nd) + h->open.errors * HS_POS_BITS;
+    size_t words = (bits + 63) / 64;
+
+    if (h->first + h->count == h->cap) {
+        if (h->first > 0) {
+            memmove(h->blocks, h->blocks + h->first, h->count * sizeof(hs_block_t *));
+            h->first = 0;
+        } else {
+            size_t cap = h->cap ? 2 * h->cap : 64;
+            hs_block_t **blocks = (hs_block_t **) realloc(h->blocks, cap * sizeof(hs_block_t *));
+            if (blocks == NULL) {
+                return -1;
+            }
+            h->blocks = blocks;
+            h->cap = cap;
+        }
+    }
+    hs_block_t *b = (hs_block_t *) malloc(sizeof(hs_block_t) + words * sizeof(uint64_t));
+    if (b == NULL) {
+        return -1;
+    }
+    b->s = h->open;
+    b->v_first = c[0];
+    b->dt_first = (n > 1) ? h->t[1] - h->t[0] : 0;
+    b->v_bits = (uint8_t) pv.bits;
+    b->v_exc_bits = (uint8_t) pv.exc_bits;
+    b->v_exc = (uint16_t) pv.exc;
+    b->dod_bits = (uint8_t) pd.bits;
+    b->dod_exc_bits = (uint8_t) pd.exc_bits;
+    b->dod_exc = (uint16_t) pd.exc;
+    b->words = words;
+
+    bit_writer_t w = { b->bits, 0, 0 };
+    pfor_put(&w, zv, nv, &pv);
+    pfor_put(&w, zd, nd, &pd);
+    for(size_t i = 0; i < n; i++) {
+        if (h->v[i] == MCP3301_READ_ERROR) {
+            bw_put(&w, i, HS_POS_BITS);
+        }
+    }
+    bw_flush(&w);
+
+    h->blocks[h->first + h->count++] = b;
+    h->usage.bytes += block_bytes(b);
+    h->n = 0;
+    summary_reset(&h->open);
+    hs_evict(h);
+    return 0;
+}
+
+int hs_append(history_t *h, int64_t t_ns, int16_t val) {
+    if (h->n == HS_BLOCK_LEN && 0 != hs_seal(h)) {
+        return -1;
+    }
+    h->t[h->n] = t_ns;
+    h->v[h->n] = val;
+    h->n++;
+    summary_add(&h->open, t_ns, val);
+    h->usage.samples++;
+    return 0;
+}
+
+////////////////////////////////////////////////////////
+/// Queries
+
+size_t hs_blocks(const history_t *h) {
+    return h->count + (h->n > 0);
+}
+
+void hs_block_summary(const history_t *h, size_t i, hs_summary_t *s) {
+    *s = (i < h->count) ? h->blocks[h->first + i]->s : h->open;
+}
+
+size_t hs_find(const history_t *h, int64_t t_ns) {
+    size_t lo = 0, hi = hs_blocks(h);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        hs_summary_t s;
+        hs_block_summary(h, mid, &s);
+        if (s.t_last < t_ns) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+size_t hs_decode(const history_t *h, size_t i, int64_t *t_ns, int16_t *vals) {
+    if (i >= h->count) {
+        memcpy(t_ns, h->t, h->n * sizeof(int64_t));
+        memcpy(vals, h->v, h->n * sizeof(int16_t));
+        return h->n;
+    }
+    const hs_block_t *b = h->blocks[h->first + i];
+    size_t n = b->s.count;
+    bit_reader_t r = { b->bits, 0 };
+    uint64_t z[HS_BLOCK_LEN];
+    pfor_get(&r, z, n - 1, b->v_bits, b->v_exc_bits, b->v_exc);
+    vals[0] = b->v_first;
+    for(size_t k = 1; k < n; k++) {
+        vals[k] = (int16_t)(vals[k - 1] + unzigzag(z[k - 1]));
+    }
+    pfor_get(&r, z, n > 2 ? n - 2 : 0, b->dod_bits, b->dod_exc_bits, b->dod_exc);
+    t_ns[0] = b->s.t_first;
+    if (n > 1) {
+        t_ns[1] = t_ns[0] + b->dt_first;
+    }
+    for(size_t k = 2; k < n; k++) {
+        t_ns[k] = 2 * t_ns[k - 1] - t_ns[k - 2] + unzigzag(z[k - 2]);
+    }
+    for(size_t k = 0; k < b->s.errors; k++) {
+        vals[br_get(&r, HS_POS_BITS)] = MCP3301_READ_ERROR;
+    }
+    return n;
+}
+
+void hs_range_summary(const history_t *h, int64_t t_from, int64_t t_to, hs_summary_t *s) {
+    summary_reset(s);
+    int64_t t[HS_BLOCK_LEN];
+    int16_t v[HS_BLOCK_LEN];
+    for(size_t i = hs_find(h, t_from); i < hs_blocks(h); i++) {
+        hs_summary_t b;
+        hs_block_summary(h, i, &b);
+        if (b.t_first > t_to) {
+            break;
+        }
+        if (b.t_first >= t_from && b.t_last <= t_to) {
+            summary_merge(s, &b);
+            continue;
+        }
+        size_t n = hs_decode(h, i, t, v);
+        for(size_t k = 0; k < n; k++) {
+            if (t[k] >= t_from && t[k] <= t_to) {
+                summary_add(s, t[k], v[k]);
+            }
+        }
+    }
+}
+
+void hs_get_usage(const history_t *h, hs_usage_t *u) {
+    *u = h->usage;
+    u->blocks = hs_blocks(h);
+}
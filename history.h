@@ -0,0 +1,161 @@
+/**
+ * @file history.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Compressed in-memory history of the raw readings, by time
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * An mcp3301_measurement_t takes 24 bytes, so a Pi can't keep weeks of
+ * readings as they are. A history_t instead packs them into blocks of
+ * up to HS_BLOCK_LEN samples:
+ *
+ * - Readings are stored as the difference from the previous one. Noise
+ *   moves a reading by only a few counts, so the differences in a block
+ *   are bit-packed at a narrow width, typically 4 to 6 bits; the few
+ *   which don't fit (a bird landing) are listed separately at full width.
+ * - Times are stored as the change in the spacing from the previous
+ *   sample (the delta-of-delta), which is a nanosecond or so within a
+ *   burst and a few microseconds of jitter for single reads; these are
+ *   packed the same way, with the gaps between bursts as the exceptions.
+ *
+ * Each block also keeps a summary (its time span, and the count, minimum,
+ * maximum, sum and sum of squares of its readings), so that statistics
+ * over a stretch of time only need to decode the blocks at its ends, and
+ * a block's time span lets hs_find() locate any time by binary search.
+ * The newest samples are kept unpacked until their block fills.
+ *
+ * When the packed blocks outgrow the given memory budget, the oldest are
+ * dropped. A history is not thread-safe; the sampler owns it.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Most samples in a block
+ */
+#define HS_BLOCK_LEN 1024
+
+/**
+ * @brief The summary of a block, or of a stretch of time
+ *
+ * @remarks Read errors (MCP3301_READ_ERROR) are counted, but left out of
+ *          the other figures.
+ */
+typedef struct hs_summary {
+    int64_t  t_first;       // Time of the first sample, in nanoseconds since the start of the run
+    int64_t  t_last;        // Time of the last sample
+    uint32_t count;         // Samples, including read errors
+    uint32_t errors;        // Read errors
+    int16_t  min;           // Smallest reading
+    int16_t  max;           // Largest reading
+    int64_t  sum;           // Sum of the readings
+    uint64_t sum_sq;        // Sum of the squares of the readings
+} hs_summary_t;
+
+/**
+ * @brief Figures for a history's memory use
+ */
+typedef struct hs_usage {
+    uint64_t samples;       // Samples held
+    uint64_t blocks;        // Blocks held, including the one being filled
+    uint64_t bytes;         // Bytes used by the packed blocks
+    uint64_t evicted;       // Samples dropped to stay within the budget
+} hs_usage_t;
+
+typedef struct history history_t;
+
+/**
+ * @brief Creates an empty history
+ *
+ * @param max_bytes The memory the packed blocks may use; the oldest are
+ *                  dropped beyond it
+ * @return history_t* The history, or NULL on failure
+ */
+history_t *hs_new(size_t max_bytes);
+
+/**
+ * @brief Frees a history
+ *
+ * @param h The history to free
+ */
+void hs_del(history_t *h);
+
+/**
+ * @brief Appends a sample
+ *
+ * @remarks Samples must be appended in order of time.
+ *
+ * @param h The history
+ * @param t_ns The sample's time, in nanoseconds since the start of the run
+ * @param val The raw reading
+ * @return int 0 on success, nonzero if memory ran out (the sample is lost)
+ */
+int hs_append(history_t *h, int64_t t_ns, int16_t val);
+
+/**
+ * @brief The number of blocks held, the oldest being block 0 and the one
+ *        being filled the last
+ *
+ * @param h The history
+ * @return size_t The number of blocks
+ */
+size_t hs_blocks(const history_t *h);
+
+/**
+ * @brief Reads the summary of a block
+ *
+ * @param h The history
+ * @param i The block's index
+ * @param s The location to write the summary to
+ */
+void hs_block_summary(const history_t *h, size_t i, hs_summary_t *s);
+
+/**
+ * @brief Finds the block holding a time
+ *
+ * @param h The history
+ * @param t_ns The time to find
+ * @return size_t The index of the first block ending at or after t_ns
+ *         (hs_blocks() if there is none)
+ */
+size_t hs_find(const history_t *h, int64_t t_ns);
+
+/**
+ * @brief Unpacks a block
+ *
+ * @param h The history
+ * @param i The block's index
+ * @param t_ns The location to write the samples' times to (HS_BLOCK_LEN of them)
+ * @param vals The location to write the readings to (HS_BLOCK_LEN of them)
+ * @return size_t The number of samples in the block
+ */
+size_t hs_decode(const history_t *h, size_t i, int64_t *t_ns, int16_t *vals);
+
+/**
+ * @brief Summarizes every sample from t_from to t_to, inclusive
+ *
+ * @remarks Blocks wholly inside the range are taken from their summaries;
+ *          only the blocks at its ends are unpacked.
+ *
+ * @param h The history
+ * @param t_from The start of the range
+ * @param t_to The end of the range
+ * @param s The location to write the summary to (count is 0 if the range is empty)
+ */
+void hs_range_summary(const history_t *h, int64_t t_from, int64_t t_to, hs_summary_t *s);
+
+/**
+ * @brief Reads a history's memory use
+ *
+ * @param h The history
+ * @param u The location to write the figures to
+ */
+void hs_get_usage(const history_t *h, hs_usage_t *u);
+
+#endif // HISTORY_H
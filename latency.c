@@ -0,0 +1,50 @@
+/**
+ * @file latency.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the per-consumer latency histograms
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <stdio.h>
+
+#include "latency.h"
+
+metric_t *lat_hists[LAT_CONSUMERS];
+
+static const char *lat_names[LAT_CONSUMERS] = {
+    "print", "subscriber", "dashboard", "capture"
+};
+
+static const char *lat_metric_names[LAT_CONSUMERS] = {
+    "latency_print_ns", "latency_subscriber_ns", "latency_dashboard_ns", "latency_capture_ns"
+};
+
+void lat_init(void) {
+    for(int i = 0; i < LAT_CONSUMERS; i++) {
+        if (lat_hists[i] == NULL) {
+            lat_hists[i] = metrics_histogram(lat_metric_names[i]);
+        }
+    }
+}
+
+void lat_report(FILE *out) {
+    for(int i = 0; i < LAT_CONSUMERS; i++) {
+        if (lat_hists[i] == NULL) {
+            continue;
+        }
+        metrics_hist_t h;
+        metric_read_hist(lat_hists[i], &h);
+        if (h.count == 0) {
+            continue;
+        }
+        fprintf(out, "Latency to %s: %llu samples, mean %.1f us, p50 %.1f us, p90 %.1f us, p99 %.1f us\n",
+                lat_names[i], (unsigned long long) h.count, (double) h.sum / h.count / 1e3,
+                metrics_hist_quantile(&h, 0.5) / 1e3, metrics_hist_quantile(&h, 0.9) / 1e3,
+                metrics_hist_quantile(&h, 0.99) / 1e3);
+    }
+}
@@ -0,0 +1,78 @@
+/**
+ * @file latency.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief End-to-end latency from acquiring a sample to each consumer seeing it
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * How fast the bus is read says little about how stale a reading is by
+ * the time anything sees it: bursts, pipelining, ring hand-offs and
+ * batched writes all hold samples back in exchange for throughput. So
+ * every sample carries the CLOCK_MONOTONIC time it was acquired through
+ * decoding, filtering and the ring, and each consumer records the age of
+ * the samples it delivers into a histogram of its own:
+ *
+ * - print: when the data line is handed to stdio
+ * - subscriber: when the batch holding the sample is sent to a subscriber
+ *   (once per subscriber)
+ * - dashboard: when the dashboard draws a sample it hasn't shown before
+ * - capture: when the buffer holding the frame is written to the file
+ *   (every frame in the buffer is recorded then)
+ *
+ * The histograms are ordinary metrics (named latency_<consumer>_ns), and
+ * lat_report() summarizes them on exit. When replaying, a sample counts
+ * as acquired when it is read from the file.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "metrics.h"
+
+/**
+ * @brief The consumers whose latency is tracked
+ */
+typedef enum lat_consumer {
+    LAT_PRINT = 0,
+    LAT_SUBSCRIBER,
+    LAT_DASHBOARD,
+    LAT_CAPTURE,
+    LAT_CONSUMERS
+} lat_consumer_t;
+
+/**
+ * @brief Each consumer's latency histogram (NULL until lat_init())
+ */
+extern metric_t *lat_hists[LAT_CONSUMERS];
+
+/**
+ * @brief Registers the latency histograms
+ *
+ * @remarks Until this is called, latencies are not recorded.
+ */
+void lat_init(void);
+
+/**
+ * @brief Records that a consumer has seen a sample
+ *
+ * @param who The consumer
+ * @param now_ns The CLOCK_MONOTONIC time, in nanoseconds, the consumer saw the sample
+ * @param acq_ns The CLOCK_MONOTONIC time, in nanoseconds, the sample was acquired
+ */
+static inline void lat_observe(lat_consumer_t who, int64_t now_ns, int64_t acq_ns) {
+    metric_observe(lat_hists[who], now_ns > acq_ns ? (uint64_t)(now_ns - acq_ns) : 0);
+}
+
+/**
+ * @brief Writes a summary line for every consumer that saw any samples
+ *
+ * @param out The file to write to
+ */
+void lat_report(FILE *out);
+
+#endif // LATENCY_H
@@ -28,8 +28,32 @@
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
 
 #include "spi.h"
+#include "spi_mmio.h"
+#include "broker.h"
+#include "capture.h"
+#include "rle.h"
+#include "history.h"
+#include "dist.h"
+#include "mcp3301.h"
+#include "adc_model.h"
+#include "timebase.h"
+#include "clocksrc.h"
+#include "replay.h"
+#include "filter.h"
+#include "snapshot.h"
+#include "dashboard.h"
+#include "ring.h"
+#include "subserver.h"
+#include "acquire.h"
+#include "diag.h"
+#include "metrics.h"
+#include "latency.h"
+#include "prof.h"
 
 ////////////////////////////////////////////////////////
 /// MCP 3301 measurement routines
@@ -42,6 +66,17 @@
  */
 static const char* device  = "/dev/spidev0.0";
 
+/**
+ * @brief The ADC model the reader is built for
+ * 
+ * @remarks To build for one of the MCP3301's siblings, point both of these
+ *          at another model in adc_model.h (e.g. adc_mcp3201_##fn and
+ *          ADC_MCP3201_##trait). Everything that depends on the model is
+ *          resolved at compile time.
+ */
+#define READER_ADC(fn)       adc_mcp3301_##fn
+#define READER_ADC_T(trait)  ADC_MCP3301_##trait
+
 /**
  * @brief SPI settings for the MCP3301
  */
@@ -53,32 +88,139 @@ spi_settings_t spi_settings_desired = {
 };
 
 /**
- * @brief Reads a single MCP3301 output value from the given SPI device
+ * @brief Nonzero when the SPI device has been switched to 16-bit words
  * 
- * @remarks 0x8001 is, according to the MCP3301 datasheet, not a valid
- *          output for the device.
+ * @remarks See enable_word_mode(). In word mode, each frame arrives as
+ *          one 16-bit word in CPU byte order instead of two bytes in bus
+ *          order, and must be decoded accordingly.
+ */
+static int word_mode = 0;
+
+/**
+ * @brief The memory-mapped controller to read through instead of spidev, if any
+ * 
+ * @remarks See spi_mmio.h. Only single reads go through it.
+ */
+static spi_mmio_t *mmio = NULL;
+
+/**
+ * @brief The SPI broker to send transfers through instead of opening the device, if any
+ * 
+ * @remarks See broker.h.
+ */
+static brk_client_t *broker = NULL;
+
+/**
+ * @brief The raw frame capture to record every frame read into, if any
+ * 
+ * @remarks See capture.h.
+ */
+static capture_t *capture = NULL;
+
+/**
+ * @brief The run-length encoded file to record every reading into, if any
+ * 
+ * @remarks See rle.h.
+ */
+static rle_writer_t *rle = NULL;
+
+/**
+ * @brief The reader's own metrics (see metrics.h)
+ */
+static metric_t *m_samples;
+static metric_t *m_read_errors;
+static metric_t *m_bursts;
+static metric_t *m_burst_ns;
+static metric_t *m_filter_window;
+
+/**
+ * @brief Decodes one raw frame in whichever mode the bus is in
+ * 
+ * @param raw_data The raw frame (two bytes, or one 16-bit word)
+ * @return int16_t The reading from the MCP3301
+ */
+static int16_t decode_frame(const uint8_t *raw_data) {
+    if (word_mode) {
+        uint16_t word;
+        memcpy(&word, raw_data, sizeof(word));
+        return READER_ADC(decode_word)(word);
+    }
+    return READER_ADC(decode)(raw_data);
+}
+
+/**
+ * @brief Tries to switch the SPI device to 16-bit words
+ * 
+ * @remarks Not every controller supports 16-bit words (the Raspberry Pi's
+ *          SPI0 driver, for one, only accepts 8). The new setting is only
+ *          kept if the controller accepts it, reports it back, and a test
+ *          frame can be read with it; otherwise the device is put back
+ *          into byte mode.
+ * 
+ * @param fd The SPI device file descriptor
+ * @return int Nonzero if word mode is now enabled
+ */
+int enable_word_mode(int fd) {
+    spi_settings_t s = spi_settings_desired;
+    spi_settings_t check;
+    uint8_t raw_data[2];
+    s.bits_per_word = 16;
+    if (READER_ADC_T(FRAME_LEN) != 2) {
+        return 0; // Only 16-bit frames fit in one word
+    }
+    if (0 == spi_write_settings(fd, &s) && 0 == spi_read_settings(fd, &check) &&
+        check.bits_per_word == 16 && 2 == spi_read_two_bytes(fd, raw_data)) {
+        spi_settings_desired.bits_per_word = 16;
+        word_mode = 1;
+        return 1;
+    }
+    spi_write_settings(fd, &spi_settings_desired);
+    return 0;
+}
+
+/**
+ * @brief Reads a single raw frame from the given SPI device and decodes it
  * 
  * @param fd The SPI device to read from which the MCP3301 is connected to
+ * @param raw_data The location to write the raw frame to
+ * @param status The location to write the transfer's byte count (or -1) to
  * @return int16_t The reading from the MCP3301, or 0x8001 in the event of an error
  */
-int16_t read_mcp3301_single(int fd) {
-    uint8_t raw_data[2];
-    int16_t data = 0;
-    char sign = 0;
+int16_t read_mcp3301_frame(int fd, uint8_t *raw_data, int *status) {
+    int ret;
 
-    if (2 != spi_read_two_bytes(fd, raw_data)) {
-        printf("read_mcp3301_single: failed to read value\n");
-        return 0x8001; // Should be an invalid output for the sensor
+    // Models with a command to send need a full-duplex transfer
+    if (mmio != NULL) {
+        ret = spi_mmio_transfer(mmio, READER_ADC(command)(), raw_data, READER_ADC_T(FRAME_LEN));
+    } else if (broker != NULL) {
+        ret = brk_transfer_frames(broker, READER_ADC(command)(), raw_data, 1, READER_ADC_T(FRAME_LEN), 0);
+    } else if (READER_ADC_T(FRAME_LEN) == 2) {
+        ret = spi_read_two_bytes(fd, raw_data);
+    } else {
+        ret = spi_transfer_frames(fd, READER_ADC(command)(), raw_data, 1, READER_ADC_T(FRAME_LEN), 0);
     }
-
-    data |= ((raw_data[0] & 0x0F) << 8);
-    data |= raw_data[1];
-    sign = (raw_data[0] & 0x10) ? 1 : 0;
-    if (sign) {
-        data -= 4096;
+    *status = ret;
+    if (READER_ADC_T(FRAME_LEN) != ret) {
+        diag_error("failed to read value");
+        return MCP3301_READ_ERROR; // Should be an invalid output for the sensor
     }
 
-    return data;
+    return decode_frame(raw_data);
+}
+
+/**
+ * @brief Reads a single MCP3301 output value from the given SPI device
+ * 
+ * @remarks 0x8001 is, according to the MCP3301 datasheet, not a valid
+ *          output for the device.
+ * 
+ * @param fd The SPI device to read from which the MCP3301 is connected to
+ * @return int16_t The reading from the MCP3301, or 0x8001 in the event of an error
+ */
+int16_t read_mcp3301_single(int fd) {
+    uint8_t raw_data[READER_ADC_T(FRAME_LEN)];
+    int status;
+    return read_mcp3301_frame(fd, raw_data, &status);
 }
 
 /**
@@ -122,152 +264,731 @@ typedef struct mcp3301_measurement {
     int16_t int_val;
 
     /**
-     * @brief The timestamp computed when the reading was taken
+     * @brief The timestamp computed when the reading was taken, in
+     *        seconds of CLOCK_MONOTONIC time since the program started
      */
     double  timestamp;
+
+    /**
+     * @brief The CLOCK_MONOTONIC time the reading was acquired, in
+     *        nanoseconds, carried to every consumer (see latency.h)
+     */
+    int64_t acq_ns;
 } mcp3301_measurement_t;
 
 /**
  * @brief Takes a single MCP3301 measurement from the given SPI device
  * 
  * @param fd The SPI device to read from which the MCP3301 is connected to
- * @param time_init The initial time that the timestamp should be computed from
+ * @param clk The clock source to timestamp the measurement with
+ * @param time_init The initial clock time (in nanoseconds) that the timestamp should be computed from
  * @return mcp3301_measurement_t The MCP3301 measurement value
  */
-mcp3301_measurement_t read_mcp3301_measurement(int fd, clock_t time_init) {
-    mcp3301_measurement_t mt = {0, 0.0};
-    mt.int_val = read_mcp3301_single(fd);
-    mt.timestamp = ((double)(clock() - time_init)) / CLOCKS_PER_SEC;
+mcp3301_measurement_t read_mcp3301_measurement(int fd, const clock_source_t *clk, int64_t time_init) {
+    mcp3301_measurement_t mt = {0, 0.0, 0};
+    uint8_t raw_data[READER_ADC_T(FRAME_LEN)];
+    int status;
+    mt.int_val = read_mcp3301_frame(fd, raw_data, &status);
+    int64_t t_ns = clk_now_ns(clk) - time_init;
+    mt.timestamp = ((double) t_ns) / 1e9;
+    mt.acq_ns = time_init + t_ns;
+    if (capture != NULL) {
+        cap_frame(capture, t_ns, status, raw_data);
+    }
     return mt;
 }
 
-////////////////////////////////////////////////////////
-/// Filter Buffer class
-
 /**
- * @brief A simple circular data buffer which enables simple data filtering
+ * @brief Decodes a burst of MCP3301 frames taken in a single SPI message
  * 
- * @remarks As this is a C-style class, one should treat all members
- *          as private and only use the given functions to access the
- *          class. In a more thorough design, this would be hidden in
- *          a *.c file for better protection.
- */
-typedef struct filter_buffer {
-    int    *data;
-    size_t  data_len;
-    int     location;
-} filter_buffer_t;
-
-/**
- * @brief Creates a new filter_buffer_t with the given buffer length
+ * @remarks The frames are taken in one SPI message, spaced by the frame
+ *          time plus spacing_us, so the individual readings can't be
+ *          timestamped as they arrive. Instead, the time the message took
+ *          beyond the nominal n * period is treated as unknown overhead,
+ *          and the burst is centered within it: reading i is stamped at
+ *          start + overhead / 2 + i * period, and error_bound is set to
+ *          half the overhead. If the transfer failed, every measurement in
+ *          the burst is 0x8001.
  * 
- * @param len The length of the buffer to allocate
- * @return filter_buffer_t* The newly-created filter_buffer_t
+ * @param raw_data The raw frames (n frames of the model's frame length)
+ * @param ok Nonzero if the transfer succeeded
+ * @param t_before The clock time (in nanoseconds) just before the transfer
+ * @param t_after The clock time (in nanoseconds) just after the transfer
+ * @param time_init The initial clock time (in nanoseconds) that the timestamps should be computed from
+ * @param out The location to write the measurements to
+ * @param n The number of frames in the burst
+ * @param spacing_us The idle time between frames, in microseconds
+ * @param period The location to write the nominal sample period (in seconds) to
+ * @param error_bound The location to write the timestamp error bound (in seconds) to
  */
-filter_buffer_t *fb_new(size_t len) {
-    filter_buffer_t *fb = (filter_buffer_t *) malloc(sizeof(filter_buffer_t));
-    fb->data = (int*) malloc(sizeof(int) * len);
-    memset(fb->data, 0, sizeof(int) * len);
-    fb->data_len = len;
-    fb->location = 0;
-    return fb;
-}
+void mcp3301_decode_burst(const uint8_t *raw_data, int ok, int64_t t_before, int64_t t_after, int64_t time_init,
+                          mcp3301_measurement_t *out, int n, uint16_t spacing_us, double *period, double *error_bound) {
+    int16_t vals[SPI_BURST_MAX];
+    if (word_mode) {
+        const uint16_t *words = (const uint16_t *) raw_data;
+        for(int i = 0; i < n; i++) {
+            vals[i] = READER_ADC(decode_word)(words[i]);
+        }
+    } else {
+        READER_ADC(decode_simd)(raw_data, vals, n);
+    }
 
-/**
- * @brief Deletes a given filter_buffer_t
- * 
- * @param fb The filter_buffer_t to delete
- */
-void fb_del(filter_buffer_t *fb) {
-    free(fb->data);
-    free(fb);
+    double frame_s = 8.0 * READER_ADC_T(FRAME_LEN) / spi_settings_desired.max_speed_hz + spacing_us / 1e6;
+    double start = ((double)(t_before - time_init)) / 1e9;
+    double overhead = ((double)(t_after - t_before)) / 1e9 - n * frame_s;
+    *period = frame_s;
+    *error_bound = fabs(overhead) / 2;
+    for(int i = 0; i < n; i++) {
+        out[i].int_val = ok ? vals[i] : MCP3301_READ_ERROR;
+        out[i].timestamp = start + overhead / 2 + i * frame_s;
+        out[i].acq_ns = time_init + llround(out[i].timestamp * 1e9);
+        if (capture != NULL) {
+            cap_frame(capture, llround(out[i].timestamp * 1e9), ok ? READER_ADC_T(FRAME_LEN) : -1,
+                      raw_data + i * READER_ADC_T(FRAME_LEN));
+        }
+    }
 }
 
 /**
- * @brief [PRIVATE] Increment the filter_buffer_t's location
+ * @brief Reads a burst of MCP3301 measurements paced by the SPI controller
  * 
- * @remarks The location field tells the filter_buffer_t where in the
- *          data array new data should be written to.
+ * @remarks See mcp3301_decode_burst() for how the readings are timestamped.
  * 
- * @param fb The filter_buffer_t to increment the location of
+ * @param fd The SPI device to read from which the MCP3301 is connected to
+ * @param clk The clock source to timestamp the measurements with
+ * @param time_init The initial clock time (in nanoseconds) that the timestamps should be computed from
+ * @param out The location to write the measurements to
+ * @param n The number of measurements to take (at most SPI_BURST_MAX)
+ * @param spacing_us The idle time between frames, in microseconds
+ * @param period The location to write the nominal sample period (in seconds) to
+ * @param error_bound The location to write the timestamp error bound (in seconds) to
  */
-void fb_incr_loc(filter_buffer_t *fb) {
-    fb->location = (fb->location + 1) % fb->data_len;
+void read_mcp3301_burst(int fd, const clock_source_t *clk, int64_t time_init, mcp3301_measurement_t *out,
+                        int n, uint16_t spacing_us, double *period, double *error_bound) {
+    // Declared as words so that the buffer is aligned for word mode
+    uint16_t raw_words[(SPI_BURST_MAX * READER_ADC_T(FRAME_LEN) + 1) / 2];
+    uint8_t *raw_data = (uint8_t *) raw_words;
+    int len = n * READER_ADC_T(FRAME_LEN);
+
+    int64_t t_before = clk_now_ns(clk);
+    int ret;
+    if (broker != NULL) {
+        ret = brk_transfer_frames(broker, READER_ADC(command)(), raw_data, n, READER_ADC_T(FRAME_LEN), spacing_us);
+    } else {
+        ret = spi_transfer_frames(fd, READER_ADC(command)(), raw_data, n, READER_ADC_T(FRAME_LEN), spacing_us);
+    }
+    int64_t t_after = clk_now_ns(clk);
+    metric_inc(m_bursts);
+    metric_observe(m_burst_ns, t_after - t_before);
+
+    if (ret != len) {
+        diag_error("failed to read values");
+    }
+    mcp3301_decode_burst(raw_data, ret == len, t_before, t_after, time_init, out, n, spacing_us, period, error_bound);
 }
 
 /**
- * @brief Push a new value into the filter_buffer_t
- * 
- * @remarks The filter_buffer_t's location is incremented in this operation.
- * 
- * @param fb The filter_buffer_t to push a value into
- * @param val The value to push into the filter_buffer_t
+ * @brief Writes an epoch anchor to STDOUT as a comment line
+ *
+ * @remarks The anchor's monotonic time should be relative to the start
+ *          of the run, so that it shares a time base with the measurement
+ *          timestamps. See out2utc.c for the conversion of a recorded file
+ *          to UTC.
+ *
+ * @param anchor The anchor to write
  */
-void fb_push(filter_buffer_t *fb, int val) {
-    fb->data[fb->location] = val;
-    fb_incr_loc(fb);
+void print_anchor(const tb_anchor_t *anchor) {
+    printf("# anchor\t%" PRId64 "\t%" PRId64 "\n", anchor->mono_ns, anchor->real_ns);
 }
 
 /**
- * @brief Computes the average of the filter_buffer_t's data, ignoring 
- *        the largest and smallest vlues
- * 
- * @param fb The filter_buffer_t to compute the average for
- * @return double The average of the data values (sans max and min) in the given filter_buffer_t
+ * @brief Records an epoch anchor from the live clocks and writes it to STDOUT
+ *
+ * @param time_init The initial monotonic time (in nanoseconds) of the run
+ * @param anchor The location to write the anchor (relative to time_init) to
+ * @return int 0 on success, nonzero otherwise
  */
-double filter_avg(filter_buffer_t *fb) {
-    int max = fb->data[0];
-    int min = fb->data[0];
-    int sum = max;
-    int data;
-    for(int i = 1; i < fb->data_len; i++) {
-        data = fb->data[i];
-        if (data > max) {
-            max = data;
-        }
-        if (data < min) {
-            min = data;
-        }
-        sum += data;
+int emit_anchor(int64_t time_init, tb_anchor_t *anchor) {
+    // A failed take may have written part of its result, so the caller's
+    // previous anchor is only replaced once a new one is in hand
+    tb_anchor_t taken;
+    if (0 != tb_anchor_take(&taken)) {
+        return -1;
     }
-    sum = sum - max - min;
-    return ((double) sum) / (fb->data_len - 2);
+    *anchor = taken;
+    anchor->mono_ns -= time_init;
+    print_anchor(anchor);
+    if (capture != NULL) {
+        cap_anchor(capture, anchor);
+    }
+    if (rle != NULL) {
+        rle_anchor(rle, anchor);
+    }
+    return 0;
 }
 
 ////////////////////////////////////////////////////////
 /// Entry point
 
+/**
+ * @brief Cleared by the signal handler to end the read loop
+ */
+static volatile sig_atomic_t running = 1;
+
+static void handle_stop_signal(int sig) {
+    (void) sig;
+    running = 0;
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s [-d] [-S socket] [-w] [-b frames [-p spacing_us] [-P buffers]] [-m mem|regfile] [-B broker] [-c capture_file] [-R rle_file [-j tolerance_ns]] [-H history_mb] [-I interval_s] [-L log_file] [-M metrics_file] [-F hz [-O profile_file]] [-a sigma [-A max_window]] [-r replay_file] [-s speed]\n", name);
+    printf("  -d        show a live dashboard on STDERR (data lines are not\n");
+    printf("            printed when STDOUT is also the terminal)\n");
+    printf("  -S PATH   serve the live stream to subscribers on a Unix domain socket\n");
+    printf("  -w        use 16-bit SPI words if the controller supports them\n");
+    printf("  -b N      read N frames per SPI message, paced by the controller\n");
+    printf("  -p US     idle time between frames in a burst, in microseconds\n");
+    printf("  -P N      pipeline bursts through N buffers, overlapping transfers\n");
+    printf("            with processing (default burst size %d)\n", SPI_BURST_MAX);
+    printf("  -m mem    read by polling the SPI0 registers directly (needs root)\n");
+    printf("  -m FILE   the same, against a simulated controller backed by FILE\n");
+    printf("  -B NAME   send transfers through the SPI broker at NAME (e.g. %s)\n", BRK_DEFAULT_NAME);
+    printf("  -c FILE   also record the raw frames read into a binary capture file\n");
+    printf("  -R FILE   also record the readings into a run-length encoded file\n");
+    printf("  -j NS     how far the RLE file's timestamps may stray, in nanoseconds\n");
+    printf("            (default 0: exact, which suits bursts; try 20000 for single reads)\n");
+    printf("  -H MB     keep a compressed history of the readings in up to MB megabytes\n");
+    printf("  -I SEC    keep an exact histogram of the readings for every SEC seconds\n");
+    printf("  -L FILE   append diagnostics to FILE instead of STDERR\n");
+    printf("  -M FILE   write the reader's metrics to FILE on exit (- for STDERR)\n");
+    printf("  -F HZ     profile the reader, sampling its stacks HZ times per CPU second\n");
+    printf("  -O FILE   write the profile's folded stacks to FILE on exit and on\n");
+    printf("            SIGUSR2 (default profile.folded)\n");
+    printf("  -a SIGMA  auto-tune the filter window to the shortest that holds the\n");
+    printf("            filtered weight to SIGMA counts of noise while the perch is steady\n");
+    printf("  -A N      longest window the tuner may pick, i.e. the longest settling\n");
+    printf("            time allowed after a step, in readings (default %d)\n", TUNE_MAX_WINDOW);
+    printf("  -r FILE   replay a recorded output or capture file instead of reading the SPI bus\n");
+    printf("  -s SPEED  replay speed relative to real time (0 = unbounded, default)\n");
+}
+
 int main(int argc, char** argv) {
-    clock_t t_init = clock();
+    const char *replay_path = NULL;
+    double replay_speed = 0.0;
+    int dashboard = 0;
+    const char *sub_path = NULL;
+    int burst = 1;
+    int spacing_us = 0;
+    int pipeline_bufs = 0;
+    int want_words = 0;
+    const char *mmio_path = NULL;
+    const char *broker_name = NULL;
+    const char *capture_path = NULL;
+    const char *rle_path = NULL;
+    long long rle_tol_ns = 0;
+    double history_mb = 0.0;
+    double dist_s = 0.0;
+    const char *log_path = NULL;
+    const char *metrics_path = NULL;
+    int prof_hz = 0;
+    const char *prof_path = "profile.folded";
+    double tune_sigma = 0.0;
+    int tune_max = TUNE_MAX_WINDOW;
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "dS:wb:p:P:m:B:c:R:j:H:I:L:M:F:O:a:A:r:s:h"))) {
+        switch (opt) {
+        case 'd':
+            dashboard = 1;
+            break;
+        case 'S':
+            sub_path = optarg;
+            break;
+        case 'w':
+            want_words = 1;
+            break;
+        case 'b':
+            burst = atoi(optarg);
+            break;
+        case 'p':
+            spacing_us = atoi(optarg);
+            break;
+        case 'P':
+            pipeline_bufs = atoi(optarg);
+            break;
+        case 'm':
+            mmio_path = optarg;
+            break;
+        case 'B':
+            broker_name = optarg;
+            break;
+        case 'c':
+            capture_path = optarg;
+            break;
+        case 'R':
+            rle_path = optarg;
+            break;
+        case 'j':
+            rle_tol_ns = atoll(optarg);
+            break;
+        case 'H':
+            history_mb = atof(optarg);
+            break;
+        case 'I':
+            dist_s = atof(optarg);
+            break;
+        case 'L':
+            log_path = optarg;
+            break;
+        case 'M':
+            metrics_path = optarg;
+            break;
+        case 'F':
+            prof_hz = atoi(optarg);
+            break;
+        case 'O':
+            prof_path = optarg;
+            break;
+        case 'a':
+            tune_sigma = atof(optarg);
+            break;
+        case 'A':
+            tune_max = atoi(optarg);
+            break;
+        case 'r':
+            replay_path = optarg;
+            break;
+        case 's':
+            replay_speed = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // Diagnostics are written out by their own thread, away from STDOUT
+    diag_start(log_path);
+
+    m_samples = metrics_counter("samples_total");
+    m_read_errors = metrics_counter("read_errors_total");
+    m_bursts = metrics_counter("bursts_total");
+    m_burst_ns = metrics_histogram("burst_transfer_ns");
+    m_filter_window = metrics_gauge("filter_window");
+    lat_init();
+    if (replay_speed < 0.0) {
+        diag_error("replay speed must not be negative");
+        goto fail;
+    }
+    if (history_mb < 0.0) {
+        diag_error("history size must not be negative");
+        goto fail;
+    }
+    if (dist_s < 0.0) {
+        diag_error("histogram interval must not be negative");
+        goto fail;
+    }
+    if (rle_tol_ns < 0) {
+        diag_error("RLE time tolerance must not be negative");
+        goto fail;
+    }
+    if (tune_sigma < 0.0 || tune_max < TUNE_MIN_WINDOW || tune_max > TUNE_MAX_WINDOW) {
+        diag_error("tuning target must be positive, window %d to %d", TUNE_MIN_WINDOW, TUNE_MAX_WINDOW);
+        goto fail;
+    }
+    if (pipeline_bufs != 0 && (pipeline_bufs < 2 || pipeline_bufs > ACQ_MAX_BUFS)) {
+        diag_error("pipeline must use 2 to %d buffers", ACQ_MAX_BUFS);
+        goto fail;
+    }
+    if (pipeline_bufs != 0 && burst == 1) {
+        burst = SPI_BURST_MAX;
+    }
+    if (burst < 1 || burst > SPI_BURST_MAX || spacing_us < 0 || spacing_us > UINT16_MAX) {
+        diag_error("burst must be 1 to %d frames, spacing 0 to %d us", SPI_BURST_MAX, UINT16_MAX);
+        goto fail;
+    }
+
+    if (mmio_path != NULL && (burst != 1 || pipeline_bufs != 0 || want_words)) {
+        diag_error("-m supports single reads only (no -b, -P or -w)");
+        goto fail;
+    }
+
+    if (broker_name != NULL && (mmio_path != NULL || pipeline_bufs != 0 || want_words)) {
+        diag_error("-B can't be combined with -m, -P or -w");
+        goto fail;
+    }
+
+    if (capture_path != NULL && replay_path != NULL) {
+        diag_error("-c captures live reads only");
+        goto fail;
+    }
+
+    if (spi_settings_desired.max_speed_hz > READER_ADC_T(MAX_HZ)) {
+        diag_warn("%u Hz is above the ADC's %d Hz maximum clock",
+                spi_settings_desired.max_speed_hz, READER_ADC_T(MAX_HZ));
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // A replay drives a virtual clock from its recorded timestamps, which
+    // are already relative to the start of the recorded run
+    clock_source_t clk;
+    replay_t *replay = NULL;
     int spi_fd = 0;
-    if (0 >= (spi_fd = spi_init(device, &spi_settings_desired))) {
-        printf("main: could not initialize SPI bus\n");
+    int64_t t_init = 0;
+    if (replay_path != NULL) {
+        if (NULL == (replay = replay_open(replay_path))) {
+            diag_error("could not open replay file");
+            goto fail;
+        }
+        // Frames from a capture are decoded as they were read live
+        const cap_file_header_t *cap = replay_capture_header(replay);
+        if (cap != NULL) {
+            if (cap->frame_len != READER_ADC_T(FRAME_LEN)) {
+                diag_error("capture holds %u-byte frames, this reader decodes %d",
+                       cap->frame_len, READER_ADC_T(FRAME_LEN));
+                goto fail;
+            }
+            word_mode = (cap->flags & CAP_FLAG_WORDS) != 0;
+        }
+        clk_init_virtual(&clk, replay_speed);
+    } else {
+        clk_init_real(&clk);
+        t_init = clk_now_ns(&clk);
+        if (mmio_path != NULL) {
+            mmio = (0 == strcmp(mmio_path, "mem")) ? spi_mmio_open(&spi_settings_desired)
+                                                   : spi_mmio_open_sim(mmio_path, &spi_settings_desired);
+            if (mmio == NULL) {
+                diag_error("could not map SPI controller");
+                goto fail;
+            }
+        } else if (broker_name != NULL) {
+            if (NULL == (broker = brk_connect(broker_name, &spi_settings_desired, 0))) {
+                diag_error("could not connect to SPI broker");
+                goto fail;
+            }
+        } else if (0 >= (spi_fd = spi_init(device, &spi_settings_desired))) {
+            diag_error("could not initialize SPI bus");
+            goto fail;
+        }
+        if (want_words && !enable_word_mode(spi_fd)) {
+            diag_warn("controller does not support 16-bit words, using bytes");
+        }
+        if (capture_path != NULL &&
+            NULL == (capture = cap_open(capture_path, READER_ADC_T(FRAME_LEN), word_mode ? CAP_FLAG_WORDS : 0,
+                                        spi_settings_desired.max_speed_hz, t_init))) {
+            diag_error("could not create capture file");
+            goto fail;
+        }
+    }
+
+    // Recording a replay into an RLE file converts a text output or
+    // capture into one
+    if (rle_path != NULL && NULL == (rle = rle_open(rle_path, rle_tol_ns))) {
+        diag_error("could not create RLE file");
+        goto fail;
+    }
+
+    // The history keeps every reading, compressed, for as long as fits
+    history_t *history = NULL;
+    if (history_mb > 0.0 && NULL == (history = hs_new((size_t)(history_mb * 1024 * 1024)))) {
+        diag_error("could not create history");
+        goto fail;
+    }
+
+    // Exact histograms of the readings, one per interval
+    dist_log_t *dists = NULL;
+    if (dist_s > 0.0 && NULL == (dists = dist_log_new(llround(dist_s * 1e9)))) {
+        diag_error("could not create histogram log");
         goto fail;
     }
 
     filter_buffer_t *fb = fb_new(16);
+    metric_set(m_filter_window, (int64_t) fb->data_len);
+
+    // The tuner starts from the default window, and moves it once it has
+    // measured the perch's noise
+    filter_tuner_t tuner;
+    if (tune_sigma > 0.0) {
+        tune_init(&tuner, tune_sigma, (size_t) tune_max, fb->data_len);
+    }
 
     int loops = 0;
     double t = 0;
-    mcp3301_measurement_t mt = {0, 0.0};
+    mcp3301_measurement_t mt = {0, 0.0, 0};
+    replay_record_t rrec;
+    // If no anchor can be taken, the zeroed one makes the loop below try
+    // again at the first re-anchor period
+    tb_anchor_t anchor = {0, 0};
+    if (replay == NULL) {
+        emit_anchor(t_init, &anchor);
+    }
+
+    // The dashboard reads the latest values through a snapshot at its own
+    // refresh rate; the sampler never touches the terminal itself
+    static live_snapshot_t live_snap;
+    live_values_t live = {0};
+    int print_data = 1;
+    if (dashboard) {
+        print_data = !isatty(STDOUT_FILENO);
+        if (0 != dash_start(&live_snap, stderr)) {
+            dashboard = 0;
+            print_data = 1;
+        }
+    }
+
+    // Subscribers are served from their own thread, which the sampler
+    // feeds through a lock-free ring
+    sample_ring_t *sub_ring = NULL;
+    if (sub_path != NULL) {
+        if (NULL == (sub_ring = ring_new(1 << 16)) || 0 != sub_start(sub_path, sub_ring)) {
+            diag_error("could not start subscription server");
+            goto fail;
+        }
+    }
 
     // Note: the exit logic was originally set to exit after some number
-    // of seconds; now, you are expected to ctrl-C out of this program.
-    for(;; t = (((double)(clock() - t_init))/ CLOCKS_PER_SEC)) {
-        mt = read_mcp3301_measurement(spi_fd, t_init);
-        fb_push(fb, mt.int_val);
-        printf("%5.6f\t%d\t%4.3f\n", mt.timestamp, mt.int_val, filter_avg(fb));
-        loops++;
+    // of seconds; now, you are expected to ctrl-C out of this program
+    // (or let a replay run to the end of its file).
+    // In pipelined mode, bus transfers run on their own thread while this
+    // one decodes and processes the previous burst
+    acq_pipeline_t *acq = NULL;
+    if (pipeline_bufs != 0 && replay == NULL) {
+        if (NULL == (acq = acq_start(spi_fd, pipeline_bufs, burst, READER_ADC(command)(),
+                                   READER_ADC_T(FRAME_LEN), (uint16_t) spacing_us))) {
+            diag_error("could not start acquisition pipeline");
+            goto fail;
+        }
+    }
+
+    if (prof_hz != 0 && 0 != prof_start(prof_hz, prof_path)) {
+        diag_error("could not start profiler");
+        goto fail;
     }
 
-    // This code is currently never reached.
-    printf("Loops: %d\tAvg time: %2.8f\tLoops/sec: %d\n", loops, t / loops, (int)(loops / t));
+    mcp3301_measurement_t batch[SPI_BURST_MAX];
+    while (running) {
+        // Acquire the next batch of measurements: one at a time from a
+        // replay or single reads, or a whole controller-paced burst
+        int count = 1;
+        if (replay != NULL) {
+            replay_kind_t kind = replay_next(replay, &rrec);
+            if (kind == REPLAY_EOF) {
+                break;
+            }
+            if (kind == REPLAY_ANCHOR) {
+                print_anchor(&rrec.anchor);
+                if (rle != NULL) {
+                    rle_anchor(rle, &rrec.anchor);
+                }
+                continue;
+            }
+            if (kind == REPLAY_FRAME) {
+                rrec.int_val = (rrec.status == READER_ADC_T(FRAME_LEN)) ? decode_frame(rrec.frame) : MCP3301_READ_ERROR;
+            }
+            clk_advance_to(&clk, rrec.t_ns);
+            batch[0].int_val = rrec.int_val;
+            batch[0].timestamp = ((double)(clk_now_ns(&clk) - t_init)) / 1e9;
+            batch[0].acq_ns = tb_mono_ns();
+        } else if (acq != NULL) {
+            double period, error_bound;
+            acq_buf_t *b = acq_next(acq);
+            int ok = (b->status == READER_ADC_T(FRAME_LEN) * burst);
+            if (!ok) {
+                diag_error("pipelined burst failed");
+            }
+            count = burst;
+            mcp3301_decode_burst(b->raw, ok, b->t_before, b->t_after, t_init,
+                                 batch, burst, (uint16_t) spacing_us, &period, &error_bound);
+            acq_release(acq, b);
+            if (print_data) {
+                printf("# burst\t%5.6f\t%d\t%.9f\t%.9f\n", batch[0].timestamp, burst, period, error_bound);
+            }
+        } else if (burst > 1) {
+            double period, error_bound;
+            count = burst;
+            read_mcp3301_burst(spi_fd, &clk, t_init, batch, burst, (uint16_t) spacing_us, &period, &error_bound);
+            if (print_data) {
+                printf("# burst\t%5.6f\t%d\t%.9f\t%.9f\n", batch[0].timestamp, burst, period, error_bound);
+            }
+        } else {
+            batch[0] = read_mcp3301_measurement(spi_fd, &clk, t_init);
+        }
+
+        for(int k = 0; k < count; k++) {
+            mt = batch[k];
+            metric_inc(m_samples);
+            if (mt.int_val == MCP3301_READ_ERROR) {
+                metric_inc(m_read_errors);
+            }
+            if (tune_sigma > 0.0 && mt.int_val != MCP3301_READ_ERROR) {
+                size_t window = tune_push(&tuner, mt.int_val);
+                if (window != fb->data_len && 0 == fb_resize(fb, window)) {
+                    metric_set(m_filter_window, (int64_t) window);
+                    diag_info("filter window now %zu readings", window);
+                }
+            }
+            if (rle != NULL) {
+                rle_sample(rle, llround(mt.timestamp * 1e9), mt.int_val);
+            }
+            if (history != NULL && 0 != hs_append(history, llround(mt.timestamp * 1e9), mt.int_val)) {
+                diag_error("out of memory for history");
+            }
+            if (dists != NULL && 0 != dist_log_sample(dists, llround(mt.timestamp * 1e9), mt.int_val)) {
+                diag_error("out of memory for histograms");
+            }
+            fb_push(fb, mt.int_val);
+            double avg = filter_avg(fb);
+            if (print_data) {
+                printf("%5.6f\t%d\t%4.3f\n", mt.timestamp, mt.int_val, avg);
+                lat_observe(LAT_PRINT, tb_mono_ns(), mt.acq_ns);
+            }
+            if (dashboard) {
+                snap_record_sample(&live, llround(mt.timestamp * 1e9), mt.int_val, avg, mt.int_val == MCP3301_READ_ERROR, mt.acq_ns);
+                snap_publish(&live_snap, &live);
+            }
+            if (sub_ring != NULL) {
+                sample_rec_t rec = { llround(mt.timestamp * 1e9), avg, mt.int_val, mt.int_val == MCP3301_READ_ERROR, mt.acq_ns };
+                ring_push(sub_ring, &rec);
+            }
+            loops++;
+        }
+        t = mt.timestamp;
+
+        // Re-anchor periodically so that drift between the monotonic and
+        // wall clocks can be corrected for afterwards
+        if (replay == NULL && mt.timestamp * 1e9 >= (double)(anchor.mono_ns + TB_ANCHOR_PERIOD_NS)) {
+            emit_anchor(t_init, &anchor);
+        }
+    }
+
+    if (prof_hz != 0) {
+        prof_stats_t pst;
+        if (0 != prof_stop(&pst)) {
+            diag_error("could not write profile");
+        }
+        fprintf(stderr, "Profile: %llu samples (%llu dropped) in %llu stacks written to %s\n",
+                (unsigned long long) pst.samples, (unsigned long long) pst.dropped,
+                (unsigned long long) pst.stacks, prof_path);
+    }
+    if (acq != NULL) {
+        // Throughput against what the bus could carry at its configured
+        // speed (one frame per reading, ignoring inter-frame gaps)
+        acq_stats_t st;
+        acq_stop(acq, &st);
+        double secs = st.elapsed_ns / 1e9;
+        double capacity = spi_settings_desired.max_speed_hz / (8.0 * READER_ADC_T(FRAME_LEN));
+        fprintf(stderr, "Pipeline: %llu frames in %.3f s = %.1f frames/s (%.1f%% of %.1f frames/s bus capacity)\n",
+                (unsigned long long) st.frames, secs, st.frames / secs, 100.0 * st.frames / secs / capacity, capacity);
+        fprintf(stderr, "Pipeline: bus busy %.1f%% of the time, %llu stalls waiting on processing, %llu failed bursts\n",
+                100.0 * st.busy_ns / st.elapsed_ns, (unsigned long long) st.stalls, (unsigned long long) st.failed);
+    }
+    if (dashboard) {
+        dash_stop();
+    }
+    if (sub_ring != NULL) {
+        sub_stop();
+    }
+    fflush(stdout);
+    if (t > 0) {
+        fprintf(stderr, "Loops: %d\tAvg time: %2.8f\tLoops/sec: %d\n", loops, t / loops, (int)(loops / t));
+    }
+    if (sub_ring != NULL) {
+        fprintf(stderr, "Subscription ring drops: %llu\tSubscribers dropped: %llu\n",
+                (unsigned long long) sub_ring->drops, (unsigned long long) sub_dropped_clients());
+        ring_del(sub_ring);
+    }
+    if (capture != NULL) {
+        cap_stats_t cst;
+        if (0 != cap_close(capture, &cst)) {
+            diag_error("capture file is incomplete (write failed)");
+        }
+        fprintf(stderr, "Capture: %llu frames, %llu dropped, %llu bytes\n", (unsigned long long) cst.frames,
+                (unsigned long long) cst.dropped, (unsigned long long) cst.bytes);
+    }
+    if (rle != NULL) {
+        rle_stats_t rst;
+        if (0 != rle_close(rle, &rst)) {
+            diag_error("RLE file is incomplete (write failed)");
+        }
+        fprintf(stderr, "RLE: %llu samples in %llu runs, %llu segments, %llu zones, %llu bytes\n", (unsigned long long) rst.samples,
+                (unsigned long long) rst.runs, (unsigned long long) rst.segments, (unsigned long long) rst.zones,
+                (unsigned long long) rst.bytes);
+    }
+    if (history != NULL) {
+        hs_usage_t hu;
+        hs_summary_t hsum;
+        hs_get_usage(history, &hu);
+        hs_range_summary(history, INT64_MIN, INT64_MAX, &hsum);
+        fprintf(stderr, "History: %llu samples in %llu blocks, %.1f KB (%.2f bits/sample), %llu evicted\n",
+                (unsigned long long) hu.samples, (unsigned long long) hu.blocks, hu.bytes / 1024.0,
+                hu.samples ? 8.0 * hu.bytes / hu.samples : 0.0, (unsigned long long) hu.evicted);
+        if (hsum.count > hsum.errors) {
+            fprintf(stderr, "History: %.3f to %.3f s, readings %d to %d, mean %.2f\n", hsum.t_first / 1e9,
+                    hsum.t_last / 1e9, hsum.min, hsum.max, (double) hsum.sum / (hsum.count - hsum.errors));
+        }
+        hs_del(history);
+    }
+    if (dists != NULL) {
+        dist_t *all = (dist_t *) malloc(sizeof(dist_t));
+        if (all != NULL) {
+            dist_clear(all);
+            dist_log_merge_range(dists, INT64_MIN, INT64_MAX, all);
+            fprintf(stderr, "Histograms: %zu intervals of %g s, %.1f KB\n", dist_log_intervals(dists), dist_s,
+                    dist_log_bytes(dists) / 1024.0);
+            if (all->total > 0) {
+                fprintf(stderr, "Histograms: median %.1f, mode %d, 1st to 99th percentile %.1f to %.1f, 10%% trimmed mean %.2f\n",
+                        dist_median(all), dist_mode(all), dist_percentile(all, 1.0), dist_percentile(all, 99.0),
+                        dist_trimmed(all, 0.1));
+            }
+            free(all);
+        }
+        dist_log_del(dists);
+    }
+    lat_report(stderr);
+    if (tune_sigma > 0.0) {
+        tune_stats_t tst;
+        tune_get_stats(&tuner, &tst);
+        fprintf(stderr, "Filter: window %zu, raw noise %.2f counts, filtered %.2f (target %.2f), %llu of %llu blocks steady, %llu changes\n",
+                tst.window, tst.noise, tst.output_sd, tune_sigma, (unsigned long long) tst.steady_blocks,
+                (unsigned long long) tst.blocks, (unsigned long long) tst.changes);
+    }
+    if (metrics_path != NULL) {
+        FILE *mf = (0 == strcmp(metrics_path, "-")) ? stderr : fopen(metrics_path, "w");
+        if (mf == NULL) {
+            diag_error("could not write %s", metrics_path);
+        } else {
+            metrics_dump(mf);
+            if (mf != stderr) {
+                fclose(mf);
+            }
+        }
+    }
+    diag_stats_t dst;
+    diag_get_stats(&dst);
+    if (dst.suppressed > 0 || dst.dropped > 0) {
+        fprintf(stderr, "Diagnostics: %llu logged, %llu suppressed, %llu dropped\n", (unsigned long long) dst.logged,
+                (unsigned long long) dst.suppressed, (unsigned long long) dst.dropped);
+    }
     fb_del(fb);
-    spi_shutdown(spi_fd);
+    if (replay != NULL) {
+        replay_close(replay);
+    } else if (mmio != NULL) {
+        spi_mmio_close(mmio);
+    } else if (broker != NULL) {
+        brk_disconnect(broker);
+    } else {
+        spi_shutdown(spi_fd);
+    }
+    diag_stop();
     return EXIT_SUCCESS;
 
 fail:
-    printf("Done with errors\n");
+    prof_stop(NULL);
+    diag_error("done with errors");
+    diag_stop();
     return EXIT_FAILURE;
 }
-
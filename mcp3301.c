@@ -0,0 +1,46 @@
+/**
+ * @file mcp3301.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of MCP3301 frame decoding
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mcp3301.h"
+#include "adc_model.h"
+
+int16_t mcp3301_decode(const uint8_t *raw_data) {
+    int16_t data = 0;
+    char sign = 0;
+
+    data |= ((raw_data[0] & 0x0F) << 8);
+    data |= raw_data[1];
+    sign = (raw_data[0] & 0x10) ? 1 : 0;
+    if (sign) {
+        data -= 4096;
+    }
+
+    return data;
+}
+
+int16_t mcp3301_decode_word(uint16_t word) {
+    // Shift the sign bit (bit 12) up to bit 15, then arithmetic-shift back
+    return (int16_t)(word << 3) >> 3;
+}
+
+void mcp3301_decode_frames(const uint8_t *restrict raw_data, int16_t *restrict out, size_t n) {
+    adc_mcp3301_decode_simd(raw_data, out, n);
+}
+
+void mcp3301_decode_words(const uint16_t *restrict words, int16_t *restrict out, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        out[i] = (int16_t)(words[i] << 3) >> 3;
+    }
+}
@@ -0,0 +1,72 @@
+/**
+ * @file mcp3301.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Decoding of MCP3301 output frames
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * The MCP3301 clocks out two null bits followed by a 13-bit two's
+ * complement reading (sign bit first), MSB first, in 16 clocks. The
+ * reading can be picked up from the bus in one of two ways:
+ *
+ * - as two 8-bit words, which arrive in bus order (byte mode)
+ * - as one 16-bit word, which spidev stores in CPU byte order (word mode)
+ *
+ * Either way the reading sits in the low 13 bits of the 16-bit frame,
+ * so word mode decodes with a single shift pair that sign-extends bit 12.
+ * The byte-mode bulk decoder is the vectorized one generated from the
+ * MCP3301's traits in adc_model.h; the word-mode one is a simple loop the
+ * compiler vectorizes by itself.
+ */
+
+#ifndef MCP3301_H
+#define MCP3301_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The value returned when a read fails
+ *
+ * @remarks 0x8001 is, according to the MCP3301 datasheet, not a valid
+ *          output for the device.
+ */
+#define MCP3301_READ_ERROR ((int16_t) 0x8001)
+
+/**
+ * @brief Decodes the two bytes of a single MCP3301 output frame (byte mode)
+ * 
+ * @param raw_data The two bytes read from the MCP3301
+ * @return int16_t The reading from the MCP3301
+ */
+int16_t mcp3301_decode(const uint8_t *raw_data);
+
+/**
+ * @brief Decodes a single MCP3301 output frame read as one 16-bit word (word mode)
+ *
+ * @param word The 16-bit word read from the MCP3301
+ * @return int16_t The reading from the MCP3301
+ */
+int16_t mcp3301_decode_word(uint16_t word);
+
+/**
+ * @brief Decodes an array of byte-mode frames
+ *
+ * @param raw_data The frames, two bytes each
+ * @param out The location to write the readings to
+ * @param n The number of frames
+ */
+void mcp3301_decode_frames(const uint8_t *raw_data, int16_t *out, size_t n);
+
+/**
+ * @brief Decodes an array of word-mode frames
+ *
+ * @param words The frames, one 16-bit word each
+ * @param out The location to write the readings to
+ * @param n The number of frames
+ */
+void mcp3301_decode_words(const uint16_t *words, int16_t *out, size_t n);
+
+#endif // MCP3301_H
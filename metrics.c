@@ -0,0 +1,152 @@
+/**
+ * @file metrics.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the sharded metrics registry
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <pthread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "diag.h"
+
+_Thread_local metrics_shard_t *metrics_tls_shard;
+
+// Every shard, plus the overflow shard at the end. Each is 8 KiB and
+// cache-line aligned, so no two threads ever write the same line.
+static metrics_shard_t shards[METRICS_MAX_SHARDS + 1];
+static atomic_int      shards_used;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static metric_t        registry[METRICS_MAX];
+static int             registry_len;
+static int             slots_used;
+
+metrics_shard_t *metrics_shard_init(void) {
+    int i = atomic_fetch_add(&shards_used, 1);
+    if (i >= METRICS_MAX_SHARDS) {
+        i = METRICS_MAX_SHARDS;
+        shards[i].shared = 1;
+    }
+    metrics_tls_shard = &shards[i];
+    return metrics_tls_shard;
+}
+
+static metric_t *metrics_register(const char *name, metric_kind_t kind, int slots) {
+    metric_t *m = NULL;
+    pthread_mutex_lock(&registry_lock);
+    if (registry_len < METRICS_MAX && slots_used + slots <= METRICS_SLOTS) {
+        m = &registry[registry_len++];
+        m->name = name;
+        m->kind = kind;
+        m->slot = slots_used;
+        slots_used += slots;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    if (m == NULL) {
+        diag_error("registry is full, not recording %s", name);
+    }
+    return m;
+}
+
+metric_t *metrics_counter(const char *name) {
+    return metrics_register(name, METRIC_COUNTER, 1);
+}
+
+metric_t *metrics_gauge(const char *name) {
+    return metrics_register(name, METRIC_GAUGE, 1);
+}
+
+metric_t *metrics_histogram(const char *name) {
+    return metrics_register(name, METRIC_HISTOGRAM, METRICS_HIST_BUCKETS + 1);
+}
+
+// The number of shards that may hold values
+static int shards_in_use(void) {
+    int n = atomic_load(&shards_used);
+    return n > METRICS_MAX_SHARDS ? METRICS_MAX_SHARDS + 1 : n;
+}
+
+static uint64_t slot_sum(int slot) {
+    uint64_t sum = 0;
+    int n = shards_in_use();
+    for(int i = 0; i < n; i++) {
+        sum += atomic_load_explicit(&shards[i].v[slot], memory_order_relaxed);
+    }
+    return sum;
+}
+
+void metric_set(metric_t *m, int64_t value) {
+    if (m == NULL) {
+        return;
+    }
+    metrics_shard_t *mine = metrics_shard();
+    uint64_t others = slot_sum(m->slot) - atomic_load_explicit(&mine->v[m->slot], memory_order_relaxed);
+    atomic_store_explicit(&mine->v[m->slot], (uint64_t) value - others, memory_order_relaxed);
+}
+
+int64_t metric_read(const metric_t *m) {
+    return (int64_t) slot_sum(m->slot);
+}
+
+void metric_read_hist(const metric_t *m, metrics_hist_t *h) {
+    h->count = 0;
+    for(int b = 0; b < METRICS_HIST_BUCKETS; b++) {
+        h->buckets[b] = slot_sum(m->slot + b);
+        h->count += h->buckets[b];
+    }
+    h->sum = slot_sum(m->slot + METRICS_HIST_BUCKETS);
+}
+
+double metrics_hist_quantile(const metrics_hist_t *h, double q) {
+    if (h->count == 0) {
+        return 0.0;
+    }
+    double rank = q * h->count;
+    uint64_t seen = 0;
+    for(int b = 0; b < METRICS_HIST_BUCKETS; b++) {
+        if (h->buckets[b] == 0) {
+            continue;
+        }
+        if (seen + h->buckets[b] >= rank) {
+            // Bucket b holds [2^(b-1), 2^b); bucket 0 holds only zero
+            if (b == 0) {
+                return 0.0;
+            }
+            double lo = (double)(1ULL << (b - 1));
+            return lo + lo * (rank - seen) / h->buckets[b];
+        }
+        seen += h->buckets[b];
+    }
+    return (double)(1ULL << (METRICS_HIST_BUCKETS - 1));
+}
+
+void metrics_dump(FILE *out) {
+    pthread_mutex_lock(&registry_lock);
+    int n = registry_len;
+    pthread_mutex_unlock(&registry_lock);
+
+    for(int i = 0; i < n; i++) {
+        const metric_t *m = &registry[i];
+        if (m->kind == METRIC_HISTOGRAM) {
+            metrics_hist_t h;
+            metric_read_hist(m, &h);
+            fprintf(out, "%s count=%llu mean=%.1f p50=%.0f p90=%.0f p99=%.0f\n", m->name,
+                    (unsigned long long) h.count, h.count ? (double) h.sum / h.count : 0.0,
+                    metrics_hist_quantile(&h, 0.5), metrics_hist_quantile(&h, 0.9), metrics_hist_quantile(&h, 0.99));
+        } else {
+            fprintf(out, "%s %lld\n", m->name, (long long) metric_read(m));
+        }
+    }
+}
@@ -0,0 +1,243 @@
+/**
+ * @file metrics.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Low-overhead counters, gauges and histograms, sharded per thread
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * With acquisition, processing, subscribers and capture on different
+ * threads, a shared counter bounces its cache line between cores on
+ * every increment. Here, every thread that records a metric gets its own
+ * shard: a cache-line-aligned block holding that thread's share of every
+ * metric. Only the owning thread writes a shard, so recording is a plain
+ * load and store, with no atomic read-modify-write and no sharing. The
+ * shards are only summed when a metric is read, which is the reporting
+ * path's cost rather than the sampler's.
+ *
+ * Metrics are registered once by name, at startup, and recorded through
+ * the returned handle:
+ *
+ *     static metric_t *m_samples;
+ *     m_samples = metrics_counter("samples_total");
+ *     ...
+ *     metric_inc(m_samples);
+ *
+ * - Counters only go up (metric_add).
+ * - Gauges go up and down (metric_add with a negative amount, or
+ *   metric_set). A gauge's value is the sum of every thread's share, so a
+ *   gauge that is set should be set from only one thread.
+ * - Histograms count values (e.g. latencies in nanoseconds) into
+ *   power-of-two buckets, and keep their sum for the mean.
+ *
+ * Beyond METRICS_MAX_SHARDS threads, the remaining threads share one
+ * overflow shard, updated atomically.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief Maximum number of metrics that can be registered
+ */
+#define METRICS_MAX 64
+
+/**
+ * @brief Number of 64-bit values in each shard (a histogram takes
+ *        METRICS_HIST_BUCKETS + 1 of them)
+ */
+#define METRICS_SLOTS 1024
+
+/**
+ * @brief Maximum number of threads with shards of their own
+ */
+#define METRICS_MAX_SHARDS 16
+
+/**
+ * @brief Number of histogram buckets; bucket i counts values with i
+ *        significant bits, i.e. in [2^(i-1), 2^i)
+ */
+#define METRICS_HIST_BUCKETS 64
+
+/**
+ * @brief The kinds of metric
+ */
+typedef enum metric_kind {
+    METRIC_COUNTER = 0,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+} metric_kind_t;
+
+/**
+ * @brief A registered metric
+ *
+ * @remarks Treat the members as private.
+ */
+typedef struct metric {
+    const char   *name;
+    metric_kind_t kind;
+    int           slot;    // The metric's first value in every shard
+} metric_t;
+
+/**
+ * @brief One thread's share of every metric
+ *
+ * @remarks Treat the members as private.
+ */
+typedef struct metrics_shard {
+    _Atomic uint64_t v[METRICS_SLOTS];
+    int              shared;  // Nonzero for the overflow shard
+} __attribute__((aligned(64))) metrics_shard_t;
+
+/**
+ * @brief A histogram's contents, summed over every thread
+ */
+typedef struct metrics_hist {
+    uint64_t buckets[METRICS_HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+} metrics_hist_t;
+
+/**
+ * @brief The calling thread's shard (NULL until it first records a metric)
+ */
+extern _Thread_local metrics_shard_t *metrics_tls_shard;
+
+/**
+ * @brief Assigns the calling thread a shard
+ *
+ * @return metrics_shard_t* The calling thread's shard
+ */
+metrics_shard_t *metrics_shard_init(void);
+
+/**
+ * @brief Registers a counter
+ *
+ * @param name The counter's name (e.g. "samples_total"); must outlive the registry
+ * @return metric_t* The counter, or NULL if the registry is full
+ */
+metric_t *metrics_counter(const char *name);
+
+/**
+ * @brief Registers a gauge
+ *
+ * @param name The gauge's name; must outlive the registry
+ * @return metric_t* The gauge, or NULL if the registry is full
+ */
+metric_t *metrics_gauge(const char *name);
+
+/**
+ * @brief Registers a histogram
+ *
+ * @param name The histogram's name; must outlive the registry
+ * @return metric_t* The histogram, or NULL if the registry is full
+ */
+metric_t *metrics_histogram(const char *name);
+
+static inline void metrics_slot_add(metrics_shard_t *s, int slot, uint64_t n) {
+    if (__builtin_expect(s->shared, 0)) {
+        atomic_fetch_add_explicit(&s->v[slot], n, memory_order_relaxed);
+    } else {
+        uint64_t v = atomic_load_explicit(&s->v[slot], memory_order_relaxed);
+        atomic_store_explicit(&s->v[slot], v + n, memory_order_relaxed);
+    }
+}
+
+static inline metrics_shard_t *metrics_shard(void) {
+    metrics_shard_t *s = metrics_tls_shard;
+    return __builtin_expect(s != NULL, 1) ? s : metrics_shard_init();
+}
+
+/**
+ * @brief Adds to a counter or gauge
+ *
+ * @remarks A NULL metric is ignored, so instrumentation can stay in place
+ *          when registration failed.
+ *
+ * @param m The counter or gauge
+ * @param n The amount to add (negative amounts wrap, which is correct for gauges)
+ */
+static inline void metric_add(metric_t *m, int64_t n) {
+    if (m != NULL) {
+        metrics_slot_add(metrics_shard(), m->slot, (uint64_t) n);
+    }
+}
+
+/**
+ * @brief Adds one to a counter or gauge
+ */
+static inline void metric_inc(metric_t *m) {
+    metric_add(m, 1);
+}
+
+/**
+ * @brief Counts a value into a histogram
+ *
+ * @param m The histogram
+ * @param value The value to count
+ */
+static inline void metric_observe(metric_t *m, uint64_t value) {
+    if (m != NULL) {
+        metrics_shard_t *s = metrics_shard();
+        int bucket = value ? 64 - __builtin_clzll(value) : 0;
+        metrics_slot_add(s, m->slot + (bucket < METRICS_HIST_BUCKETS ? bucket : METRICS_HIST_BUCKETS - 1), 1);
+        metrics_slot_add(s, m->slot + METRICS_HIST_BUCKETS, value);
+    }
+}
+
+/**
+ * @brief Sets a gauge
+ *
+ * @remarks Sets the calling thread's share to whatever makes the total
+ *          come to value, so the gauge reads back exactly the value set
+ *          as long as no other thread changes it at the same time.
+ *
+ * @param m The gauge
+ * @param value The gauge's new value
+ */
+void metric_set(metric_t *m, int64_t value);
+
+/**
+ * @brief Reads a counter or gauge, summed over every thread
+ *
+ * @param m The counter or gauge
+ * @return int64_t The metric's value
+ */
+int64_t metric_read(const metric_t *m);
+
+/**
+ * @brief Reads a histogram, summed over every thread
+ *
+ * @param m The histogram
+ * @param h The location to write the histogram's contents to
+ */
+void metric_read_hist(const metric_t *m, metrics_hist_t *h);
+
+/**
+ * @brief Estimates a quantile of a histogram
+ *
+ * @remarks Interpolates within the bucket the quantile falls in, so the
+ *          estimate is within a factor of two of the true value.
+ *
+ * @param h The histogram's contents
+ * @param q The quantile (0 to 1)
+ * @return double The estimated value at the quantile, or 0 if the histogram is empty
+ */
+double metrics_hist_quantile(const metrics_hist_t *h, double q);
+
+/**
+ * @brief Writes every registered metric to a file, one per line
+ *
+ * @remarks Counters and gauges are written as "name value"; histograms
+ *          as "name count=N mean=M p50=... p90=... p99=...".
+ *
+ * @param out The file to write to
+ */
+void metrics_dump(FILE *out);
+
+#endif // METRICS_H
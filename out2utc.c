@@ -0,0 +1,76 @@
+/**
+ * @file out2utc.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Converts the timestamps of a recorded reader output file to UTC
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * The reader writes "# anchor" comment lines into its output, pairing
+ * the run's monotonic time base with the wall clock. This program reads
+ * such a file twice: once to collect all of the anchors, and once to
+ * rewrite every data line with its first column replaced by an ISO 8601
+ * UTC timestamp. Because all anchors are known up front, every sample is
+ * interpolated between the anchors on either side of it, which removes
+ * the drift between the two clocks.
+ *
+ * Usage:
+ *
+ *     ./out2utc out.txt > out_utc.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "timebase.h"
+#include "diag.h"
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        printf("Usage: %s <reader output file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *f = fopen(argv[1], "r");
+    if (f == NULL) {
+        diag_error("could not open %s", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    timebase_t tb;
+    tb_init(&tb);
+
+    char line[256];
+    tb_anchor_t a;
+    while (NULL != fgets(line, sizeof(line), f)) {
+        if (2 == sscanf(line, "# anchor\t%" SCNd64 "\t%" SCNd64, &a.mono_ns, &a.real_ns)) {
+            tb_add_anchor(&tb, &a);
+        }
+    }
+    if (tb.count == 0) {
+        diag_error("%s contains no anchors", argv[1]);
+        fclose(f);
+        return EXIT_FAILURE;
+    }
+
+    rewind(f);
+    char stamp[40];
+    while (NULL != fgets(line, sizeof(line), f)) {
+        double t;
+        int n = 0;
+        if (line[0] == '#' || 1 != sscanf(line, "%lf%n", &t, &n)) {
+            continue;
+        }
+        tb_format_utc(tb_mono_to_utc_ns(&tb, (int64_t)(t * 1e9)), stamp, sizeof(stamp));
+        fputs(stamp, stdout);
+        fputs(line + n, stdout);
+    }
+
+    tb_free(&tb);
+    fclose(f);
+    return EXIT_SUCCESS;
+}
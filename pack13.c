@@ -0,0 +1,194 @@
+/**
+ * @file pack13.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the bit-packed 13-bit arrays
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "pack13.h"
+#include "mcp3301.h"
+
+// Eight 16-bit lanes; NEON or SSE2 depending on the target
+typedef uint16_t p13_v8u16 __attribute__((vector_size(16)));
+typedef int16_t  p13_v8i16 __attribute__((vector_size(16)));
+
+// The 13-bit code standing for a read error
+#define P13_ERROR_CODE (-4096)
+
+////////////////////////////////////////////////////////
+/// Tile kernels
+
+// Maps eight readings to their 13-bit codes
+static inline p13_v8u16 p13_encode(p13_v8i16 v) {
+    p13_v8i16 err = (v == MCP3301_READ_ERROR);
+    p13_v8i16 lo = (v < P13_ERROR_CODE + 1);
+    v = (v & ~lo) | ((P13_ERROR_CODE + 1) & lo);
+    p13_v8i16 hi = (v > 4095);
+    v = (v & ~hi) | (4095 & hi);
+    v = (v & ~err) | (P13_ERROR_CODE & err);
+    return (p13_v8u16) v & 0x1FFF;
+}
+
+// Maps eight 13-bit codes back to readings
+static inline p13_v8i16 p13_decode(p13_v8u16 x) {
+    p13_v8i16 v = (p13_v8i16)(x << 3) >> 3;
+    p13_v8i16 err = (v == P13_ERROR_CODE);
+    return (v & ~err) | (MCP3301_READ_ERROR & err);
+}
+
+// With the loops unrolled, every shift and offset below is a constant
+static inline __attribute__((always_inline)) void p13_pack_tile(const int16_t *in, uint8_t *out) {
+    p13_v8u16 acc = { 0 };
+    int filled = 0;
+    int o = 0;
+#pragma GCC unroll 16
+    for(int j = 0; j < P13_TILE / 8; j++) {
+        p13_v8i16 v;
+        memcpy(&v, in + 8 * j, sizeof(v));
+        p13_v8u16 x = p13_encode(v);
+        acc |= x << filled;
+        if (filled + 13 >= 16) {
+            memcpy(out + sizeof(acc) * o++, &acc, sizeof(acc));
+            acc = x >> (16 - filled);
+            filled -= 3;
+        } else {
+            filled += 13;
+        }
+    }
+}
+
+static inline __attribute__((always_inline)) void p13_unpack_tile(const uint8_t *in, int16_t *out) {
+#pragma GCC unroll 16
+    for(int j = 0; j < P13_TILE / 8; j++) {
+        int w = 13 * j / 16, off = 13 * j % 16;
+        p13_v8u16 a, b;
+        memcpy(&a, in + sizeof(a) * w, sizeof(a));
+        p13_v8u16 x = a >> off;
+        if (off > 3) {
+            memcpy(&b, in + sizeof(b) * (w + 1), sizeof(b));
+            x |= b << (16 - off);
+        }
+        p13_v8i16 v = p13_decode(x);
+        memcpy(out + 8 * j, &v, sizeof(v));
+    }
+}
+
+void p13_pack(const int16_t *in, size_t tiles, uint8_t *out) {
+    for(size_t t = 0; t < tiles; t++) {
+        p13_pack_tile(in + t * P13_TILE, out + t * P13_TILE_BYTES);
+    }
+}
+
+void p13_unpack(const uint8_t *in, size_t tiles, int16_t *out) {
+    for(size_t t = 0; t < tiles; t++) {
+        p13_unpack_tile(in + t * P13_TILE_BYTES, out + t * P13_TILE);
+    }
+}
+
+int16_t p13_read(const uint8_t *in, size_t i) {
+    const uint8_t *tile = in + i / P13_TILE * P13_TILE_BYTES;
+    size_t j = i % P13_TILE / 8, lane = i % 8;
+    size_t w = 13 * j / 16, off = 13 * j % 16;
+    uint16_t a, b;
+    memcpy(&a, tile + 16 * w + 2 * lane, sizeof(a));
+    uint16_t x = (uint16_t)(a >> off);
+    if (off > 3) {
+        memcpy(&b, tile + 16 * (w + 1) + 2 * lane, sizeof(b));
+        x |= (uint16_t)(b << (16 - off));
+    }
+    int16_t v = (int16_t)(uint16_t)(x << 3) >> 3;
+    return (v == P13_ERROR_CODE) ? MCP3301_READ_ERROR : v;
+}
+
+////////////////////////////////////////////////////////
+/// Arrays
+
+struct p13_array {
+    uint8_t *data;
+    size_t   len;
+    size_t   cap;               // Tiles allocated
+};
+
+p13_array_t *p13_new(void) {
+    return (p13_array_t *) calloc(1, sizeof(p13_array_t));
+}
+
+void p13_del(p13_array_t *a) {
+    free(a->data);
+    free(a);
+}
+
+int p13_append(p13_array_t *a, const int16_t *vals, size_t n) {
+    size_t need = (a->len + n + P13_TILE - 1) / P13_TILE;
+    if (need > a->cap) {
+        size_t cap = a->cap ? 2 * a->cap : 64;
+        cap = cap < need ? need : cap;
+        uint8_t *data = (uint8_t *) realloc(a->data, cap * P13_TILE_BYTES);
+        if (data == NULL) {
+            return -1;
+        }
+        a->data = data;
+        a->cap = cap;
+    }
+
+    // Top up a partial last tile, then pack whole tiles straight from the
+    // input, then start a partial tile with what's left (zero-padded)
+    int16_t tile[P13_TILE];
+    size_t used = a->len % P13_TILE;
+    if (used > 0) {
+        uint8_t *last = a->data + a->len / P13_TILE * P13_TILE_BYTES;
+        size_t k = (n < P13_TILE - used) ? n : P13_TILE - used;
+        p13_unpack_tile(last, tile);
+        memcpy(tile + used, vals, k * sizeof(int16_t));
+        p13_pack_tile(tile, last);
+        a->len += k;
+        vals += k;
+        n -= k;
+    }
+    size_t whole = n / P13_TILE;
+    p13_pack(vals, whole, a->data + a->len / P13_TILE * P13_TILE_BYTES);
+    a->len += whole * P13_TILE;
+    vals += whole * P13_TILE;
+    n -= whole * P13_TILE;
+    if (n > 0) {
+        memset(tile, 0, sizeof(tile));
+        memcpy(tile, vals, n * sizeof(int16_t));
+        p13_pack_tile(tile, a->data + a->len / P13_TILE * P13_TILE_BYTES);
+        a->len += n;
+    }
+    return 0;
+}
+
+size_t p13_len(const p13_array_t *a) {
+    return a->len;
+}
+
+size_t p13_bytes(const p13_array_t *a) {
+    return p13_tiles(a) * P13_TILE_BYTES;
+}
+
+int16_t p13_get(const p13_array_t *a, size_t i) {
+    assert(i < a->len);
+    return p13_read(a->data, i);
+}
+
+size_t p13_tiles(const p13_array_t *a) {
+    return (a->len + P13_TILE - 1) / P13_TILE;
+}
+
+size_t p13_tile(const p13_array_t *a, size_t i, int16_t *tile) {
+    assert(i < p13_tiles(a));
+    p13_unpack_tile(a->data + i * P13_TILE_BYTES, tile);
+    size_t left = a->len - i * P13_TILE;
+    return left < P13_TILE ? left : P13_TILE;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file pack13.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Bit-packed arrays of 13-bit readings
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * An MCP3301 reading fits in 13 bits, but an int16_t spends 16 on it. A
+ * packed array stores readings at 13 bits each, in tiles of P13_TILE
+ * readings (P13_TILE_BYTES bytes, 81% of the int16_t size).
+ *
+ * Within a tile the readings are laid out for SIMD: reading k sits in
+ * lane k % 8 of eight 16-bit lanes, and each lane's 16 readings are
+ * packed one after another into thirteen 16-bit words, least significant
+ * bit first. Every reading in a row of eight then has the same bit
+ * offset, so packing and unpacking a tile is a fixed sequence of vector
+ * shifts and ORs (NEON or SSE2, through GCC's vector extensions), running
+ * close to the speed of a memcpy once built with -O2, which unrolls them
+ * (without it they run some 20 times slower). Words are in host byte
+ * order.
+ *
+ * The 13-bit code -4096 stands for MCP3301_READ_ERROR. A genuine reading
+ * of -4096 (the input railed negative) is stored as -4095, and readings
+ * outside the 13-bit range are clamped.
+ *
+ * For statistics over a large array, unpack it a tile at a time into a
+ * buffer which stays in L1 (see p13_tile()), rather than all at once.
+ */
+
+#ifndef PACK13_H
+#define PACK13_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Readings in a tile
+ */
+#define P13_TILE 128
+
+/**
+ * @brief Bytes in a packed tile
+ */
+#define P13_TILE_BYTES (P13_TILE * 13 / 8)
+
+/**
+ * @brief Packs whole tiles
+ *
+ * @param in The readings (tiles * P13_TILE of them)
+ * @param tiles The number of tiles
+ * @param out The location to write the tiles to (tiles * P13_TILE_BYTES bytes)
+ */
+void p13_pack(const int16_t *in, size_t tiles, uint8_t *out);
+
+/**
+ * @brief Unpacks whole tiles
+ *
+ * @param in The packed tiles
+ * @param tiles The number of tiles
+ * @param out The location to write the readings to (tiles * P13_TILE of them)
+ */
+void p13_unpack(const uint8_t *in, size_t tiles, int16_t *out);
+
+/**
+ * @brief Reads one reading from packed tiles
+ *
+ * @param in The packed tiles
+ * @param i The reading's index, which must lie within them (nothing
+ *          checks)
+ * @return int16_t The reading
+ */
+int16_t p13_read(const uint8_t *in, size_t i);
+
+typedef struct p13_array p13_array_t;
+
+/**
+ * @brief Creates an empty packed array
+ *
+ * @return p13_array_t* The array, or NULL on failure
+ */
+p13_array_t *p13_new(void);
+
+/**
+ * @brief Frees a packed array
+ *
+ * @param a The array to free
+ */
+void p13_del(p13_array_t *a);
+
+/**
+ * @brief Appends readings to an array
+ *
+ * @param a The array
+ * @param vals The readings
+ * @param n The number of readings
+ * @return int 0 on success, nonzero if memory ran out (nothing is appended)
+ */
+int p13_append(p13_array_t *a, const int16_t *vals, size_t n);
+
+/**
+ * @brief The number of readings in an array
+ */
+size_t p13_len(const p13_array_t *a);
+
+/**
+ * @brief The bytes an array's packed tiles take
+ */
+size_t p13_bytes(const p13_array_t *a);
+
+/**
+ * @brief Reads one reading from an array
+ *
+ * @remarks An empty array has no tiles to read from, so i must be less
+ *          than p13_len() (asserted).
+ *
+ * @param a The array
+ * @param i The reading's index, less than p13_len()
+ * @return int16_t The reading
+ */
+int16_t p13_get(const p13_array_t *a, size_t i);
+
+/**
+ * @brief The number of tiles in an array, the last possibly partial
+ */
+size_t p13_tiles(const p13_array_t *a);
+
+/**
+ * @brief Unpacks one tile of an array
+ *
+ * @param a The array
+ * @param i The tile's index, less than p13_tiles() (asserted)
+ * @param tile The location to write the readings to (P13_TILE of them)
+ * @return size_t The number of readings in the tile
+ */
+size_t p13_tile(const p13_array_t *a, size_t i, int16_t *tile);
+
+#endif // PACK13_H
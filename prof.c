@@ -0,0 +1,422 @@
+/**
+ * @file prof.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the SIGPROF sampling profiler
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ *
+ * Everything the signal handler touches is preallocated: it claims a ring
+ * entry with a compare-and-swap, copies the stack into it and publishes
+ * it, exactly as diag_log() does. Counting and naming stacks, which need
+ * memory and dladdr(), only ever happen on the drain thread.
+ */
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "prof.h"
+#include "diag.h"
+
+// Largest distance between a frame and its caller's that the walk
+// accepts; anything further is taken to be a bad frame pointer
+#define PROF_MAX_FRAME (128 * 1024)
+
+// Smallest page size; memory is known to be readable a page at a time
+#define PROF_PAGE ((uintptr_t) 4096)
+
+// Every frame holds its caller's frame pointer followed by its return
+// address. GCC's ARM frames point at the return address; everywhere else
+// the frame pointer points at the caller's.
+#if defined(__arm__)
+#define PROF_FRAME_OFFSET (-(intptr_t) sizeof(uintptr_t))
+#else
+#define PROF_FRAME_OFFSET 0
+#endif
+
+/**
+ * @brief One sampled stack in the ring
+ */
+typedef struct prof_entry {
+    atomic_size_t seq;
+    int           depth;
+    uintptr_t     pcs[PROF_DEPTH];  // Innermost frame first
+} prof_entry_t;
+
+/**
+ * @brief One distinct stack and the number of times it was sampled
+ */
+typedef struct prof_stack {
+    uint64_t  count;
+    uint32_t  hash;
+    int       depth;                // 0 for an unused entry
+    uintptr_t pcs[PROF_DEPTH];
+} prof_stack_t;
+
+static prof_entry_t     ring[PROF_RING_LEN];
+static atomic_size_t    enqueue_pos;
+static size_t           dequeue_pos;
+static atomic_ullong    total_dropped;
+
+// Only touched by the drain thread (and by prof_stop() once it has ended).
+// The entry after the last is the "[other]" stack.
+static prof_stack_t    *stacks;
+static uint64_t         stacks_used;
+static uint64_t         total_samples;
+
+static atomic_int       prof_running;
+static atomic_int       dump_requested;
+static sem_t            prof_wake;
+static pthread_t        prof_thread;
+static const char      *prof_path;
+static pid_t            prof_pid;
+static struct sigaction old_usr2;
+
+// Reads the interrupted pc, stack pointer and frame pointer out of a
+// signal context
+static void context_regs(const ucontext_t *uc, uintptr_t *pc, uintptr_t *sp, uintptr_t *fp) {
+#if defined(__x86_64__)
+    *pc = (uintptr_t) uc->uc_mcontext.gregs[REG_RIP];
+    *sp = (uintptr_t) uc->uc_mcontext.gregs[REG_RSP];
+    *fp = (uintptr_t) uc->uc_mcontext.gregs[REG_RBP];
+#elif defined(__i386__)
+    *pc = (uintptr_t) uc->uc_mcontext.gregs[REG_EIP];
+    *sp = (uintptr_t) uc->uc_mcontext.gregs[REG_ESP];
+    *fp = (uintptr_t) uc->uc_mcontext.gregs[REG_EBP];
+#elif defined(__aarch64__)
+    *pc = (uintptr_t) uc->uc_mcontext.pc;
+    *sp = (uintptr_t) uc->uc_mcontext.sp;
+    *fp = (uintptr_t) uc->uc_mcontext.regs[29];
+#elif defined(__arm__)
+    *pc = (uintptr_t) uc->uc_mcontext.arm_pc;
+    *sp = (uintptr_t) uc->uc_mcontext.arm_sp;
+    *fp = (uintptr_t) uc->uc_mcontext.arm_fp;
+#else
+    (void) uc;
+    *pc = 0;
+    *sp = 0;
+    *fp = 0;
+#endif
+}
+
+// Reads a frame's caller frame pointer and return address without ever
+// faulting. Frames on the page last found readable are read directly;
+// otherwise the kernel copies them, and fails rather than faults if they
+// aren't mapped (e.g. past the top of a thread's stack).
+static int read_frame(uintptr_t fp, uintptr_t *next, uintptr_t *ret, uintptr_t *ok_page) {
+    uintptr_t words[2];
+    uintptr_t lo = fp + PROF_FRAME_OFFSET;
+    uintptr_t hi = lo + sizeof(words) - 1;
+    if ((lo & ~(PROF_PAGE - 1)) == *ok_page && (hi & ~(PROF_PAGE - 1)) == *ok_page) {
+        memcpy(words, (const void *) lo, sizeof(words));
+    } else {
+        struct iovec local = { words, sizeof(words) };
+        struct iovec remote = { (void *) lo, sizeof(words) };
+        if ((ssize_t) sizeof(words) != process_vm_readv(prof_pid, &local, 1, &remote, 1, 0)) {
+            return -1;
+        }
+        *ok_page = hi & ~(PROF_PAGE - 1);
+    }
+    *next = words[0];
+    *ret = words[1];
+    return 0;
+}
+
+// Walks the frame pointer chain up from the interrupted frame. The chain
+// must start just above the stack pointer and run strictly up the stack in
+// frame-sized steps, so a frame pointer that was reused as a general
+// register ends the walk instead of sending it off into arbitrary memory.
+static int walk(uintptr_t pc, uintptr_t sp, uintptr_t fp, uintptr_t *pcs) {
+    int depth = 0;
+    if (pc != 0) {
+        pcs[depth++] = pc;
+    }
+    // The interrupted stack pointer's page is mapped: the handler is running on it
+    uintptr_t ok_page = sp & ~(PROF_PAGE - 1);
+    if (fp < sp || fp - sp > PROF_MAX_FRAME) {
+        return depth;
+    }
+    while (depth < PROF_DEPTH && (fp & (sizeof(uintptr_t) - 1)) == 0) {
+        uintptr_t next, ret;
+        if (0 != read_frame(fp, &next, &ret, &ok_page) || ret == 0) {
+            break;
+        }
+        pcs[depth++] = ret;
+        if (next <= fp || next - fp > PROF_MAX_FRAME) {
+            break;
+        }
+        fp = next;
+    }
+    return depth;
+}
+
+static void prof_handler(int sig, siginfo_t *si, void *ctx) {
+    (void) sig;
+    (void) si;
+    int saved_errno = errno;
+
+    // Claim an entry, or give up if the ring is full
+    size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    prof_entry_t *e;
+    for (;;) {
+        e = &ring[pos & (PROF_RING_LEN - 1)];
+        size_t seq = atomic_load_explicit(&e->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&total_dropped, 1, memory_order_relaxed);
+            errno = saved_errno;
+            return;
+        } else {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    uintptr_t pc, sp, fp;
+    context_regs((const ucontext_t *) ctx, &pc, &sp, &fp);
+    e->depth = walk(pc, sp, fp, e->pcs);
+    atomic_store_explicit(&e->seq, pos + 1, memory_order_release);
+    errno = saved_errno;
+}
+
+static void dump_handler(int sig) {
+    (void) sig;
+    atomic_store(&dump_requested, 1);
+    sem_post(&prof_wake);
+}
+
+static uint32_t stack_hash(const uintptr_t *pcs, int depth) {
+    uint32_t h = 2166136261u;
+    for(int i = 0; i < depth; i++) {
+        h = (h ^ (uint32_t) pcs[i]) * 16777619u;
+        h = (h ^ (uint32_t)((uint64_t) pcs[i] >> 32)) * 16777619u;
+    }
+    return h;
+}
+
+// Counts one sample of a stack. The table is kept at most three quarters
+// full so that probes stay short; later stacks go to "[other]".
+static void count_stack(const uintptr_t *pcs, int depth) {
+    total_samples++;
+    if (depth > 0) {
+        uint32_t h = stack_hash(pcs, depth);
+        for(uint32_t i = 0; i < PROF_STACKS; i++) {
+            prof_stack_t *s = &stacks[(h + i) & (PROF_STACKS - 1)];
+            if (s->depth == 0) {
+                if (stacks_used >= PROF_STACKS / 4 * 3) {
+                    break;
+                }
+                s->hash = h;
+                s->depth = depth;
+                memcpy(s->pcs, pcs, depth * sizeof(uintptr_t));
+                s->count = 1;
+                stacks_used++;
+                return;
+            }
+            if (s->hash == h && s->depth == depth && 0 == memcmp(s->pcs, pcs, depth * sizeof(uintptr_t))) {
+                s->count++;
+                return;
+            }
+        }
+    }
+    stacks[PROF_STACKS].count++;
+}
+
+// Maps a frame's address to the start of its function, so that samples
+// anywhere in the same functions count as the same stack. Return addresses
+// point after the call, which may be the first instruction of the next
+// function, so they are looked up one byte earlier. Addresses without a
+// symbol are kept as they are; return addresses outside every loaded
+// module are stale stack contents, not frames, and map to 0.
+static uintptr_t frame_key(uintptr_t pc, int is_return) {
+    uintptr_t addr = is_return ? pc - 1 : pc;
+    Dl_info info;
+    if (0 == dladdr((void *) addr, &info)) {
+        return is_return ? 0 : addr;
+    }
+    return (info.dli_saddr != NULL) ? (uintptr_t) info.dli_saddr : addr;
+}
+
+// Counts every published sample
+static void drain(void) {
+    for (;;) {
+        prof_entry_t *e = &ring[dequeue_pos & (PROF_RING_LEN - 1)];
+        if (atomic_load_explicit(&e->seq, memory_order_acquire) != dequeue_pos + 1) {
+            break;
+        }
+        for(int k = 0; k < e->depth; k++) {
+            if (0 == (e->pcs[k] = frame_key(e->pcs[k], k > 0))) {
+                e->depth = k;
+                break;
+            }
+        }
+        count_stack(e->pcs, e->depth);
+        atomic_store_explicit(&e->seq, dequeue_pos + PROF_RING_LEN, memory_order_release);
+        dequeue_pos++;
+    }
+}
+
+// Names a frame (as mapped by frame_key())
+static void write_frame(FILE *out, uintptr_t addr) {
+    Dl_info info;
+    if (0 == dladdr((void *) addr, &info)) {
+        fprintf(out, "0x%lx", (unsigned long) addr);
+    } else if (info.dli_sname != NULL) {
+        fputs(info.dli_sname, out);
+    } else {
+        const char *base = strrchr(info.dli_fname, '/');
+        fprintf(out, "%s+0x%lx", base != NULL ? base + 1 : info.dli_fname,
+                (unsigned long)(addr - (uintptr_t) info.dli_fbase));
+    }
+}
+
+// Writes the stacks counted so far, outermost frame first
+static int write_profile(void) {
+    FILE *out = fopen(prof_path, "w");
+    if (out == NULL) {
+        diag_error("could not write %s", prof_path);
+        return -1;
+    }
+    for(int i = 0; i < PROF_STACKS; i++) {
+        const prof_stack_t *s = &stacks[i];
+        if (s->depth == 0) {
+            continue;
+        }
+        for(int k = s->depth - 1; k >= 0; k--) {
+            write_frame(out, s->pcs[k]);
+            fputc(k > 0 ? ';' : ' ', out);
+        }
+        fprintf(out, "%llu\n", (unsigned long long) s->count);
+    }
+    if (stacks[PROF_STACKS].count > 0) {
+        fprintf(out, "[other] %llu\n", (unsigned long long) stacks[PROF_STACKS].count);
+    }
+    return (0 == fclose(out)) ? 0 : -1;
+}
+
+static void *prof_main(void *arg) {
+    (void) arg;
+    while (atomic_load(&prof_running)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += PROF_DRAIN_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        sem_timedwait(&prof_wake, &ts);
+        drain();
+        if (atomic_exchange(&dump_requested, 0)) {
+            write_profile();
+        }
+    }
+    return NULL;
+}
+
+static void set_timer(int hz) {
+    struct itimerval it;
+    memset(&it, 0, sizeof(it));
+    if (hz > 0) {
+        it.it_interval.tv_sec = (hz == 1) ? 1 : 0;
+        it.it_interval.tv_usec = (hz == 1) ? 0 : 1000000 / hz;
+        it.it_value = it.it_interval;
+    }
+    setitimer(ITIMER_PROF, &it, NULL);
+}
+
+int prof_start(int hz, const char *path) {
+    if (atomic_load(&prof_running)) {
+        return -1;
+    }
+    if (hz < 1 || hz > PROF_MAX_HZ) {
+        diag_error("sampling rate must be 1 to %d Hz", PROF_MAX_HZ);
+        return -1;
+    }
+    if (NULL == (stacks = calloc(PROF_STACKS + 1, sizeof(prof_stack_t)))) {
+        diag_error("out of memory");
+        return -1;
+    }
+    stacks_used = 0;
+    total_samples = 0;
+    prof_path = path;
+    prof_pid = getpid();
+    for(size_t i = 0; i < PROF_RING_LEN; i++) {
+        atomic_store_explicit(&ring[i].seq, i, memory_order_relaxed);
+    }
+    atomic_store(&enqueue_pos, 0);
+    atomic_store(&total_dropped, 0);
+    atomic_store(&dump_requested, 0);
+    dequeue_pos = 0;
+    sem_init(&prof_wake, 0, 0);
+
+    atomic_store(&prof_running, 1);
+    if (0 != pthread_create(&prof_thread, NULL, prof_main, NULL)) {
+        atomic_store(&prof_running, 0);
+        sem_destroy(&prof_wake);
+        free(stacks);
+        diag_error("could not start the profiler thread");
+        return -1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = dump_handler;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &sa, &old_usr2);
+    sa.sa_handler = NULL;
+    sa.sa_sigaction = prof_handler;
+    sa.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigaction(SIGPROF, &sa, NULL);
+    set_timer(hz);
+    return 0;
+}
+
+int prof_stop(prof_stats_t *stats) {
+    if (!atomic_load(&prof_running)) {
+        return 0;
+    }
+    // A SIGPROF still pending would kill the process under the default
+    // action, so it is ignored rather than restored
+    set_timer(0);
+    signal(SIGPROF, SIG_IGN);
+    sigaction(SIGUSR2, &old_usr2, NULL);
+
+    atomic_store(&prof_running, 0);
+    sem_post(&prof_wake);
+    pthread_join(prof_thread, NULL);
+    drain();
+    int ret = write_profile();
+
+    if (stats != NULL) {
+        stats->samples = total_samples;
+        stats->dropped = atomic_load(&total_dropped);
+        stats->stacks = stacks_used;
+    }
+    sem_destroy(&prof_wake);
+    free(stacks);
+    stacks = NULL;
+    return ret;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file prof.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Built-in sampling profiler writing folded stacks for flame graphs
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * Attaching perf or gdb to a reader out in the field is awkward, so the
+ * reader can profile itself. While running, ITIMER_PROF raises SIGPROF
+ * every 1/hz seconds of CPU time the process uses, in whichever thread is
+ * running. The handler walks that thread's frame pointers and copies the
+ * return addresses into a lock-free ring (the same scheme as diag.c's), so
+ * it never takes a lock or allocates. A background thread drains the ring
+ * every PROF_DRAIN_MS and counts identical stacks.
+ *
+ * The profile is written on prof_stop(), and also whenever the process
+ * gets SIGUSR2, in the "folded" format used by flamegraph.pl and
+ * speedscope: one line per distinct stack, outermost frame first, frames
+ * separated by semicolons, then the number of samples:
+ *
+ *     main;read_mcp3301_frame;spi_read_two_bytes;ioctl 812
+ *
+ * Frames are named with dladdr(), which only sees exported symbols, so
+ * the reader's own functions only have names if it is linked with
+ * -rdynamic, and static functions never do; those frames are written as
+ * module+offset, for addr2line. Stack walking relies on frame pointers, so
+ * build with -fno-omit-frame-pointer; a walk ends early at code built
+ * without them (e.g. most of libc), and the stack is then truncated there.
+ *
+ * The cost grows with the rate: each sample costs a signal delivery and a
+ * walk of up to PROF_DEPTH frames, a few microseconds on a Pi, so 100 Hz
+ * costs well under 0.1% of a core. The kernel only checks CPU-time timers
+ * on its scheduler tick, so rates above its CONFIG_HZ (100 to 250 on most
+ * Pi kernels) give no more samples than that.
+ */
+
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+
+/**
+ * @brief Deepest stack recorded, in frames
+ */
+#define PROF_DEPTH 32
+
+/**
+ * @brief Number of samples the ring can hold between drains (a power of two)
+ */
+#define PROF_RING_LEN 1024
+
+/**
+ * @brief Number of distinct stacks counted; samples of any further stacks
+ *        are counted under a single "[other]" stack
+ */
+#define PROF_STACKS 4096
+
+/**
+ * @brief How often the ring is drained, in milliseconds
+ */
+#define PROF_DRAIN_MS 50
+
+/**
+ * @brief Highest sampling rate allowed, in samples per second of CPU time
+ */
+#define PROF_MAX_HZ 10000
+
+/**
+ * @brief Totals for a profiling run
+ */
+typedef struct prof_stats {
+    uint64_t samples;            // Samples counted into the profile
+    uint64_t dropped;            // Samples lost because the ring was full
+    uint64_t stacks;             // Distinct stacks in the profile
+} prof_stats_t;
+
+/**
+ * @brief Starts profiling the process
+ *
+ * @param hz The sampling rate, in samples per second of CPU time (1 to PROF_MAX_HZ)
+ * @param path The file to write the folded stacks to (replaced on every write)
+ * @return int 0 on success, nonzero otherwise
+ */
+int prof_start(int hz, const char *path);
+
+/**
+ * @brief Stops profiling and writes the profile
+ *
+ * @remarks Does nothing if the profiler isn't running.
+ *
+ * @param stats The location to write the run's totals to, or NULL
+ * @return int 0 on success, nonzero if the profile couldn't be written
+ */
+int prof_stop(prof_stats_t *stats);
+
+#endif // PROF_H
@@ -0,0 +1,161 @@
+/**
+ * @file replay.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the replay backend
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include <assert.h>
+
+#include "replay.h"
+#include "diag.h"
+
+replay_t *replay_open(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        diag_error("could not open %s", path);
+        return NULL;
+    }
+    replay_t *r = (replay_t *) calloc(1, sizeof(replay_t));
+    if (r == NULL) {
+        diag_error("out of memory");
+        fclose(f);
+        return NULL;
+    }
+    r->file = f;
+    r->line_no = 0;
+
+    // Raw frame captures and RLE files start with a binary header; text
+    // files never start with either magic number
+    int has_header = (1 == fread(&r->header, sizeof(r->header), 1, f));
+    if (has_header && r->header.magic == CAP_MAGIC) {
+        if (r->header.version != CAP_VERSION || r->header.frame_len < 1 || r->header.frame_len > CAP_FRAME_MAX) {
+            diag_error("%s is an unsupported capture", path);
+            fclose(f);
+            free(r);
+            return NULL;
+        }
+        r->is_capture = 1;
+    } else if (has_header && r->header.magic == RLE_MAGIC) {
+        rewind(f);
+        if (1 != fread(&r->rle_header, sizeof(r->rle_header), 1, f) || r->rle_header.version < 1 ||
+            r->rle_header.version > RLE_VERSION) {
+            diag_error("%s is an unsupported RLE file", path);
+            fclose(f);
+            free(r);
+            return NULL;
+        }
+        r->is_rle = 1;
+        rle_reader_init(&r->rle, f);
+    } else {
+        rewind(f);
+    }
+    return r;
+}
+
+const cap_file_header_t *replay_capture_header(const replay_t *r) {
+    return r->is_capture ? &r->header : NULL;
+}
+
+void replay_close(replay_t *r) {
+    fclose(r->file);
+    free(r);
+}
+
+static replay_kind_t capture_next(replay_t *r, replay_record_t *rec) {
+    int tag;
+    uint32_t dt;
+    int8_t status;
+
+    while (EOF != (tag = fgetc(r->file))) {
+        if (tag == CAP_TAG_FRAME) {
+            if (1 != fread(&dt, sizeof(dt), 1, r->file) || 1 != fread(&status, 1, 1, r->file) ||
+                1 != fread(rec->frame, r->header.frame_len, 1, r->file)) {
+                break;
+            }
+            r->t_ns += dt;
+            rec->kind = REPLAY_FRAME;
+            rec->t_ns = r->t_ns;
+            rec->status = status;
+            return rec->kind;
+        }
+        if (tag == CAP_TAG_TIME) {
+            if (1 != fread(&r->t_ns, sizeof(r->t_ns), 1, r->file)) {
+                break;
+            }
+            continue;
+        }
+        if (tag == CAP_TAG_ANCHOR) {
+            if (1 != fread(&rec->anchor.mono_ns, sizeof(int64_t), 1, r->file) ||
+                1 != fread(&rec->anchor.real_ns, sizeof(int64_t), 1, r->file)) {
+                break;
+            }
+            rec->kind = REPLAY_ANCHOR;
+            return rec->kind;
+        }
+        diag_error("corrupt capture record (tag 0x%02x)", tag);
+        break;
+    }
+    rec->kind = REPLAY_EOF;
+    return rec->kind;
+}
+
+static replay_kind_t rle_next(replay_t *r, replay_record_t *rec) {
+    switch (rle_read_sample(&r->rle, &rec->t_ns, &rec->int_val)) {
+    case RLE_SAMPLE:
+        rec->kind = REPLAY_SAMPLE;
+        break;
+    case RLE_ANCHOR:
+        rec->anchor = r->rle.rec.anchor;
+        rec->kind = REPLAY_ANCHOR;
+        break;
+    default:
+        rec->kind = REPLAY_EOF;
+        break;
+    }
+    return rec->kind;
+}
+
+replay_kind_t replay_next(replay_t *r, replay_record_t *rec) {
+    assert(rec != NULL);
+    if (r->is_capture) {
+        return capture_next(r, rec);
+    }
+    if (r->is_rle) {
+        return rle_next(r, rec);
+    }
+    char line[256];
+    double t;
+    int val;
+
+    while (NULL != fgets(line, sizeof(line), r->file)) {
+        r->line_no++;
+        if (2 == sscanf(line, "# anchor\t%" SCNd64 "\t%" SCNd64, &rec->anchor.mono_ns, &rec->anchor.real_ns)) {
+            rec->kind = REPLAY_ANCHOR;
+            return rec->kind;
+        }
+        if (line[0] == '#') {
+            continue;
+        }
+        if (2 == sscanf(line, "%lf %d", &t, &val)) {
+            rec->kind = REPLAY_SAMPLE;
+            rec->t_ns = llround(t * 1e9);
+            rec->int_val = (int16_t) val;
+            return rec->kind;
+        }
+    }
+    rec->kind = REPLAY_EOF;
+    return rec->kind;
+}
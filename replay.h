@@ -0,0 +1,137 @@
+/**
+ * @file replay.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Replay backend which reads a recorded reader output file
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * The replay backend stands in for the SPI bus. It reads the text output
+ * of a previous run (e.g. out.txt) and hands back, in order, each raw
+ * reading with its recorded timestamp, along with any epoch anchors. The
+ * recorded running average column is ignored; it is recomputed by the
+ * pipeline being replayed through.
+ *
+ * It also reads raw frame captures (see capture.h), which it recognizes
+ * by their magic number. Those hand back each frame's bytes and transfer
+ * status instead of a reading, for the caller to decode exactly as it
+ * would a live frame.
+ *
+ * Run-length encoded files (see rle.h) are recognized the same way, and
+ * are expanded back into one REPLAY_SAMPLE record per reading.
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "timebase.h"
+#include "capture.h"
+#include "rle.h"
+
+/**
+ * @brief The kinds of record a replay file contains
+ */
+typedef enum replay_kind {
+    REPLAY_EOF = 0,
+    REPLAY_SAMPLE,
+    REPLAY_ANCHOR,
+    REPLAY_FRAME
+} replay_kind_t;
+
+/**
+ * @brief A single record read from a replay file
+ */
+typedef struct replay_record {
+    /**
+     * @brief What kind of record this is
+     */
+    replay_kind_t kind;
+
+    /**
+     * @brief The recorded time of a sample or frame, in nanoseconds since the start of the run
+     */
+    int64_t t_ns;
+
+    /**
+     * @brief The recorded raw reading of a sample
+     */
+    int16_t int_val;
+
+    /**
+     * @brief The raw bytes of a frame (the capture's frame_len of them)
+     */
+    uint8_t frame[CAP_FRAME_MAX];
+
+    /**
+     * @brief The byte count the transfer that read a frame returned, or -1
+     */
+    int status;
+
+    /**
+     * @brief The recorded anchor (monotonic time relative to the start of the run)
+     */
+    tb_anchor_t anchor;
+} replay_record_t;
+
+/**
+ * @brief An open replay file
+ *
+ * @remarks Treat the members as private.
+ */
+typedef struct replay {
+    FILE *file;
+    long  line_no;
+
+    // Set for raw frame captures
+    int               is_capture;
+    cap_file_header_t header;
+    int64_t           t_ns;
+
+    // Set for RLE files
+    int               is_rle;
+    rle_file_header_t rle_header;
+    rle_reader_t      rle;
+} replay_t;
+
+/**
+ * @brief Opens a recorded reader output file for replay
+ *
+ * @param path The path of the file to replay
+ * @return replay_t* The opened replay, or NULL on failure
+ */
+replay_t *replay_open(const char *path);
+
+/**
+ * @brief The header of a replayed raw frame capture
+ *
+ * @param r The replay
+ * @return const cap_file_header_t* The capture's header, or NULL if the
+ *         replay is of a text output file
+ */
+const cap_file_header_t *replay_capture_header(const replay_t *r);
+
+/**
+ * @brief Closes a replay and frees it
+ *
+ * @param r The replay to close
+ */
+void replay_close(replay_t *r);
+
+/**
+ * @brief Reads the next record from a replay
+ *
+ * @remarks Lines which are neither samples nor anchors are skipped. A
+ *          raw frame capture yields REPLAY_FRAME records in place of
+ *          REPLAY_SAMPLE ones.
+ *
+ * @param r The replay to read from
+ * @param rec The location to write the record to
+ * @return replay_kind_t The kind of record read, or REPLAY_EOF at the end of the file
+ */
+replay_kind_t replay_next(replay_t *r, replay_record_t *rec);
+
+#endif // REPLAY_H
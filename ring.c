@@ -0,0 +1,45 @@
+/**
+ * @file ring.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the SPSC sample ring
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ring.h"
+#include "diag.h"
+
+sample_ring_t *ring_new(size_t capacity) {
+    size_t cap = 1;
+    while (cap < capacity) {
+        cap <<= 1;
+    }
+    sample_ring_t *ring = (sample_ring_t *) aligned_alloc(64, sizeof(sample_ring_t));
+    if (ring == NULL) {
+        diag_error("out of memory");
+        return NULL;
+    }
+    ring->recs = (sample_rec_t *) malloc(sizeof(sample_rec_t) * cap);
+    if (ring->recs == NULL) {
+        diag_error("out of memory");
+        free(ring);
+        return NULL;
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->mask = cap - 1;
+    ring->drops = 0;
+    return ring;
+}
+
+void ring_del(sample_ring_t *ring) {
+    free(ring->recs);
+    free(ring);
+}
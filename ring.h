@@ -0,0 +1,126 @@
+/**
+ * @file ring.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Lock-free single-producer, single-consumer ring of samples
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * The sampler uses a sample_ring_t to hand samples to a consumer thread
+ * (e.g. the subscription server) without locks. The producer never
+ * waits: if the ring is full, the sample is dropped and counted. The
+ * push and pop operations are defined here so that they can be inlined
+ * into the sampling loop.
+ *
+ * Exactly one thread may push, and exactly one thread may pop.
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A single sample as passed between threads
+ */
+typedef struct sample_rec {
+    /**
+     * @brief The acquisition timestamp, in nanoseconds since the start of the run
+     */
+    int64_t t_ns;
+
+    /**
+     * @brief The filtered value at the time of the sample
+     */
+    double  filtered;
+
+    /**
+     * @brief The raw reading
+     */
+    int16_t raw;
+
+    /**
+     * @brief Nonzero if the read failed
+     */
+    int16_t status;
+
+    /**
+     * @brief The CLOCK_MONOTONIC time the sample was acquired, in nanoseconds (see latency.h)
+     */
+    int64_t acq_ns;
+} sample_rec_t;
+
+/**
+ * @brief A lock-free SPSC ring of sample_rec_t
+ *
+ * @remarks Treat the members as private. The head and tail live on
+ *          separate cache lines so that the two threads don't contend.
+ */
+typedef struct sample_ring {
+    _Alignas(64) atomic_size_t head;   // Written by the producer
+    _Alignas(64) atomic_size_t tail;   // Written by the consumer
+    _Alignas(64) size_t        mask;
+    uint64_t                   drops;  // Written by the producer
+    sample_rec_t              *recs;
+} sample_ring_t;
+
+/**
+ * @brief Creates a new ring
+ *
+ * @param capacity The number of samples the ring can hold (rounded up to a power of two)
+ * @return sample_ring_t* The newly-created ring, or NULL on failure
+ */
+sample_ring_t *ring_new(size_t capacity);
+
+/**
+ * @brief Deletes a ring
+ *
+ * @param ring The ring to delete
+ */
+void ring_del(sample_ring_t *ring);
+
+/**
+ * @brief Pushes a sample into the ring (producer only)
+ *
+ * @param ring The ring to push into
+ * @param rec The sample to push
+ * @return int 1 if the sample was pushed, 0 if the ring was full and it was dropped
+ */
+static inline int ring_push(sample_ring_t *ring, const sample_rec_t *rec) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail > ring->mask) {
+        ring->drops++;
+        return 0;
+    }
+    ring->recs[head & ring->mask] = *rec;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 1;
+}
+
+/**
+ * @brief Pops up to max samples from the ring (consumer only)
+ *
+ * @param ring The ring to pop from
+ * @param out The location to copy the samples to
+ * @param max The maximum number of samples to pop
+ * @return size_t The number of samples popped
+ */
+static inline size_t ring_pop(sample_ring_t *ring, sample_rec_t *out, size_t max) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t n = head - tail;
+    if (n > max) {
+        n = max;
+    }
+    for(size_t i = 0; i < n; i++) {
+        out[i] = ring->recs[(tail + i) & ring->mask];
+    }
+    atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+    return n;
+}
+
+#endif // RING_H
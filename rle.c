@@ -0,0 +1,439 @@
+/**
+ * @file rle.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the run-length encoded sample stream
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <sys/types.h>
+
+#include "rle.h"
+#include "mcp3301.h"
+#include "diag.h"
+
+// Months of recordings run past 2 GB, which a 32-bit off_t can't seek to
+_Static_assert(sizeof(off_t) >= sizeof(int64_t), "build with -D_FILE_OFFSET_BITS=64");
+
+// A decoded timestamp is rounded to the nanosecond, so a spacing may put
+// a sample up to just under half a nanosecond beyond the tolerance
+#define RLE_ROUNDING_NS 0.49
+
+struct rle_writer {
+    FILE       *file;
+    int64_t     tol_ns;
+    int         write_failed;
+
+    // The open segment: the spacings which keep each of its samples
+    // within the tolerance lie between dt_lo and dt_hi
+    int64_t     t0;
+    uint64_t    seg_len;
+    double      dt_lo;
+    double      dt_hi;
+    rle_run_t   runs[RLE_SEG_RUNS];
+    int         n_runs;
+
+    // The zones written so far, the last being the one filling; seg
+    // summarizes the open segment until it is written
+    rle_zone_t *zones;
+    size_t      n_zones;
+    size_t      cap_zones;
+    rle_zone_t  seg;
+
+    rle_stats_t stats;
+};
+
+static void zone_reset(rle_zone_t *z, int64_t offset) {
+    memset(z, 0, sizeof(*z));
+    z->offset = offset;
+    z->min = INT16_MAX;
+    z->max = INT16_MIN;
+}
+
+static void zone_add(rle_zone_t *z, int64_t t_ns, int16_t val) {
+    if (z->count == 0) {
+        z->t_first = t_ns;
+    }
+    z->t_last = t_ns;
+    z->count++;
+    if (val == MCP3301_READ_ERROR) {
+        z->errors++;
+        return;
+    }
+    z->min = val < z->min ? val : z->min;
+    z->max = val > z->max ? val : z->max;
+    z->sum += val;
+    z->sum_sq += (uint64_t)((int32_t) val * val);
+}
+
+static void zone_merge(rle_zone_t *z, const rle_zone_t *b) {
+    if (z->count == 0) {
+        z->t_first = b->t_first;
+    }
+    z->t_last = b->t_last;
+    z->count += b->count;
+    z->errors += b->errors;
+    z->min = b->min < z->min ? b->min : z->min;
+    z->max = b->max > z->max ? b->max : z->max;
+    z->sum += b->sum;
+    z->sum_sq += b->sum_sq;
+}
+
+static void rle_write(rle_writer_t *w, const void *data, size_t len) {
+    if (len != fwrite(data, 1, len, w->file)) {
+        w->write_failed = 1;
+    }
+    w->stats.bytes += len;
+}
+
+// Writes a zone's summary a field at a time, leaving out rle_zone_t's padding
+static void zone_write(rle_writer_t *w, const rle_zone_t *z) {
+    rle_write(w, &z->offset, sizeof(z->offset));
+    rle_write(w, &z->t_first, sizeof(z->t_first));
+    rle_write(w, &z->t_last, sizeof(z->t_last));
+    rle_write(w, &z->count, sizeof(z->count));
+    rle_write(w, &z->errors, sizeof(z->errors));
+    rle_write(w, &z->min, sizeof(z->min));
+    rle_write(w, &z->max, sizeof(z->max));
+    rle_write(w, &z->sum, sizeof(z->sum));
+    rle_write(w, &z->sum_sq, sizeof(z->sum_sq));
+}
+
+rle_writer_t *rle_open(const char *path, int64_t tol_ns) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        diag_error("could not create %s", path);
+        return NULL;
+    }
+    rle_writer_t *w = (rle_writer_t *) calloc(1, sizeof(rle_writer_t));
+    rle_zone_t *zones = (rle_zone_t *) malloc(64 * sizeof(rle_zone_t));
+    if (w == NULL || zones == NULL) {
+        diag_error("out of memory");
+        free(w);
+        free(zones);
+        fclose(f);
+        remove(path);
+        return NULL;
+    }
+    w->file = f;
+    w->tol_ns = tol_ns;
+
+    rle_file_header_t h = { RLE_MAGIC, RLE_VERSION, 0, tol_ns };
+    rle_write(w, &h, sizeof(h));
+
+    w->zones = zones;
+    w->cap_zones = 64;
+    w->n_zones = 1;
+    zone_reset(&w->zones[0], (int64_t) w->stats.bytes);
+    return w;
+}
+
+// Writes out the open segment, if any
+static void rle_flush(rle_writer_t *w) {
+    if (w->n_runs == 0) {
+        return;
+    }
+    uint8_t tag = RLE_TAG_SEGMENT;
+    double dt = (w->seg_len > 1) ? (w->dt_lo + w->dt_hi) / 2 : 0.0;
+    uint16_t n_runs = (uint16_t) w->n_runs;
+    rle_write(w, &tag, 1);
+    rle_write(w, &w->t0, sizeof(w->t0));
+    rle_write(w, &dt, sizeof(dt));
+    rle_write(w, &n_runs, sizeof(n_runs));
+    for(int i = 0; i < w->n_runs; i++) {
+        rle_write(w, &w->runs[i].value, sizeof(int16_t));
+        rle_write(w, &w->runs[i].count, sizeof(uint16_t));
+    }
+    w->stats.runs += w->n_runs;
+    w->stats.segments++;
+    w->n_runs = 0;
+
+    // Close the zone once it holds enough samples
+    rle_zone_t *z = &w->zones[w->n_zones - 1];
+    zone_merge(z, &w->seg);
+    if (z->count >= RLE_ZONE_SAMPLES) {
+        if (w->n_zones == w->cap_zones) {
+            rle_zone_t *zones = (rle_zone_t *) realloc(w->zones, 2 * w->cap_zones * sizeof(rle_zone_t));
+            if (zones == NULL) {
+                // Carry on in the same zone; it's only coarser
+                return;
+            }
+            w->zones = zones;
+            w->cap_zones *= 2;
+        }
+        zone_reset(&w->zones[w->n_zones++], (int64_t) w->stats.bytes);
+    }
+}
+
+void rle_sample(rle_writer_t *w, int64_t t_ns, int16_t val) {
+    w->stats.samples++;
+    if (w->n_runs > 0) {
+        // Narrow the spacings to those which also fit this sample
+        double k = (double) w->seg_len;
+        double margin = w->tol_ns + RLE_ROUNDING_NS;
+        double lo = fmax(w->dt_lo, (t_ns - w->t0 - margin) / k);
+        double hi = fmin(w->dt_hi, (t_ns - w->t0 + margin) / k);
+        rle_run_t *run = &w->runs[w->n_runs - 1];
+        int extends = (run->value == val && run->count < RLE_RUN_MAX);
+        if (lo <= hi && (extends || w->n_runs < RLE_SEG_RUNS)) {
+            w->dt_lo = lo;
+            w->dt_hi = hi;
+            w->seg_len++;
+            if (extends) {
+                run->count++;
+            } else {
+                w->runs[w->n_runs++] = (rle_run_t) { val, 1 };
+            }
+            zone_add(&w->seg, t_ns, val);
+            return;
+        }
+        rle_flush(w);
+    }
+    zone_reset(&w->seg, 0);
+    zone_add(&w->seg, t_ns, val);
+    w->t0 = t_ns;
+    w->seg_len = 1;
+    w->dt_lo = -INFINITY;
+    w->dt_hi = INFINITY;
+    w->runs[0] = (rle_run_t) { val, 1 };
+    w->n_runs = 1;
+}
+
+void rle_anchor(rle_writer_t *w, const tb_anchor_t *anchor) {
+    uint8_t tag = RLE_TAG_ANCHOR;
+    rle_flush(w);
+    rle_write(w, &tag, 1);
+    rle_write(w, &anchor->mono_ns, sizeof(int64_t));
+    rle_write(w, &anchor->real_ns, sizeof(int64_t));
+}
+
+int rle_close(rle_writer_t *w, rle_stats_t *stats) {
+    rle_flush(w);
+
+    // The index, without the last zone if it's empty
+    uint32_t n_zones = (uint32_t) w->n_zones - (w->zones[w->n_zones - 1].count == 0);
+    rle_file_trailer_t trailer = { (int64_t) w->stats.bytes, RLE_INDEX_MAGIC, 0 };
+    uint8_t tag = RLE_TAG_INDEX;
+    rle_write(w, &tag, 1);
+    rle_write(w, &n_zones, sizeof(n_zones));
+    for(uint32_t i = 0; i < n_zones; i++) {
+        zone_write(w, &w->zones[i]);
+    }
+    rle_write(w, &trailer, sizeof(trailer));
+    w->stats.zones = n_zones;
+    free(w->zones);
+
+    if (0 != fclose(w->file)) {
+        w->write_failed = 1;
+    }
+    int ret = w->write_failed ? -1 : 0;
+    if (stats != NULL) {
+        *stats = w->stats;
+    }
+    free(w);
+    return ret;
+}
+
+FILE *rle_read_open(const char *path, rle_file_header_t *header) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        diag_error("could not open %s", path);
+        return NULL;
+    }
+    if (1 != fread(header, sizeof(*header), 1, f) || header->magic != RLE_MAGIC || header->version < 1 ||
+        header->version > RLE_VERSION) {
+        diag_error("%s is not a supported RLE file", path);
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+rle_kind_t rle_read_record(FILE *f, rle_record_t *rec) {
+    int tag = fgetc(f);
+    uint16_t n;
+    if (tag == RLE_TAG_SEGMENT) {
+        if (1 == fread(&rec->t_ns, sizeof(rec->t_ns), 1, f) && 1 == fread(&rec->dt_ns, sizeof(rec->dt_ns), 1, f) &&
+            1 == fread(&n, sizeof(n), 1, f) && n <= RLE_SEG_RUNS) {
+            rec->n_runs = n;
+            int ok = 1;
+            for(int i = 0; i < n && ok; i++) {
+                ok = (1 == fread(&rec->runs[i].value, sizeof(int16_t), 1, f) &&
+                      1 == fread(&rec->runs[i].count, sizeof(uint16_t), 1, f));
+            }
+            if (ok) {
+                rec->kind = RLE_SEGMENT;
+                return rec->kind;
+            }
+        }
+    } else if (tag == RLE_TAG_ANCHOR) {
+        if (1 == fread(&rec->anchor.mono_ns, sizeof(int64_t), 1, f) &&
+            1 == fread(&rec->anchor.real_ns, sizeof(int64_t), 1, f)) {
+            rec->kind = RLE_ANCHOR;
+            return rec->kind;
+        }
+    } else if (tag != EOF && tag != RLE_TAG_INDEX) {
+        diag_error("corrupt RLE record (tag 0x%02x)", tag);
+    }
+    rec->kind = RLE_EOF;
+    return rec->kind;
+}
+
+static int zone_read(FILE *f, rle_zone_t *z) {
+    return 1 == fread(&z->offset, sizeof(z->offset), 1, f) && 1 == fread(&z->t_first, sizeof(z->t_first), 1, f) &&
+           1 == fread(&z->t_last, sizeof(z->t_last), 1, f) && 1 == fread(&z->count, sizeof(z->count), 1, f) &&
+           1 == fread(&z->errors, sizeof(z->errors), 1, f) && 1 == fread(&z->min, sizeof(z->min), 1, f) &&
+           1 == fread(&z->max, sizeof(z->max), 1, f) && 1 == fread(&z->sum, sizeof(z->sum), 1, f) &&
+           1 == fread(&z->sum_sq, sizeof(z->sum_sq), 1, f);
+}
+
+rle_zone_t *rle_read_zones(FILE *f, size_t *count) {
+    rle_file_trailer_t trailer;
+    uint32_t n;
+    if (0 != fseeko(f, -(off_t) sizeof(trailer), SEEK_END) || 1 != fread(&trailer, sizeof(trailer), 1, f) ||
+        trailer.magic != RLE_INDEX_MAGIC || 0 != fseeko(f, (off_t) trailer.index_offset, SEEK_SET) ||
+        RLE_TAG_INDEX != fgetc(f) || 1 != fread(&n, sizeof(n), 1, f)) {
+        return NULL;
+    }
+    rle_zone_t *zones = (rle_zone_t *) malloc((n ? n : 1) * sizeof(rle_zone_t));
+    if (zones == NULL) {
+        return NULL;
+    }
+    for(uint32_t i = 0; i < n; i++) {
+        if (!zone_read(f, &zones[i])) {
+            free(zones);
+            return NULL;
+        }
+    }
+    *count = n;
+    return zones;
+}
+
+void rle_reader_init(rle_reader_t *r, FILE *f) {
+    memset(r, 0, sizeof(*r));
+    r->file = f;
+}
+
+rle_kind_t rle_read_sample(rle_reader_t *r, int64_t *t_ns, int16_t *val) {
+    for(;;) {
+        if (r->left > 0) {
+            *t_ns = r->rec.t_ns + llround(r->k * r->rec.dt_ns);
+            *val = r->rec.runs[r->run].value;
+            r->k++;
+            r->left--;
+            return RLE_SAMPLE;
+        }
+        if (r->rec.kind == RLE_SEGMENT && r->run + 1 < r->rec.n_runs) {
+            r->left = r->rec.runs[++r->run].count;
+            continue;
+        }
+        if (RLE_SEGMENT != rle_read_record(r->file, &r->rec)) {
+            return r->rec.kind;
+        }
+        r->run = -1;
+        r->k = 0;
+    }
+}
+
+// The state of an rle_find(): the stretch being built, if any
+typedef struct rle_finder {
+    int        threshold;
+    int        above;
+    void     (*fn)(const rle_span_t *span, void *arg);
+    void      *arg;
+    int        open;
+    rle_span_t span;
+} rle_finder_t;
+
+static void finder_end(rle_finder_t *fd) {
+    if (fd->open) {
+        fd->fn(&fd->span, fd->arg);
+        fd->open = 0;
+    }
+}
+
+static void finder_add(rle_finder_t *fd, int64_t t_ns, int16_t val) {
+    if (!fd->open) {
+        fd->open = 1;
+        fd->span.t_first = t_ns;
+        fd->span.count = 0;
+        fd->span.peak = val;
+    }
+    fd->span.t_last = t_ns;
+    fd->span.count++;
+    if (fd->above ? val > fd->span.peak : val < fd->span.peak) {
+        fd->span.peak = val;
+    }
+}
+
+// Whether a reading passes the threshold
+static int finder_matches(const rle_finder_t *fd, int16_t val) {
+    return val != MCP3301_READ_ERROR && (fd->above ? val > fd->threshold : val < fd->threshold);
+}
+
+// Decodes one zone, whose records end at the offset end (-1 for the
+// last), adding its matching readings to the open stretch; returns the
+// number of samples decoded
+static uint64_t finder_scan(rle_finder_t *fd, FILE *f, const rle_zone_t *z, int64_t end, rle_record_t *rec) {
+    uint64_t samples = 0;
+    if (0 != fseeko(f, (off_t) z->offset, SEEK_SET)) {
+        return 0;
+    }
+    while ((end < 0 || ftello(f) < end) && RLE_EOF != rle_read_record(f, rec)) {
+        if (rec->kind != RLE_SEGMENT) {
+            continue;
+        }
+        uint64_t k = 0;
+        for(int i = 0; i < rec->n_runs; i++) {
+            const rle_run_t *run = &rec->runs[i];
+            if (!finder_matches(fd, run->value)) {
+                finder_end(fd);
+                k += run->count;
+                continue;
+            }
+            for(uint16_t j = 0; j < run->count; j++, k++) {
+                finder_add(fd, rec->t_ns + llround(k * rec->dt_ns), run->value);
+            }
+        }
+        samples += k;
+    }
+    return samples;
+}
+
+int rle_find(FILE *f, const rle_zone_t *zones, size_t n, int threshold, int above,
+             void (*fn)(const rle_span_t *span, void *arg), void *arg, rle_find_stats_t *stats) {
+    rle_record_t *rec = (rle_record_t *) malloc(sizeof(rle_record_t));
+    if (rec == NULL) {
+        return -1;
+    }
+    rle_finder_t fd = { threshold, above, fn, arg, 0, { 0 } };
+    rle_find_stats_t st = { n, 0, 0, 0 };
+    for(size_t i = 0; i < n; i++) {
+        const rle_zone_t *z = &zones[i];
+        st.samples += z->count;
+
+        // A zone with no reading past the threshold still has a reading,
+        // which ends any open stretch
+        if (z->count == z->errors || !(above ? z->max > threshold : z->min < threshold)) {
+            finder_end(&fd);
+            continue;
+        }
+        st.zones_decoded++;
+        st.samples_decoded += finder_scan(&fd, f, z, (i + 1 < n) ? zones[i + 1].offset : -1, rec);
+    }
+    finder_end(&fd);
+    free(rec);
+    if (stats != NULL) {
+        *stats = st;
+    }
+    return 0;
+}
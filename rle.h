@@ -0,0 +1,328 @@
+/**
+ * @file rle.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Run-length encoded storage of the raw reading stream
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * While the perch is empty, the raw readings sit on one or two codes for
+ * hours, and the text output spends a 20-odd byte line on each of them.
+ * An RLE file instead holds the readings as runs of equal values, and
+ * their timestamps as segments of regularly spaced samples, so that an
+ * idle stretch costs a few bytes per run rather than per reading.
+ *
+ * The file is an rle_file_header_t followed by tagged records:
+ *
+ *     'S' i64 t_ns, f64 dt_ns, u16 runs, runs * (i16 value, u16 count)
+ *                                      a segment of samples
+ *     'A' i64 mono_ns, i64 real_ns     an epoch anchor
+ *     'Z' u32 zones, zones * (i64 offset, i64 t_first, i64 t_last,
+ *         u32 count, u32 errors, i16 min, i16 max, i64 sum, u64 sum_sq)
+ *                                      the zone index, last (see rle_zone_t)
+ *
+ * followed by an rle_file_trailer_t giving the zone index's offset.
+ *
+ * Sample k of a segment (counting from 0 across its runs) is at
+ * t_ns + llround(k * dt_ns), in nanoseconds since the start of the run as
+ * in the text output. The runs give the samples' values in order; a run
+ * holds at most RLE_RUN_MAX samples, and a longer stretch of one value
+ * continues in the next run. All fields are in host byte order and
+ * unaligned.
+ *
+ * The values, their order and the anchors are kept exactly. The writer
+ * keeps a segment going for as long as one spacing puts every sample
+ * within the file's time tolerance of its recorded time, so timestamps
+ * come back within that tolerance: exactly (to the nanosecond) with a
+ * tolerance of 0, which suits controller-paced bursts, whose readings
+ * are spaced exactly. Single reads jitter by microseconds, so need a
+ * tolerance of that order for segments to span more than a few samples.
+ *
+ * The records are grouped into zones of whole segments holding at least
+ * RLE_ZONE_SAMPLES samples each, and the index keeps a summary of each
+ * zone's samples: where its records start, its time span, and the count,
+ * minimum, maximum, sum and sum of squares of its readings. A query such
+ * as "when did the reading exceed X" can then skip every zone whose
+ * summary rules it out, and decode only the rest (see rle_find() and
+ * spiquery.c). The
+ * index is written when the file is closed, so a file whose writer
+ * didn't exit cleanly has none, but its records are still complete up to
+ * the last one written. Offsets are 64-bit; on a 32-bit Pi, build with
+ * -D_FILE_OFFSET_BITS=64 (as the README does) so that stdio can reach
+ * past 2 GB.
+ *
+ * A recorded RLE file is decoded by replaying it (see replay.h), which
+ * hands back every sample in turn, just as for a text output file, by
+ * way of rle_read_sample().
+ */
+
+#ifndef RLE_H
+#define RLE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "timebase.h"
+
+/**
+ * @brief Magic number at the start of an RLE file ("SPIR")
+ */
+#define RLE_MAGIC 0x52495053u
+
+/**
+ * @brief The RLE format version this code writes; it also reads version 1,
+ *        which had no zone index
+ */
+#define RLE_VERSION 2
+
+/**
+ * @brief Magic number at the very end of an RLE file with a zone index ("SPIZ")
+ */
+#define RLE_INDEX_MAGIC 0x5A495053u
+
+/**
+ * @brief Most samples in one run
+ */
+#define RLE_RUN_MAX 65535
+
+/**
+ * @brief Most runs in one segment
+ */
+#define RLE_SEG_RUNS 1024
+
+/**
+ * @brief Fewest samples in a zone (but the last), which ends at the end
+ *        of the segment that reaches this many
+ */
+#define RLE_ZONE_SAMPLES 4096
+
+// Record tags
+#define RLE_TAG_SEGMENT 'S'
+#define RLE_TAG_ANCHOR  'A'
+#define RLE_TAG_INDEX   'Z'
+
+/**
+ * @brief The header at the start of an RLE file
+ */
+typedef struct rle_file_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    int64_t  tol_ns;        // Largest timestamp error allowed, in nanoseconds
+} rle_file_header_t;
+
+/**
+ * @brief The summary of a zone
+ *
+ * @remarks Read errors (MCP3301_READ_ERROR) are counted, but left out of
+ *          the other figures. Times are as recorded, so may differ from
+ *          the decoded times by up to the file's tolerance. In the file,
+ *          the fields follow one another without the struct's padding.
+ */
+typedef struct rle_zone {
+    int64_t  offset;        // Offset in the file of the zone's first record
+    int64_t  t_first;       // Time of the first sample, in nanoseconds since the start of the run
+    int64_t  t_last;        // Time of the last sample
+    uint32_t count;         // Samples, including read errors
+    uint32_t errors;        // Read errors
+    int16_t  min;           // Smallest reading
+    int16_t  max;           // Largest reading
+    int64_t  sum;           // Sum of the readings
+    uint64_t sum_sq;        // Sum of the squares of the readings
+} rle_zone_t;
+
+/**
+ * @brief The trailer at the very end of an RLE file with a zone index
+ */
+typedef struct rle_file_trailer {
+    int64_t  index_offset;  // Offset of the zone index's tag
+    uint32_t magic;         // RLE_INDEX_MAGIC
+    uint32_t reserved;
+} rle_file_trailer_t;
+
+/**
+ * @brief Figures for a finished RLE file
+ */
+typedef struct rle_stats {
+    uint64_t samples;       // Samples written
+    uint64_t runs;          // Runs they took
+    uint64_t segments;      // Segments they took
+    uint64_t zones;         // Zones in the index
+    uint64_t bytes;         // Bytes written to the file
+} rle_stats_t;
+
+typedef struct rle_writer rle_writer_t;
+
+/**
+ * @brief Creates an RLE file
+ *
+ * @param path The path of the file to create (replaced if it exists)
+ * @param tol_ns The largest timestamp error allowed, in nanoseconds (0 for exact)
+ * @return rle_writer_t* The writer, or NULL on failure
+ */
+rle_writer_t *rle_open(const char *path, int64_t tol_ns);
+
+/**
+ * @brief Records one sample
+ *
+ * @param w The writer to record into
+ * @param t_ns The sample's time, in nanoseconds since the start of the run
+ * @param val The raw reading
+ */
+void rle_sample(rle_writer_t *w, int64_t t_ns, int16_t val);
+
+/**
+ * @brief Records an epoch anchor, after the samples recorded so far
+ *
+ * @param w The writer to record into
+ * @param anchor The anchor (monotonic time relative to the start of the run)
+ */
+void rle_anchor(rle_writer_t *w, const tb_anchor_t *anchor);
+
+/**
+ * @brief Writes out everything recorded, closes the file and frees the writer
+ *
+ * @param w The writer to close
+ * @param stats The location to write the file's figures to, or NULL
+ * @return int 0 if everything was written, nonzero if a write failed
+ */
+int rle_close(rle_writer_t *w, rle_stats_t *stats);
+
+/**
+ * @brief The kinds of record an RLE file contains
+ */
+typedef enum rle_kind {
+    RLE_EOF = 0,
+    RLE_SEGMENT,
+    RLE_ANCHOR,
+    RLE_SAMPLE              // One sample of a segment, from rle_read_sample()
+} rle_kind_t;
+
+/**
+ * @brief A run of equal readings
+ */
+typedef struct rle_run {
+    int16_t  value;
+    uint16_t count;
+} rle_run_t;
+
+/**
+ * @brief A single record read from an RLE file
+ */
+typedef struct rle_record {
+    rle_kind_t  kind;
+    int64_t     t_ns;                   // A segment's first sample time
+    double      dt_ns;                  // A segment's sample spacing
+    int         n_runs;                 // The number of runs in a segment
+    rle_run_t   runs[RLE_SEG_RUNS];     // A segment's runs
+    tb_anchor_t anchor;                 // An anchor
+} rle_record_t;
+
+/**
+ * @brief Opens an RLE file for reading
+ *
+ * @param path The path of the file
+ * @param header The location to write the file's header to
+ * @return FILE* The file, positioned at its first record, or NULL on failure
+ */
+FILE *rle_read_open(const char *path, rle_file_header_t *header);
+
+/**
+ * @brief Reads the next record from an RLE file
+ *
+ * @param f The file
+ * @param rec The location to write the record to
+ * @return rle_kind_t The kind of record read, or RLE_EOF at the zone
+ *         index or the end of the file
+ */
+rle_kind_t rle_read_record(FILE *f, rle_record_t *rec);
+
+/**
+ * @brief Reads an RLE file a sample at a time, expanding each segment's
+ *        runs
+ *
+ * @remarks Treat the members as private.
+ */
+typedef struct rle_reader {
+    FILE        *file;
+    rle_record_t rec;       // The segment being expanded, or the last anchor read
+    int          run;       // The run being expanded
+    uint32_t     left;      // Samples left in it
+    uint64_t     k;         // The next sample's index in the segment
+} rle_reader_t;
+
+/**
+ * @brief Starts reading samples from an RLE file
+ *
+ * @param r The reader to set up
+ * @param f The file, positioned at a record (as rle_read_open() leaves it)
+ */
+void rle_reader_init(rle_reader_t *r, FILE *f);
+
+/**
+ * @brief Reads the next sample or anchor
+ *
+ * @param r The reader
+ * @param t_ns The location to write a sample's time to
+ * @param val The location to write a sample's reading to
+ * @return rle_kind_t RLE_SAMPLE for a sample; RLE_ANCHOR for an anchor,
+ *         which is left in r->rec.anchor; or RLE_EOF at the zone index or
+ *         the end of the file
+ */
+rle_kind_t rle_read_sample(rle_reader_t *r, int64_t *t_ns, int16_t *val);
+
+/**
+ * @brief Reads an RLE file's zone index
+ *
+ * @remarks Leaves the file's position undefined.
+ *
+ * @param f The file
+ * @param count The location to write the number of zones to
+ * @return rle_zone_t* The zones, in order (to be freed by the caller), or
+ *         NULL if the file has no index
+ */
+rle_zone_t *rle_read_zones(FILE *f, size_t *count);
+
+/**
+ * @brief A stretch of consecutive readings past a threshold
+ */
+typedef struct rle_span {
+    int64_t  t_first;       // Time of the first reading, in nanoseconds since the start of the run
+    int64_t  t_last;        // Time of the last reading
+    uint64_t count;         // Readings
+    int16_t  peak;          // The reading furthest past the threshold
+} rle_span_t;
+
+/**
+ * @brief How much of a file a search decoded
+ */
+typedef struct rle_find_stats {
+    size_t   zones;             // Zones in the index
+    size_t   zones_decoded;     // Zones whose summaries allowed a match
+    uint64_t samples;           // Samples in the file
+    uint64_t samples_decoded;   // Samples in the zones decoded
+} rle_find_stats_t;
+
+/**
+ * @brief Finds every stretch of consecutive readings above (or below) a
+ *        threshold, decoding only the zones whose summaries allow a match
+ *
+ * @remarks Read errors match neither way, so end a stretch, as do
+ *          anything else failing the threshold. The stretches are the
+ *          same as from checking every sample of the file in turn.
+ *
+ * @param f The file
+ * @param zones Its zone index, from rle_read_zones()
+ * @param n The number of zones
+ * @param threshold The raw reading to compare against
+ * @param above Nonzero to find readings above the threshold, 0 for below
+ * @param fn Called with each stretch, in order of time
+ * @param arg Passed on to fn
+ * @param stats The location to write how much was decoded to, or NULL
+ * @return int 0 on success, nonzero if memory ran out
+ */
+int rle_find(FILE *f, const rle_zone_t *zones, size_t n, int threshold, int above,
+             void (*fn)(const rle_span_t *span, void *arg), void *arg, rle_find_stats_t *stats);
+
+#endif // RLE_H
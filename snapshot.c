@@ -0,0 +1,58 @@
+/**
+ * @file snapshot.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the lock-free live snapshot
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "snapshot.h"
+
+// Weight of each new interval in the interval and jitter moving averages
+#define SNAP_EWMA_ALPHA (1.0 / 64.0)
+
+void snap_record_sample(live_values_t *v, int64_t t_ns, int16_t raw, double filtered, int is_error, int64_t acq_ns) {
+    if (v->samples > 0) {
+        double dt = (double)(t_ns - v->t_ns);
+        if (v->samples == 1) {
+            v->interval_ns = dt;
+        }
+        v->jitter_ns += SNAP_EWMA_ALPHA * (fabs(dt - v->interval_ns) - v->jitter_ns);
+        v->interval_ns += SNAP_EWMA_ALPHA * (dt - v->interval_ns);
+    }
+    v->t_ns = t_ns;
+    v->raw = raw;
+    v->filtered = filtered;
+    v->acq_ns = acq_ns;
+    v->samples++;
+    if (is_error) {
+        v->errors++;
+    }
+}
+
+void snap_publish(live_snapshot_t *snap, const live_values_t *v) {
+    unsigned seq = atomic_load_explicit(&snap->seq, memory_order_relaxed);
+    atomic_store_explicit(&snap->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&snap->values, v, sizeof(*v));
+    atomic_store_explicit(&snap->seq, seq + 2, memory_order_release);
+}
+
+void snap_read(live_snapshot_t *snap, live_values_t *v) {
+    unsigned before, after;
+    do {
+        before = atomic_load_explicit(&snap->seq, memory_order_acquire);
+        memcpy(v, &snap->values, sizeof(*v));
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&snap->seq, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+}
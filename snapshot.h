@@ -0,0 +1,116 @@
+/**
+ * @file snapshot.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Lock-free "latest values" snapshot shared by the sampler and its viewers
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * The sampler publishes the latest reading, running counters and timing
+ * statistics into a live_snapshot_t after every sample. Any number of
+ * other threads (e.g. the dashboard) can read a consistent copy at their
+ * own pace without ever making the sampler wait.
+ *
+ * This is a sequence lock: the single writer bumps the sequence number
+ * to odd before writing and back to even afterwards, and readers retry
+ * if they saw an odd number or the number changed while they copied.
+ * Only one thread may publish into a given snapshot.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * @brief The values published by the sampler
+ */
+typedef struct live_values {
+    /**
+     * @brief The timestamp of the latest sample, in nanoseconds since the start of the run
+     */
+    int64_t  t_ns;
+
+    /**
+     * @brief The latest raw reading
+     */
+    int16_t  raw;
+
+    /**
+     * @brief The latest filtered value
+     */
+    double   filtered;
+
+    /**
+     * @brief The number of samples taken so far
+     */
+    uint64_t samples;
+
+    /**
+     * @brief The number of failed reads so far
+     */
+    uint64_t errors;
+
+    /**
+     * @brief Moving average of the time between samples, in nanoseconds
+     */
+    double   interval_ns;
+
+    /**
+     * @brief Moving average of the absolute deviation of the time between
+     *        samples from interval_ns, in nanoseconds
+     */
+    double   jitter_ns;
+
+    /**
+     * @brief The CLOCK_MONOTONIC time the latest sample was acquired, in nanoseconds
+     */
+    int64_t  acq_ns;
+} live_values_t;
+
+/**
+ * @brief A seqlock-protected copy of live_values_t
+ *
+ * @remarks Treat the members as private. Zero-initialization is valid.
+ */
+typedef struct live_snapshot {
+    atomic_uint   seq;
+    live_values_t values;
+} live_snapshot_t;
+
+/**
+ * @brief Folds a new sample into the sampler's running values
+ *
+ * @remarks This only touches the sampler's private copy; call
+ *          snap_publish() to make the result visible.
+ *
+ * @param v The sampler's running values
+ * @param t_ns The timestamp of the sample, in nanoseconds since the start of the run
+ * @param raw The raw reading
+ * @param filtered The filtered value
+ * @param is_error Nonzero if the read failed
+ * @param acq_ns The CLOCK_MONOTONIC time the sample was acquired, in nanoseconds
+ */
+void snap_record_sample(live_values_t *v, int64_t t_ns, int16_t raw, double filtered, int is_error, int64_t acq_ns);
+
+/**
+ * @brief Publishes the given values into the snapshot
+ *
+ * @remarks Must only be called from the snapshot's single writer thread.
+ *
+ * @param snap The snapshot to publish into
+ * @param v The values to publish
+ */
+void snap_publish(live_snapshot_t *snap, const live_values_t *v);
+
+/**
+ * @brief Reads a consistent copy of the snapshot
+ *
+ * @param snap The snapshot to read
+ * @param v The location to copy the values to
+ */
+void snap_read(live_snapshot_t *snap, live_values_t *v);
+
+#endif // SNAPSHOT_H
@@ -23,6 +23,7 @@
 #include <assert.h>
 
 #include "spi.h"
+#include "diag.h"
 
 // Internal storage of original (i.e. before initialization) SPI bus settings
 static spi_settings_t spi_settings_orig = {0, 0, 0, 0};
@@ -68,19 +69,19 @@ int spi_read_settings(int fd, spi_settings_t *settings) {
     assert(settings != NULL);
     int ret = 0;
     if (0 != (ret = get_spi_mode(fd, &(settings->mode)))) {
-        printf("Could not read SPI mode: code %d\n", ret);
+        diag_error("could not read SPI mode: code %d", ret);
         return ret;
     } 
     if (0 != (ret = get_spi_is_lsb_first(fd, &(settings->is_lsb_first)))) {
-        printf("Could not read SPI mode: code %d\n", ret);
+        diag_error("could not read SPI mode: code %d", ret);
         return ret;
     } 
     if (0 != (ret = get_spi_bits_per_word(fd, &(settings->bits_per_word)))) {
-        printf("Could not read SPI mode: code %d\n", ret);
+        diag_error("could not read SPI mode: code %d", ret);
         return ret;
     } 
     if (0 != (ret = get_spi_max_speed_hz(fd, &(settings->max_speed_hz)))) {
-        printf("Could not read SPI max speed (hz): code %d\n", ret);
+        diag_error("could not read SPI max speed (hz): code %d", ret);
         return ret;
     }
     return 0; 
@@ -90,19 +91,19 @@ int spi_write_settings(int fd, spi_settings_t *settings) {
     assert(settings != NULL);
     int ret = 0;
     if (0 != (ret = set_spi_mode(fd, settings->mode))) {
-        printf("Could not set SPI mode: code %d\n", ret);
+        diag_error("could not set SPI mode: code %d", ret);
         return ret;
     } 
     if (0 != (ret = set_spi_is_lsb_first(fd, settings->is_lsb_first))) {
-        printf("Could not set SPI mode: code %d\n", ret);
+        diag_error("could not set SPI mode: code %d", ret);
         return ret;
     } 
     if (0 != (ret = set_spi_bits_per_word(fd, settings->bits_per_word))) {
-        printf("Could not set SPI mode: code %d\n", ret);
+        diag_error("could not set SPI mode: code %d", ret);
         return ret;
     } 
     if (0 != (ret = set_spi_max_speed_hz(fd, settings->max_speed_hz))) {
-        printf("Could not set SPI max speed (hz): code %d\n", ret);
+        diag_error("could not set SPI max speed (hz): code %d", ret);
         return ret;
     }
     return 0; 
@@ -111,7 +112,7 @@ int spi_write_settings(int fd, spi_settings_t *settings) {
 void print_current_spi_settings(int fd) {
     spi_settings_t s;
     if (0 != spi_read_settings(fd, &s)) {
-        printf("print_current_spi_settings: unable to read settings");
+        diag_error("unable to read settings");
         return;
     }
     print_spi_settings(&s);
@@ -120,18 +121,18 @@ void print_current_spi_settings(int fd) {
 int spi_init(const char *device_name, spi_settings_t *settings) {
     int fd = open(device_name, O_RDWR);
     if (0 > fd) {
-        printf("spi_init: open failed with retval %d\n", fd);
+        diag_error("open failed with retval %d", fd);
         return fd;
     }
 
     int ret = 0;
     if (0 != (ret = spi_read_settings(fd, &spi_settings_orig))) {
-        printf("spi_init: failed to read SPI settings, code %d\n", ret);
+        diag_error("failed to read SPI settings, code %d", ret);
         close(fd);
         return -1;
     }
     if (0 != (ret = spi_write_settings(fd, settings))) {
-        printf("spi_init: failed to write SPI settings, code %d\n", ret);
+        diag_error("failed to write SPI settings, code %d", ret);
         close(fd);
         return -1;
     }
@@ -142,7 +143,7 @@ int spi_init(const char *device_name, spi_settings_t *settings) {
 void spi_shutdown(int fd) {
     int ret = 0;
     if (0 != (ret = spi_write_settings(fd, &spi_settings_orig))) {
-        printf("spi_shutdown: failed to write SPI settings, code %d\n", ret);
+        diag_error("failed to write SPI settings, code %d", ret);
     }
     close(fd);
 }
@@ -150,3 +151,23 @@ void spi_shutdown(int fd) {
 int spi_read_two_bytes(int fd, uint8_t* out) {
     return read(fd, out, 2);
 }
+
+int spi_transfer_frames(int fd, const uint8_t *tx_frame, uint8_t *out, int frames, int frame_len, uint16_t delay_usecs) {
+    assert(frames > 0 && frames <= SPI_BURST_MAX);
+    struct spi_ioc_transfer xfer[SPI_BURST_MAX];
+    memset(xfer, 0, sizeof(struct spi_ioc_transfer) * frames);
+    for(int i = 0; i < frames; i++) {
+        xfer[i].tx_buf = (unsigned long) tx_frame;
+        xfer[i].rx_buf = (unsigned long)(out + i * frame_len);
+        xfer[i].len = frame_len;
+        xfer[i].delay_usecs = delay_usecs;
+        // Deselect between frames so the ADC starts a new conversion, but
+        // not after the last one (which would leave the chip selected)
+        xfer[i].cs_change = (i < frames - 1);
+    }
+    return ioctl(fd, SPI_IOC_MESSAGE(frames), xfer);
+}
+
+int spi_read_frames(int fd, uint8_t *out, int frames, int frame_len, uint16_t delay_usecs) {
+    return spi_transfer_frames(fd, NULL, out, frames, frame_len, delay_usecs);
+}
@@ -24,6 +24,9 @@
  * should be reasonably straightforward :).
  */
 
+#ifndef SPI_H
+#define SPI_H
+
 #include <linux/spi/spidev.h>
 #include <stdint.h>
 
@@ -117,3 +120,47 @@ void spi_shutdown(int fd);
  * @return int The number of bytes read, else 0 for for EOF or -1 for errors
  */
 int spi_read_two_bytes(int fd, uint8_t* out);
+
+/**
+ * @brief The largest number of frames spi_read_frames() can take in one burst
+ *
+ * @remarks The spidev ioctl encodes the size of the transfer array in 14
+ *          bits, which caps a single message at 511 transfers.
+ */
+#define SPI_BURST_MAX 256
+
+/**
+ * @brief Transfers a burst of fixed-length frames in a single SPI message
+ * 
+ * @remarks Each frame is its own transfer, with chip select toggled
+ *          between frames (cs_change) and delay_usecs of idle time after
+ *          each one, so the spacing between frames is set by the SPI
+ *          controller inside the kernel rather than by userspace. The
+ *          same tx_frame (e.g. an ADC's command bytes) is sent for every
+ *          frame.
+ * 
+ * @param fd The SPI device file descriptor
+ * @param tx_frame The frame_len bytes to send for each frame, or NULL to send zeros
+ * @param out The memory buffer to write the data to (frames * frame_len bytes)
+ * @param frames The number of frames to transfer (at most SPI_BURST_MAX)
+ * @param frame_len The length of each frame, in bytes
+ * @param delay_usecs The delay after each frame, in microseconds
+ * @return int The number of bytes read, or -1 for errors
+ */
+int spi_transfer_frames(int fd, const uint8_t *tx_frame, uint8_t *out, int frames, int frame_len, uint16_t delay_usecs);
+
+/**
+ * @brief Reads a burst of fixed-length frames in a single SPI message
+ * 
+ * @remarks Equivalent to spi_transfer_frames() with a NULL tx_frame.
+ * 
+ * @param fd The SPI device file descriptor
+ * @param out The memory buffer to write the data to (frames * frame_len bytes)
+ * @param frames The number of frames to read (at most SPI_BURST_MAX)
+ * @param frame_len The length of each frame, in bytes
+ * @param delay_usecs The delay after each frame, in microseconds
+ * @return int The number of bytes read, or -1 for errors
+ */
+int spi_read_frames(int fd, uint8_t *out, int frames, int frame_len, uint16_t delay_usecs);
+
+#endif // SPI_H
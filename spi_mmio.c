@@ -0,0 +1,350 @@
+/**
+ * @file spi_mmio.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the direct, polled SPI0 driver and its simulator
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "spi_mmio.h"
+#include "diag.h"
+
+// Where the peripheral base is published on Raspberry Pi OS
+#define SPI_MMIO_RANGES_PATH "/proc/device-tree/soc/ranges"
+
+// The base to fall back on if it isn't published (the original Pi)
+#define SPI_MMIO_DEFAULT_BASE 0x20000000u
+
+// Status polls before a transfer is given up on; far longer than a
+// transfer takes at any usable clock
+#define SPI_MMIO_POLL_LIMIT 10000000
+
+////////////////////////////////////////////////////////
+/// Simulator state
+
+// Depth of the simulated RX FIFO, in bytes (as on the real controller)
+#define SIM_FIFO_LEN 64
+
+// Where the simulator keeps its own state in the register file
+#define SIM_STATE_OFFSET 0x800
+
+/**
+ * @brief The simulated controller and ADC, stored in the register file
+ *        after the registers themselves
+ */
+typedef struct sim_state {
+    uint32_t rx_head;              // Next byte to read from rx_fifo
+    uint32_t rx_count;             // Bytes waiting in rx_fifo
+    uint32_t frame;                // The frame the ADC is shifting out
+    uint32_t frame_bits;           // Bits of the frame not yet shifted out
+    uint32_t conversions;          // Conversions started so far
+    uint32_t value_fixed;          // Nonzero once a value has been set
+    int32_t  value;                // The value set, if any
+    uint8_t  rx_fifo[SIM_FIFO_LEN];
+} sim_state_t;
+
+struct spi_mmio {
+    volatile uint8_t *regs;        // The mapped register block
+    int fd;                        // /dev/mem or the register file
+    int sim;                       // Nonzero for the simulator
+    uint32_t cs_orig;              // Register values to restore on close
+    uint32_t clk_orig;
+};
+
+static sim_state_t *sim_state(spi_mmio_t *dev) {
+    return (sim_state_t *)(dev->regs + SIM_STATE_OFFSET);
+}
+
+static volatile uint32_t *reg_ptr(spi_mmio_t *dev, uint32_t off) {
+    return (volatile uint32_t *)(dev->regs + off);
+}
+
+// Recomputes the read-only status bits of the simulated CS register
+static void sim_update_status(spi_mmio_t *dev) {
+    sim_state_t *st = sim_state(dev);
+    uint32_t cs = *reg_ptr(dev, SPI_MMIO_REG_CS);
+    cs &= ~(SPI_MMIO_CS_DONE | SPI_MMIO_CS_RXD | SPI_MMIO_CS_TXD | SPI_MMIO_CS_RXR | SPI_MMIO_CS_RXF);
+    // Bytes are shifted as soon as they are written, so the TX FIFO is
+    // always empty; it only refuses bytes while the RX FIFO is full
+    if (st->rx_count < SIM_FIFO_LEN) {
+        cs |= SPI_MMIO_CS_TXD;
+    }
+    if (cs & SPI_MMIO_CS_TA) {
+        cs |= SPI_MMIO_CS_DONE;
+    }
+    if (st->rx_count > 0) {
+        cs |= SPI_MMIO_CS_RXD;
+    }
+    if (st->rx_count >= SIM_FIFO_LEN * 3 / 4) {
+        cs |= SPI_MMIO_CS_RXR;
+    }
+    if (st->rx_count == SIM_FIFO_LEN) {
+        cs |= SPI_MMIO_CS_RXF;
+    }
+    *reg_ptr(dev, SPI_MMIO_REG_CS) = cs;
+}
+
+// Chip select falling: the MCP3301 samples and starts a new frame of two
+// sample clocks, a null bit, then the 13-bit two's complement reading
+static void sim_start_conversion(spi_mmio_t *dev) {
+    sim_state_t *st = sim_state(dev);
+    int32_t value = st->value;
+    if (!st->value_fixed) {
+        // A slow triangle wave around mid-scale of the positive range
+        int32_t phase = (st->conversions >> 4) & 127;
+        value = 1024 + (phase < 64 ? phase : 127 - phase);
+    }
+    st->frame = (uint32_t) value & 0x1FFF;
+    st->frame_bits = 16;
+    st->conversions++;
+}
+
+static void sim_write(spi_mmio_t *dev, uint32_t off, uint32_t val) {
+    sim_state_t *st = sim_state(dev);
+    if (off == SPI_MMIO_REG_CS) {
+        uint32_t was_active = *reg_ptr(dev, SPI_MMIO_REG_CS) & SPI_MMIO_CS_TA;
+        if (val & SPI_MMIO_CS_CLEAR_RX) {
+            st->rx_head = 0;
+            st->rx_count = 0;
+        }
+        // The CLEAR bits act once and read back as zero
+        *reg_ptr(dev, SPI_MMIO_REG_CS) = val & ~(SPI_MMIO_CS_CLEAR_TX | SPI_MMIO_CS_CLEAR_RX);
+        if (!was_active && (val & SPI_MMIO_CS_TA)) {
+            sim_start_conversion(dev);
+        }
+    } else if (off == SPI_MMIO_REG_FIFO) {
+        if (!(*reg_ptr(dev, SPI_MMIO_REG_CS) & SPI_MMIO_CS_TA) || st->rx_count == SIM_FIFO_LEN) {
+            return; // Ignored, as the hardware would
+        }
+        // MISO carries the frame MSB first, then zeros once it runs out
+        uint8_t in = 0;
+        if (st->frame_bits >= 8) {
+            in = (uint8_t)(st->frame >> (st->frame_bits - 8));
+            st->frame_bits -= 8;
+        }
+        st->rx_fifo[(st->rx_head + st->rx_count) % SIM_FIFO_LEN] = in;
+        st->rx_count++;
+    } else {
+        *reg_ptr(dev, off) = val;
+    }
+    sim_update_status(dev);
+}
+
+static uint32_t sim_read_fifo(spi_mmio_t *dev) {
+    sim_state_t *st = sim_state(dev);
+    uint32_t val = 0;
+    if (st->rx_count > 0) {
+        val = st->rx_fifo[st->rx_head];
+        st->rx_head = (st->rx_head + 1) % SIM_FIFO_LEN;
+        st->rx_count--;
+    }
+    *reg_ptr(dev, SPI_MMIO_REG_FIFO) = val;
+    sim_update_status(dev);
+    return val;
+}
+
+////////////////////////////////////////////////////////
+/// Register access
+
+// All register traffic goes through these two, so the simulator sees
+// exactly the accesses the hardware would
+static inline uint32_t reg_read(spi_mmio_t *dev, uint32_t off) {
+    if (dev->sim && off == SPI_MMIO_REG_FIFO) {
+        return sim_read_fifo(dev);
+    }
+    return *reg_ptr(dev, off);
+}
+
+static inline void reg_write(spi_mmio_t *dev, uint32_t off, uint32_t val) {
+    if (dev->sim) {
+        sim_write(dev, off, val);
+        return;
+    }
+    *reg_ptr(dev, off) = val;
+}
+
+////////////////////////////////////////////////////////
+/// Driver
+
+// Reads the peripheral base from the device tree, as bcm_host does
+static uint32_t peripheral_base(void) {
+    uint8_t ranges[12];
+    uint32_t base = 0;
+    FILE *f = fopen(SPI_MMIO_RANGES_PATH, "rb");
+    if (f != NULL) {
+        if (sizeof(ranges) == fread(ranges, 1, sizeof(ranges), f)) {
+            base = ((uint32_t) ranges[4] << 24) | (ranges[5] << 16) | (ranges[6] << 8) | ranges[7];
+            // The Pi 4 has a 64-bit parent address, high word first
+            if (base == 0) {
+                base = ((uint32_t) ranges[8] << 24) | (ranges[9] << 16) | (ranges[10] << 8) | ranges[11];
+            }
+        }
+        fclose(f);
+    }
+    return base != 0 ? base : SPI_MMIO_DEFAULT_BASE;
+}
+
+// The clock divider for the fastest clock at or below the requested one.
+// The controller only honors even dividers; 0 means the largest, 65536.
+static uint32_t clock_divider(uint32_t speed_hz) {
+    if (speed_hz == 0) {
+        return 0;
+    }
+    uint32_t div = (SPI_MMIO_CORE_HZ + speed_hz - 1) / speed_hz;
+    div = (div + 1) & ~1u;
+    if (div < 2) {
+        div = 2;
+    }
+    return div >= 65536 ? 0 : div;
+}
+
+static int configure(spi_mmio_t *dev, spi_settings_t *settings) {
+    if (settings->is_lsb_first || (settings->bits_per_word != 8 && settings->bits_per_word != 0)) {
+        diag_error("only 8-bit, MSB-first words are supported");
+        return -1;
+    }
+    dev->cs_orig = reg_read(dev, SPI_MMIO_REG_CS);
+    dev->clk_orig = reg_read(dev, SPI_MMIO_REG_CLK);
+
+    uint32_t cs = 0;
+    if (settings->mode & SPI_CPHA) {
+        cs |= SPI_MMIO_CS_CPHA;
+    }
+    if (settings->mode & SPI_CPOL) {
+        cs |= SPI_MMIO_CS_CPOL;
+    }
+    reg_write(dev, SPI_MMIO_REG_CS, cs | SPI_MMIO_CS_CLEAR_TX | SPI_MMIO_CS_CLEAR_RX);
+    reg_write(dev, SPI_MMIO_REG_CLK, clock_divider(settings->max_speed_hz));
+    return 0;
+}
+
+static spi_mmio_t *map_block(int fd, off_t offset, int sim, spi_settings_t *settings) {
+    void *regs = mmap(NULL, SPI_MMIO_BLOCK_LEN, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+    if (regs == MAP_FAILED) {
+        diag_error("could not map the register block");
+        close(fd);
+        return NULL;
+    }
+    spi_mmio_t *dev = calloc(1, sizeof(spi_mmio_t));
+    if (dev == NULL) {
+        diag_error("out of memory");
+        munmap(regs, SPI_MMIO_BLOCK_LEN);
+        close(fd);
+        return NULL;
+    }
+    dev->regs = regs;
+    dev->fd = fd;
+    dev->sim = sim;
+    if (0 != configure(dev, settings)) {
+        munmap(regs, SPI_MMIO_BLOCK_LEN);
+        close(fd);
+        free(dev);
+        return NULL;
+    }
+    return dev;
+}
+
+spi_mmio_t *spi_mmio_open(spi_settings_t *settings) {
+    int fd = open("/dev/mem", O_RDWR | O_SYNC);
+    if (0 > fd) {
+        diag_error("could not open /dev/mem (are you root?)");
+        return NULL;
+    }
+    return map_block(fd, (off_t) peripheral_base() + SPI_MMIO_SPI0_OFFSET, 0, settings);
+}
+
+spi_mmio_t *spi_mmio_open_sim(const char *reg_file, spi_settings_t *settings) {
+    int fd = open(reg_file, O_RDWR | O_CREAT, 0644);
+    if (0 > fd) {
+        diag_error("could not open %s", reg_file);
+        return NULL;
+    }
+    // Power-on state: all registers and simulator state zeroed
+    uint8_t zeros[SPI_MMIO_BLOCK_LEN] = {0};
+    if (0 != ftruncate(fd, SPI_MMIO_BLOCK_LEN) ||
+        SPI_MMIO_BLOCK_LEN != pwrite(fd, zeros, SPI_MMIO_BLOCK_LEN, 0)) {
+        diag_error("could not reset %s", reg_file);
+        close(fd);
+        return NULL;
+    }
+    return map_block(fd, 0, 1, settings);
+}
+
+void spi_mmio_close(spi_mmio_t *dev) {
+    if (dev == NULL) {
+        return;
+    }
+    reg_write(dev, SPI_MMIO_REG_CS, (dev->cs_orig & ~SPI_MMIO_CS_TA) | SPI_MMIO_CS_CLEAR_TX | SPI_MMIO_CS_CLEAR_RX);
+    reg_write(dev, SPI_MMIO_REG_CLK, dev->clk_orig);
+    munmap((void *) dev->regs, SPI_MMIO_BLOCK_LEN);
+    close(dev->fd);
+    free(dev);
+}
+
+int spi_mmio_transfer(spi_mmio_t *dev, const uint8_t *tx, uint8_t *rx, int len) {
+    uint32_t cs = reg_read(dev, SPI_MMIO_REG_CS) & (SPI_MMIO_CS_CPHA | SPI_MMIO_CS_CPOL);
+    int sent = 0, received = 0;
+    long polls = 0;
+
+    // Peripheral accesses on the BCM2835 aren't ordered against accesses
+    // to other peripherals, so fence around the whole transfer
+    __sync_synchronize();
+    reg_write(dev, SPI_MMIO_REG_CS, cs | SPI_MMIO_CS_CLEAR_TX | SPI_MMIO_CS_CLEAR_RX);
+    reg_write(dev, SPI_MMIO_REG_CS, cs | SPI_MMIO_CS_TA);
+
+    // Keep the TX FIFO fed and the RX FIFO drained until every byte is back
+    while (received < len) {
+        uint32_t status = reg_read(dev, SPI_MMIO_REG_CS);
+        while (sent < len && (status & SPI_MMIO_CS_TXD)) {
+            reg_write(dev, SPI_MMIO_REG_FIFO, tx != NULL ? tx[sent] : 0);
+            sent++;
+            status = reg_read(dev, SPI_MMIO_REG_CS);
+        }
+        while (received < len && (status & SPI_MMIO_CS_RXD)) {
+            rx[received++] = (uint8_t) reg_read(dev, SPI_MMIO_REG_FIFO);
+            status = reg_read(dev, SPI_MMIO_REG_CS);
+        }
+        if (++polls > SPI_MMIO_POLL_LIMIT) {
+            break;
+        }
+    }
+    while (received == len && !(reg_read(dev, SPI_MMIO_REG_CS) & SPI_MMIO_CS_DONE)) {
+        if (++polls > SPI_MMIO_POLL_LIMIT) {
+            break;
+        }
+    }
+
+    reg_write(dev, SPI_MMIO_REG_CS, cs);
+    __sync_synchronize();
+
+    if (polls > SPI_MMIO_POLL_LIMIT) {
+        diag_error("timed out after %d of %d bytes", received, len);
+        return -1;
+    }
+    return received;
+}
+
+int spi_mmio_read_two_bytes(spi_mmio_t *dev, uint8_t *out) {
+    return spi_mmio_transfer(dev, NULL, out, 2);
+}
+
+void spi_mmio_sim_set_value(spi_mmio_t *dev, int16_t value) {
+    if (!dev->sim) {
+        return;
+    }
+    sim_state(dev)->value = value;
+    sim_state(dev)->value_fixed = 1;
+}
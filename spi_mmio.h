@@ -0,0 +1,131 @@
+/**
+ * @file spi_mmio.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Direct, polled driver for the Raspberry Pi's SPI0 controller
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * Every transfer through spidev costs a trip into the kernel and through
+ * the SPI core. This driver instead maps the BCM2835-family SPI0 register
+ * block into the process and runs each transfer by polling the FIFO, so
+ * a 2-byte MCP3301 read costs little more than the 16 bus clocks
+ * themselves. It lives alongside the spi.c API rather than replacing it:
+ * the same spi_settings_t configures it, and spi_mmio_read_two_bytes()
+ * mirrors spi_read_two_bytes().
+ *
+ * Caveats for real hardware: it needs root (it maps /dev/mem), the SPI0
+ * pins must already be in their SPI function (e.g. by enabling SPI in
+ * config.txt), and the kernel's own SPI driver must not be using the
+ * controller at the same time.
+ *
+ * For development on any Linux machine, spi_mmio_open_sim() maps a plain
+ * file instead of /dev/mem, laid out exactly like the register block.
+ * Every register access goes through the same code path, but in
+ * simulation the accesses also drive a model of the controller (FIFOs,
+ * transfer-active and status bits) with a simulated MCP3301 attached.
+ * The simulator's own state is kept in the same file, after the
+ * registers, so it can be inspected from outside while the program runs.
+ */
+
+#ifndef SPI_MMIO_H
+#define SPI_MMIO_H
+
+#include <stdint.h>
+
+#include "spi.h"
+
+////////////////////////////////////////////////////////
+/// BCM2835 SPI0 register block
+
+#define SPI_MMIO_SPI0_OFFSET 0x204000  // From the peripheral base
+#define SPI_MMIO_BLOCK_LEN   4096
+
+#define SPI_MMIO_REG_CS   0x00  // Control and status
+#define SPI_MMIO_REG_FIFO 0x04  // TX and RX FIFOs
+#define SPI_MMIO_REG_CLK  0x08  // Clock divider
+#define SPI_MMIO_REG_DLEN 0x0C  // Data length (DMA only)
+#define SPI_MMIO_REG_LTOH 0x10  // LoSSI output hold delay
+#define SPI_MMIO_REG_DC   0x14  // DMA DREQ controls
+
+#define SPI_MMIO_CS_CPHA     (1u << 2)
+#define SPI_MMIO_CS_CPOL     (1u << 3)
+#define SPI_MMIO_CS_CLEAR_TX (1u << 4)
+#define SPI_MMIO_CS_CLEAR_RX (1u << 5)
+#define SPI_MMIO_CS_TA       (1u << 7)
+#define SPI_MMIO_CS_DONE     (1u << 16)
+#define SPI_MMIO_CS_RXD      (1u << 17)
+#define SPI_MMIO_CS_TXD      (1u << 18)
+#define SPI_MMIO_CS_RXR      (1u << 19)
+#define SPI_MMIO_CS_RXF      (1u << 20)
+
+/**
+ * @brief The core clock the SPI clock divider divides down from
+ *
+ * @remarks 250 MHz on the Pi 1 to 3 with default settings. Adjust for
+ *          boards running a different core_freq (e.g. 500 MHz on a Pi 4).
+ */
+#define SPI_MMIO_CORE_HZ 250000000u
+
+typedef struct spi_mmio spi_mmio_t;
+
+/**
+ * @brief Maps the real SPI0 controller and configures it
+ *
+ * @param settings The SPI settings to configure (only mode and
+ *                 max_speed_hz apply; words are always 8 bits, MSB first)
+ * @return spi_mmio_t* The opened controller, or NULL on failure
+ */
+spi_mmio_t *spi_mmio_open(spi_settings_t *settings);
+
+/**
+ * @brief Maps a simulated SPI0 controller backed by a plain file
+ *
+ * @remarks The file is created (or reset) as needed.
+ *
+ * @param reg_file The path of the file holding the simulated register block
+ * @param settings The SPI settings to configure
+ * @return spi_mmio_t* The opened simulator, or NULL on failure
+ */
+spi_mmio_t *spi_mmio_open_sim(const char *reg_file, spi_settings_t *settings);
+
+/**
+ * @brief Stops any transfer in progress and unmaps the controller
+ *
+ * @param dev The controller to close
+ */
+void spi_mmio_close(spi_mmio_t *dev);
+
+/**
+ * @brief Runs one polled full-duplex transfer with chip select 0 asserted
+ *
+ * @param dev The controller to transfer with
+ * @param tx The bytes to send, or NULL to send zeros
+ * @param rx The location to write the received bytes to
+ * @param len The number of bytes to transfer
+ * @return int The number of bytes transferred, or -1 if the controller timed out
+ */
+int spi_mmio_transfer(spi_mmio_t *dev, const uint8_t *tx, uint8_t *rx, int len);
+
+/**
+ * @brief Reads two bytes of data from the controller
+ *
+ * @param dev The controller to read from
+ * @param out The memory buffer to write the data to
+ * @return int The number of bytes read, or -1 for errors
+ */
+int spi_mmio_read_two_bytes(spi_mmio_t *dev, uint8_t *out);
+
+/**
+ * @brief Sets the reading the simulated MCP3301 returns from now on
+ *
+ * @remarks Has no effect on real hardware. Until this is called, the
+ *          simulated ADC returns a slowly varying test pattern.
+ *
+ * @param dev The simulated controller
+ * @param value The 13-bit reading to return
+ */
+void spi_mmio_sim_set_value(spi_mmio_t *dev, int16_t value);
+
+#endif // SPI_MMIO_H
@@ -0,0 +1,242 @@
+/**
+ * @file spiarchive.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Encodes, decodes and verifies bounded-error archives of recorded output
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See archive.h for the archive itself. This program archives the
+ * filtered weight (the third column) of a recorded reader output file,
+ * along with its anchors; writes an archive back out as text, either at
+ * its vertices or resampled at a fixed interval; and checks an archive
+ * against the file it came from, reporting the largest and RMS error and
+ * failing if any sample is beyond the archive's tolerance.
+ *
+ * Usage:
+ *
+ *     ./spiarchive encode [-e max_err] out.txt out.arc
+ *     ./spiarchive decode [-i interval_us] out.arc > weight.txt
+ *     ./spiarchive verify out.txt out.arc
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/types.h>
+
+#include "archive.h"
+#include "timebase.h"
+#include "diag.h"
+
+/**
+ * @brief Reads the next sample or anchor from a reader output file
+ *
+ * @param f The file
+ * @param t_ns The location to write a sample's time to
+ * @param avg The location to write a sample's filtered weight to
+ * @param anchor The location to write an anchor to
+ * @return int 1 for a sample, 2 for an anchor, 0 at the end of the file
+ */
+static int read_line(FILE *f, int64_t *t_ns, double *avg, tb_anchor_t *anchor) {
+    char line[256];
+    double t;
+    int val;
+    while (NULL != fgets(line, sizeof(line), f)) {
+        if (2 == sscanf(line, "# anchor\t%" SCNd64 "\t%" SCNd64, &anchor->mono_ns, &anchor->real_ns)) {
+            return 2;
+        }
+        if (line[0] != '#' && 3 == sscanf(line, "%lf %d %lf", &t, &val, avg)) {
+            *t_ns = llround(t * 1e9);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int encode(const char *in_path, const char *out_path, double max_err) {
+    FILE *in = fopen(in_path, "r");
+    if (in == NULL) {
+        diag_error("could not open %s", in_path);
+        return EXIT_FAILURE;
+    }
+    arc_writer_t *w = arc_open(out_path, max_err);
+    if (w == NULL) {
+        fclose(in);
+        return EXIT_FAILURE;
+    }
+
+    int64_t t_ns;
+    double avg;
+    tb_anchor_t anchor;
+    int kind;
+    while (0 != (kind = read_line(in, &t_ns, &avg, &anchor))) {
+        if (kind == 1) {
+            arc_sample(w, t_ns, avg);
+        } else {
+            arc_anchor(w, &anchor);
+        }
+    }
+    off_t in_bytes = ftello(in);
+    fclose(in);
+
+    arc_stats_t st;
+    if (0 != arc_close(w, &st)) {
+        diag_error("could not write %s", out_path);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "%llu samples in %llu vertices, %llu bytes (%.0f:1 against the text, %.1f samples per vertex)\n",
+            (unsigned long long) st.samples, (unsigned long long) st.vertices, (unsigned long long) st.bytes,
+            (double) in_bytes / st.bytes, (double) st.samples / st.vertices);
+    return EXIT_SUCCESS;
+}
+
+static int decode(const char *path, int64_t interval_ns) {
+    arc_file_header_t h;
+    FILE *f = arc_read_open(path, &h);
+    if (f == NULL) {
+        return EXIT_FAILURE;
+    }
+    printf("# archive\tmax_err\t%g\n", h.max_err);
+
+    // Resampling runs from the first vertex to the last
+    arc_record_t a, b;
+    uint64_t vertices = 0;
+    int64_t next_t = 0;
+    while (ARC_EOF != arc_next(f, &b)) {
+        if (b.kind == ARC_ANCHOR) {
+            printf("# anchor\t%" PRId64 "\t%" PRId64 "\n", b.anchor.mono_ns, b.anchor.real_ns);
+            continue;
+        }
+        if (interval_ns == 0) {
+            printf("%5.6f\t%4.3f\n", b.t_ns / 1e9, b.value);
+        } else if (vertices == 0) {
+            next_t = b.t_ns;
+        } else {
+            for(; next_t <= b.t_ns; next_t += interval_ns) {
+                printf("%5.6f\t%4.3f\n", next_t / 1e9, arc_interp(&a, &b, next_t));
+            }
+        }
+        a = b;
+        vertices++;
+    }
+    if (interval_ns != 0 && vertices == 1) {
+        printf("%5.6f\t%4.3f\n", a.t_ns / 1e9, a.value);
+    }
+    fclose(f);
+    return EXIT_SUCCESS;
+}
+
+static int verify(const char *in_path, const char *arc_path) {
+    FILE *in = fopen(in_path, "r");
+    if (in == NULL) {
+        diag_error("could not open %s", in_path);
+        return EXIT_FAILURE;
+    }
+    arc_file_header_t h;
+    FILE *f = arc_read_open(arc_path, &h);
+    if (f == NULL) {
+        fclose(in);
+        return EXIT_FAILURE;
+    }
+
+    // Walk the samples and the vertices together, keeping the pair of
+    // vertices (a, b) around each sample
+    arc_record_t a, b;
+    int have_a = 0, have_b = 0, at_end = 0;
+    int64_t t_ns;
+    double avg;
+    tb_anchor_t anchor;
+    uint64_t samples = 0, beyond = 0, uncovered = 0;
+    double worst = 0.0, sq = 0.0;
+    int kind;
+    while (0 != (kind = read_line(in, &t_ns, &avg, &anchor))) {
+        if (kind != 1) {
+            continue;
+        }
+        samples++;
+        while (!at_end && (!have_b || b.t_ns < t_ns)) {
+            if (have_b) {
+                a = b;
+                have_a = 1;
+            }
+            while (ARC_ANCHOR == arc_next(f, &b)) {
+            }
+            at_end = (b.kind == ARC_EOF);
+            have_b = !at_end;
+        }
+        if (at_end || (!have_a && b.t_ns != t_ns)) {
+            uncovered++;
+            continue;
+        }
+        double err = fabs((have_a ? arc_interp(&a, &b, t_ns) : b.value) - avg);
+        worst = fmax(worst, err);
+        sq += err * err;
+        if (err > h.max_err) {
+            beyond++;
+        }
+    }
+    fclose(in);
+    fclose(f);
+
+    printf("%llu samples: max error %.6f counts (limit %g), rms %.6f, %llu beyond the limit, %llu not covered\n",
+           (unsigned long long) samples, worst, h.max_err, samples ? sqrt(sq / samples) : 0.0,
+           (unsigned long long) beyond, (unsigned long long) uncovered);
+    return (beyond == 0 && uncovered == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s encode [-e max_err] <reader output file> <archive>\n", name);
+    printf("       %s decode [-i interval_us] <archive>\n", name);
+    printf("       %s verify <reader output file> <archive>\n", name);
+    printf("  -e ERR  largest error allowed, in ADC counts (default 1)\n");
+    printf("  -i US   resample at this interval, in microseconds (default: the vertices)\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *cmd = argv[1];
+    double max_err = 1.0;
+    double interval_us = 0.0;
+    int opt;
+    optind = 2;
+    while (-1 != (opt = getopt(argc, argv, "e:i:h"))) {
+        switch (opt) {
+        case 'e':
+            max_err = atof(optarg);
+            break;
+        case 'i':
+            interval_us = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    int nargs = argc - optind;
+    char **args = argv + optind;
+
+    int ret = EXIT_FAILURE;
+    if (0 == strcmp(cmd, "encode") && nargs == 2) {
+        if (!(max_err > 0.0)) {
+            diag_error("the largest error must be positive");
+        } else {
+            ret = encode(args[0], args[1], max_err);
+        }
+    } else if (0 == strcmp(cmd, "decode") && nargs == 1 && interval_us >= 0.0) {
+        ret = decode(args[0], llround(interval_us * 1e3));
+    } else if (0 == strcmp(cmd, "verify") && nargs == 2) {
+        ret = verify(args[0], args[1]);
+    } else {
+        usage(argv[0]);
+    }
+    return ret;
+}
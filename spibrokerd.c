@@ -0,0 +1,103 @@
+/**
+ * @file spibrokerd.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Daemon that owns an SPI device and runs other programs' transfers
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See broker.h for how clients and the broker share the bus. The daemon
+ * opens the SPI device once, serves clients until it gets SIGINT or
+ * SIGTERM, then restores the device's original settings and reports how
+ * each connected client was served.
+ *
+ * Usage:
+ *
+ *     ./spibrokerd [-D device] [-n shm_name]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "spi.h"
+#include "broker.h"
+#include "diag.h"
+
+/**
+ * @brief Settings to open the device with; each client's own settings
+ *        are applied before its transfers
+ */
+static spi_settings_t spi_settings_open = {
+    .mode          = SPI_MODE_0,
+    .is_lsb_first  = 0,
+    .bits_per_word = 8,
+    .max_speed_hz  = 500000
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void handle_stop_signal(int sig) {
+    (void) sig;
+    running = 0;
+}
+
+int main(int argc, char** argv) {
+    const char *device = "/dev/spidev0.0";
+    const char *name = BRK_DEFAULT_NAME;
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "D:n:h"))) {
+        switch (opt) {
+        case 'D':
+            device = optarg;
+            break;
+        case 'n':
+            name = optarg;
+            break;
+        default:
+            printf("Usage: %s [-D device] [-n shm_name]\n", argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // Own the region before touching the device: a broker already serving
+    // it must not have its bus settings changed underneath it
+    brk_shared_t *shm = brk_create(name);
+    if (shm == NULL) {
+        return EXIT_FAILURE;
+    }
+    int fd = spi_init(device, &spi_settings_open);
+    if (0 >= fd) {
+        diag_error("could not initialize SPI bus");
+        brk_destroy(shm, name);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "spibrokerd: serving %s on %s\n", device, name);
+
+    brk_serve(shm, fd, &running);
+
+    fprintf(stderr, "Settings changes: %llu\n", (unsigned long long) shm->settings_changes);
+    for(int i = 0; i < BRK_MAX_CLIENTS; i++) {
+        brk_slot_t *slot = &shm->slots[i];
+        if (slot->state == BRK_SLOT_FREE || slot->stats.requests == 0) {
+            continue;
+        }
+        fprintf(stderr, "Client %d: %llu requests, %llu frames, mean latency %.1f us, max %.1f us, %llu missed target of %.1f us\n",
+                (int) slot->pid, (unsigned long long) slot->stats.requests, (unsigned long long) slot->stats.frames,
+                slot->stats.latency_ns / 1e3 / slot->stats.requests, slot->stats.max_latency_ns / 1e3,
+                (unsigned long long) slot->stats.missed, slot->target_ns / 1e3);
+    }
+    brk_destroy(shm, name);
+    spi_shutdown(fd);
+    return EXIT_SUCCESS;
+}
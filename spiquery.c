@@ -0,0 +1,134 @@
+/**
+ * @file spiquery.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Searches RLE files for thresholds and variance using their zone index
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See rle.h for the file and its zone index. Each query first checks
+ * every zone's summary, and decodes only the zones which could hold a
+ * match, so that a search over months of recordings reads a small
+ * fraction of them:
+ *
+ * - above / below: prints every stretch of consecutive readings above
+ *   (or below) a raw reading, with its time span, length and peak. Only
+ *   zones whose maximum (or minimum) passes the threshold are decoded.
+ * - variance: prints every zone whose readings' variance is above a
+ *   limit, with its mean and standard deviation, straight from the
+ *   index.
+ * - zones: prints the index itself.
+ *
+ * How many zones and samples were decoded goes to STDERR. The threshold
+ * searches are rle_find()'s; bench checks them against full scans.
+ *
+ * Usage:
+ *
+ *     ./spiquery above 2500 run.rle
+ *     ./spiquery below -100 run.rle
+ *     ./spiquery variance 25 run.rle
+ *     ./spiquery zones run.rle
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "rle.h"
+#include "diag.h"
+
+static void print_span(const rle_span_t *s, void *arg) {
+    (void) arg;
+    printf("%5.6f\t%5.6f\t%llu\t%d\n", s->t_first / 1e9, s->t_last / 1e9, (unsigned long long) s->count, s->peak);
+}
+
+static int query_threshold(FILE *f, const rle_zone_t *zones, size_t n, int threshold, int above) {
+    rle_find_stats_t st;
+    printf("# %s %d\n# start\tend\tsamples\tpeak\n", above ? "above" : "below", threshold);
+    if (0 != rle_find(f, zones, n, threshold, above, print_span, NULL, &st)) {
+        diag_error("out of memory");
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "%zu of %zu zones decoded (%llu of %llu samples)\n", st.zones_decoded, st.zones,
+            (unsigned long long) st.samples_decoded, (unsigned long long) st.samples);
+    return EXIT_SUCCESS;
+}
+
+static int query_variance(const rle_zone_t *zones, size_t n, double limit) {
+    printf("# variance %g\n# start\tend\tsamples\tmean\tsd\n", limit);
+    size_t found = 0;
+    for(size_t i = 0; i < n; i++) {
+        const rle_zone_t *z = &zones[i];
+        uint32_t k = z->count - z->errors;
+        if (k < 2) {
+            continue;
+        }
+        double mean = (double) z->sum / k;
+        double var = fmax((double) z->sum_sq / k - mean * mean, 0.0);
+        if (var > limit) {
+            printf("%5.6f\t%5.6f\t%u\t%.3f\t%.3f\n", z->t_first / 1e9, z->t_last / 1e9, z->count, mean, sqrt(var));
+            found++;
+        }
+    }
+    fprintf(stderr, "0 of %zu zones decoded, %zu above the limit\n", n, found);
+    return EXIT_SUCCESS;
+}
+
+static int list_zones(const rle_zone_t *zones, size_t n) {
+    printf("# offset\tstart\tend\tsamples\terrors\tmin\tmax\tmean\n");
+    for(size_t i = 0; i < n; i++) {
+        const rle_zone_t *z = &zones[i];
+        uint32_t k = z->count - z->errors;
+        printf("%lld\t%5.6f\t%5.6f\t%u\t%u\t%d\t%d\t%.3f\n", (long long) z->offset, z->t_first / 1e9,
+               z->t_last / 1e9, z->count, z->errors, z->min, z->max, k ? (double) z->sum / k : 0.0);
+    }
+    return EXIT_SUCCESS;
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s above|below <reading> <RLE file>\n", name);
+    printf("       %s variance <counts squared> <RLE file>\n", name);
+    printf("       %s zones <RLE file>\n", name);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3 || (argc != 4 && 0 != strcmp(argv[1], "zones"))) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *cmd = argv[1];
+    const char *path = argv[argc - 1];
+    if (0 != strcmp(cmd, "above") && 0 != strcmp(cmd, "below") && 0 != strcmp(cmd, "variance") &&
+        0 != strcmp(cmd, "zones")) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    rle_file_header_t h;
+    FILE *f = rle_read_open(path, &h);
+    if (f == NULL) {
+        return EXIT_FAILURE;
+    }
+    size_t n = 0;
+    rle_zone_t *zones = rle_read_zones(f, &n);
+    if (zones == NULL) {
+        diag_error("%s has no zone index (an older file, or its writer didn't exit cleanly); replay it instead", path);
+        fclose(f);
+        return EXIT_FAILURE;
+    }
+
+    int ret;
+    if (0 == strcmp(cmd, "zones")) {
+        ret = list_zones(zones, n);
+    } else if (0 == strcmp(cmd, "variance")) {
+        ret = query_variance(zones, n, atof(argv[2]));
+    } else {
+        ret = query_threshold(f, zones, n, atoi(argv[2]), 0 == strcmp(cmd, "above"));
+    }
+    free(zones);
+    fclose(f);
+    return ret;
+}
@@ -0,0 +1,445 @@
+/**
+ * @file subserver.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of the Unix domain socket subscription server
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "subserver.h"
+#include "timebase.h"
+#include "diag.h"
+#include "metrics.h"
+#include "latency.h"
+
+// Size of each subscriber's outgoing batch buffer
+#define SUB_BUF_LEN 16384
+
+// Socket send buffer requested for each subscriber, to absorb short stalls
+#define SUB_SNDBUF (256 * 1024)
+
+// Number of samples drained from the ring at a time
+#define SUB_DRAIN_MAX 1024
+
+/**
+ * @brief The state of one connected subscriber
+ */
+typedef struct sub_client {
+    int      fd;
+    int      subscribed;
+    char     req[128];
+    size_t   req_len;
+
+    // Subscription parameters
+    unsigned every;
+    unsigned skip;
+    int64_t  interval_ns;
+    int      text;
+
+    // Aggregation state
+    int64_t  agg_start;
+    int64_t  agg_acq_ns;       // When the oldest sample in the aggregate was acquired
+    uint32_t agg_count;
+    int16_t  agg_min;
+    int16_t  agg_max;
+    double   agg_sum;
+
+    // Outgoing batch
+    uint8_t  buf[SUB_BUF_LEN];
+    size_t   buf_len;
+    uint16_t batch_count;
+    int64_t  batch_since;
+    int64_t  batch_acq_ns[SUB_BATCH_MAX];  // When each record's (oldest) sample was acquired
+} sub_client_t;
+
+// State of the (single) server thread
+static pthread_t      sub_thread;
+static atomic_int     sub_running;
+static atomic_ullong  sub_dropped;
+static int            listen_fd = -1;
+static char           sock_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static sample_ring_t *sub_ring;
+static sub_client_t  *clients[SUB_MAX_CLIENTS];
+
+// Subscriber figures
+static metric_t *m_clients;
+static metric_t *m_bytes_sent;
+
+static void client_close(int i) {
+    metric_add(m_clients, -1);
+    close(clients[i]->fd);
+    free(clients[i]);
+    clients[i] = NULL;
+}
+
+static void client_drop(int i) {
+    atomic_fetch_add(&sub_dropped, 1);
+    client_close(i);
+}
+
+/**
+ * @brief Sends a subscriber's pending batch; drops the subscriber if the
+ *        whole batch can't be sent without blocking
+ */
+static void client_flush(int i) {
+    sub_client_t *c = clients[i];
+    if (c->buf_len == 0) {
+        return;
+    }
+    if (!c->text) {
+        ((sub_frame_header_t *) c->buf)->count = c->batch_count;
+    }
+    ssize_t n = send(c->fd, c->buf, c->buf_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n != (ssize_t) c->buf_len) {
+        client_drop(i);
+        return;
+    }
+    metric_add(m_bytes_sent, n);
+    int64_t now = tb_mono_ns();
+    for(uint16_t k = 0; k < c->batch_count; k++) {
+        lat_observe(LAT_SUBSCRIBER, now, c->batch_acq_ns[k]);
+    }
+    c->buf_len = 0;
+    c->batch_count = 0;
+}
+
+/**
+ * @brief Reserves room for one record in a subscriber's batch, starting a
+ *        new batch (and flushing the old one) as needed
+ *
+ * @return void* Where to write the record, or NULL if the subscriber was dropped
+ */
+static void *client_reserve(int i, size_t rec_len, uint16_t kind, int64_t acq_ns) {
+    sub_client_t *c = clients[i];
+    if (c->batch_count == SUB_BATCH_MAX || c->buf_len + rec_len > SUB_BUF_LEN) {
+        client_flush(i);
+        if (clients[i] == NULL) {
+            return NULL;
+        }
+    }
+    if (c->buf_len == 0) {
+        c->batch_since = tb_mono_ns();
+        if (!c->text) {
+            sub_frame_header_t *h = (sub_frame_header_t *) c->buf;
+            h->magic = SUB_FRAME_MAGIC;
+            h->kind = kind;
+            h->count = 0;
+            c->buf_len = sizeof(sub_frame_header_t);
+        }
+    }
+    void *p = c->buf + c->buf_len;
+    c->buf_len += rec_len;
+    c->batch_acq_ns[c->batch_count++] = acq_ns;
+    return p;
+}
+
+static void client_emit_sample(int i, const sample_rec_t *rec) {
+    if (clients[i]->text) {
+        char line[64];
+        int n = snprintf(line, sizeof(line), "%5.6f\t%d\t%4.3f\n", rec->t_ns / 1e9, rec->raw, rec->filtered);
+        char *p = (char *) client_reserve(i, n, 0, rec->acq_ns);
+        if (p != NULL) {
+            memcpy(p, line, n);
+        }
+        return;
+    }
+    sub_sample_t *s = (sub_sample_t *) client_reserve(i, sizeof(sub_sample_t), SUB_KIND_SAMPLE, rec->acq_ns);
+    if (s != NULL) {
+        s->t_ns = rec->t_ns;
+        s->filtered = rec->filtered;
+        s->raw = rec->raw;
+        s->status = rec->status;
+        s->reserved = 0;
+    }
+}
+
+static void client_emit_aggregate(int i) {
+    sub_client_t *c = clients[i];
+    double mean = c->agg_sum / c->agg_count;
+    if (c->text) {
+        char line[96];
+        int n = snprintf(line, sizeof(line), "%5.6f\t%u\t%d\t%d\t%4.3f\n", c->agg_start / 1e9, c->agg_count, c->agg_min, c->agg_max, mean);
+        char *p = (char *) client_reserve(i, n, 0, c->agg_acq_ns);
+        if (p != NULL) {
+            memcpy(p, line, n);
+        }
+        return;
+    }
+    int64_t start = c->agg_start;
+    uint32_t count = c->agg_count;
+    int16_t min = c->agg_min;
+    int16_t max = c->agg_max;
+    sub_aggregate_t *a = (sub_aggregate_t *) client_reserve(i, sizeof(sub_aggregate_t), SUB_KIND_AGGREGATE, c->agg_acq_ns);
+    if (a != NULL) {
+        a->t_ns = start;
+        a->mean = mean;
+        a->count = count;
+        a->min = min;
+        a->max = max;
+    }
+}
+
+/**
+ * @brief Feeds one sample to a subscriber, applying its decimation or aggregation
+ */
+static void client_feed(int i, const sample_rec_t *rec) {
+    sub_client_t *c = clients[i];
+    if (c->interval_ns == 0) {
+        if (c->skip == 0) {
+            client_emit_sample(i, rec);
+            c->skip = c->every;
+        }
+        c->skip--;
+        return;
+    }
+
+    if (c->agg_count > 0 && rec->t_ns >= c->agg_start + c->interval_ns) {
+        client_emit_aggregate(i);
+        if ((c = clients[i]) == NULL) {
+            return;
+        }
+        c->agg_count = 0;
+    }
+    if (c->agg_count == 0) {
+        c->agg_start = rec->t_ns - (rec->t_ns % c->interval_ns);
+        c->agg_min = rec->raw;
+        c->agg_max = rec->raw;
+        c->agg_sum = 0;
+        c->agg_acq_ns = rec->acq_ns;
+    }
+    c->agg_count++;
+    c->agg_sum += rec->raw;
+    if (rec->raw < c->agg_min) {
+        c->agg_min = rec->raw;
+    }
+    if (rec->raw > c->agg_max) {
+        c->agg_max = rec->raw;
+    }
+}
+
+/**
+ * @brief Parses a subscriber's request line
+ *
+ * @return int 0 if the request was valid, nonzero otherwise
+ */
+static int client_parse_request(sub_client_t *c) {
+    char *save = NULL;
+    char *tok = strtok_r(c->req, " \t\r\n", &save);
+    if (tok == NULL || 0 != strcmp(tok, "SUB")) {
+        return -1;
+    }
+    c->every = 1;
+    c->interval_ns = 0;
+    c->text = 0;
+    while (NULL != (tok = strtok_r(NULL, " \t\r\n", &save))) {
+        long v;
+        if (1 == sscanf(tok, "every=%ld", &v) && v > 0) {
+            c->every = (unsigned) v;
+        } else if (1 == sscanf(tok, "interval=%ld", &v) && v > 0) {
+            c->interval_ns = v * 1000000LL;
+        } else if (0 == strcmp(tok, "format=bin")) {
+            c->text = 0;
+        } else if (0 == strcmp(tok, "format=text")) {
+            c->text = 1;
+        } else {
+            return -1;
+        }
+    }
+    c->skip = 0;
+    c->agg_count = 0;
+    c->subscribed = 1;
+    return 0;
+}
+
+static void client_read(int i) {
+    sub_client_t *c = clients[i];
+    char buf[128];
+    ssize_t n = read(c->fd, buf, sizeof(buf));
+    if (n <= 0) {
+        if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+            client_close(i);
+        }
+        return;
+    }
+    if (c->subscribed) {
+        return; // Anything after the request line is ignored
+    }
+    for(ssize_t k = 0; k < n; k++) {
+        if (c->req_len == sizeof(c->req) - 1) {
+            client_close(i);
+            return;
+        }
+        c->req[c->req_len++] = buf[k];
+        if (buf[k] == '\n') {
+            c->req[c->req_len] = '\0';
+            if (0 != client_parse_request(c)) {
+                const char *err = "ERR bad request\n";
+                send(c->fd, err, strlen(err), MSG_DONTWAIT | MSG_NOSIGNAL);
+                client_close(i);
+            }
+            return;
+        }
+    }
+}
+
+static void accept_clients(void) {
+    int fd;
+    while (0 <= (fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC))) {
+        int i;
+        for(i = 0; i < SUB_MAX_CLIENTS && clients[i] != NULL; i++) {
+        }
+        if (i == SUB_MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+        int sndbuf = SUB_SNDBUF;
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        clients[i] = (sub_client_t *) calloc(1, sizeof(sub_client_t));
+        if (clients[i] == NULL) {
+            diag_error("out of memory");
+            close(fd);
+            continue;
+        }
+        clients[i]->fd = fd;
+        metric_inc(m_clients);
+    }
+}
+
+static void *sub_main(void *arg) {
+    (void) arg;
+    static sample_rec_t recs[SUB_DRAIN_MAX];
+    struct pollfd pfds[SUB_MAX_CLIENTS + 1];
+    int owner[SUB_MAX_CLIENTS + 1];
+
+    // One last pass is made after stopping, so that everything the sampler
+    // pushed before sub_stop() still reaches the subscribers
+    for(int last = 0; !last; ) {
+        last = !atomic_load(&sub_running);
+        int n = 0;
+        pfds[n].fd = listen_fd;
+        pfds[n].events = POLLIN;
+        owner[n++] = -1;
+        for(int i = 0; i < SUB_MAX_CLIENTS; i++) {
+            if (clients[i] != NULL) {
+                pfds[n].fd = clients[i]->fd;
+                pfds[n].events = POLLIN;
+                owner[n++] = i;
+            }
+        }
+        poll(pfds, n, last ? 0 : 10);
+
+        for(int k = 0; k < n; k++) {
+            if (!(pfds[k].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            if (owner[k] < 0) {
+                accept_clients();
+            } else if (clients[owner[k]] != NULL) {
+                client_read(owner[k]);
+            }
+        }
+
+        size_t got;
+        while (0 < (got = ring_pop(sub_ring, recs, SUB_DRAIN_MAX))) {
+            for(int i = 0; i < SUB_MAX_CLIENTS; i++) {
+                for(size_t r = 0; r < got && clients[i] != NULL; r++) {
+                    if (clients[i]->subscribed) {
+                        client_feed(i, &recs[r]);
+                    }
+                }
+            }
+        }
+
+        int64_t now = tb_mono_ns();
+        for(int i = 0; i < SUB_MAX_CLIENTS; i++) {
+            if (clients[i] != NULL && clients[i]->buf_len > 0 &&
+                now - clients[i]->batch_since >= SUB_FLUSH_MS * 1000000LL) {
+                client_flush(i);
+            }
+        }
+    }
+    return NULL;
+}
+
+int sub_start(const char *path, sample_ring_t *ring) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        diag_error("socket path too long");
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    strcpy(sock_path, path);
+
+    if (0 > (listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0))) {
+        diag_error("socket failed with errno %d", errno);
+        return -1;
+    }
+    unlink(path);
+    if (0 != bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) || 0 != listen(listen_fd, 8)) {
+        diag_error("could not listen on %s, errno %d", path, errno);
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+
+    if (m_clients == NULL) {
+        m_clients = metrics_gauge("sub_clients");
+        m_bytes_sent = metrics_counter("sub_bytes_sent_total");
+    }
+    sub_ring = ring;
+    atomic_store(&sub_dropped, 0);
+    atomic_store(&sub_running, 1);
+    if (0 != pthread_create(&sub_thread, NULL, sub_main, NULL)) {
+        diag_error("could not start server thread");
+        close(listen_fd);
+        unlink(path);
+        listen_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void sub_stop(void) {
+    atomic_store(&sub_running, 0);
+    pthread_join(sub_thread, NULL);
+    for(int i = 0; i < SUB_MAX_CLIENTS; i++) {
+        // An aggregating subscriber's unfinished interval goes out too
+        if (clients[i] != NULL && clients[i]->interval_ns != 0 && clients[i]->agg_count > 0) {
+            client_emit_aggregate(i);
+        }
+        if (clients[i] != NULL) {
+            client_flush(i);
+            if (clients[i] != NULL) {
+                client_close(i);
+            }
+        }
+    }
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(sock_path);
+}
+
+uint64_t sub_dropped_clients(void) {
+    return atomic_load(&sub_dropped);
+}
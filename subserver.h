@@ -0,0 +1,123 @@
+/**
+ * @file subserver.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Unix domain socket subscription server for the live sample stream
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * Local programs can subscribe to the live stream at their own rate. The
+ * sampler pushes every sample into a sample_ring_t; a separate fan-out
+ * thread drains the ring and, for each subscriber, decimates or
+ * aggregates the samples and sends them in batches. Sends never block: a
+ * subscriber that can't keep up is disconnected rather than allowed to
+ * hold up the others (or the sampler).
+ *
+ * A subscriber connects to the socket and sends a single request line:
+ *
+ *     SUB [every=N] [interval=MS] [format=bin|text]\n
+ *
+ * - every=N:     send every Nth sample (default 1, i.e. everything)
+ * - interval=MS: instead send one aggregate (count/min/max/mean) per MS
+ *                milliseconds of sample time
+ * - format:      batched binary frames (default), or tab-separated text
+ *                lines in the same layout as the reader's STDOUT
+ *
+ * A binary frame is a sub_frame_header_t followed by `count` records,
+ * each a sub_sample_t or sub_aggregate_t depending on `kind`. All fields
+ * are in host byte order, since subscribers are on the same machine.
+ */
+
+#ifndef SUBSERVER_H
+#define SUBSERVER_H
+
+#include <stdint.h>
+
+#include "ring.h"
+
+/**
+ * @brief Magic number at the start of every binary frame ("SUBF")
+ */
+#define SUB_FRAME_MAGIC 0x46425553u
+
+/**
+ * @brief Maximum number of records in one binary frame
+ */
+#define SUB_BATCH_MAX 256
+
+/**
+ * @brief Longest time a record may wait in a batch before it is sent, in milliseconds
+ */
+#define SUB_FLUSH_MS 50
+
+/**
+ * @brief Maximum number of simultaneous subscribers
+ */
+#define SUB_MAX_CLIENTS 16
+
+/**
+ * @brief The kinds of record a binary frame can hold
+ */
+enum sub_kind {
+    SUB_KIND_SAMPLE    = 1,
+    SUB_KIND_AGGREGATE = 2
+};
+
+/**
+ * @brief The header at the start of every binary frame
+ */
+typedef struct sub_frame_header {
+    uint32_t magic;
+    uint16_t kind;
+    uint16_t count;
+} sub_frame_header_t;
+
+/**
+ * @brief A single (possibly decimated) sample
+ */
+typedef struct sub_sample {
+    int64_t t_ns;
+    double  filtered;
+    int16_t raw;
+    int16_t status;
+    int32_t reserved;
+} sub_sample_t;
+
+/**
+ * @brief An aggregate over one interval of samples
+ */
+typedef struct sub_aggregate {
+    int64_t  t_ns;      // Start of the interval
+    double   mean;      // Mean raw reading
+    uint32_t count;
+    int16_t  min;
+    int16_t  max;
+} sub_aggregate_t;
+
+/**
+ * @brief Starts the subscription server on its own thread
+ *
+ * @remarks Only one server may run at a time. Any stale socket file at
+ *          the path is replaced.
+ *
+ * @param path The filesystem path of the Unix domain socket
+ * @param ring The ring the sampler pushes samples into
+ * @return int 0 on success, nonzero otherwise
+ */
+int sub_start(const char *path, sample_ring_t *ring);
+
+/**
+ * @brief Stops the subscription server, disconnects all subscribers and
+ *        removes the socket file
+ */
+void sub_stop(void);
+
+/**
+ * @brief The number of subscribers disconnected for falling behind
+ *
+ * @return uint64_t The number of subscribers dropped so far
+ */
+uint64_t sub_dropped_clients(void);
+
+#endif // SUBSERVER_H
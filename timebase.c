@@ -0,0 +1,124 @@
+/**
+ * @file timebase.c
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Implementation of absolute epoch anchoring
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * See the associated .h file for more documentation about the functions here.
+ */
+
+#include <time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <assert.h>
+
+#include "timebase.h"
+#include "diag.h"
+
+// Number of attempts tb_anchor_take() makes to find a tight bracket
+#define TB_ANCHOR_TRIES 5
+
+static int64_t ts_to_ns(const struct timespec *ts) {
+    return (int64_t)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+int64_t tb_mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts_to_ns(&ts);
+}
+
+int tb_anchor_take(tb_anchor_t *anchor) {
+    assert(anchor != NULL);
+    struct timespec m0, r, m1;
+    int64_t best_window = INT64_MAX;
+
+    for(int i = 0; i < TB_ANCHOR_TRIES; i++) {
+        if (0 != clock_gettime(CLOCK_MONOTONIC, &m0) ||
+            0 != clock_gettime(CLOCK_REALTIME, &r) ||
+            0 != clock_gettime(CLOCK_MONOTONIC, &m1)) {
+            diag_error("clock_gettime failed");
+            return -1;
+        }
+        int64_t window = ts_to_ns(&m1) - ts_to_ns(&m0);
+        if (window < best_window) {
+            best_window = window;
+            anchor->mono_ns = ts_to_ns(&m0) + window / 2;
+            anchor->real_ns = ts_to_ns(&r);
+        }
+    }
+    return 0;
+}
+
+void tb_init(timebase_t *tb) {
+    tb->anchors = NULL;
+    tb->count = 0;
+    tb->capacity = 0;
+}
+
+void tb_free(timebase_t *tb) {
+    free(tb->anchors);
+    tb_init(tb);
+}
+
+int tb_add_anchor(timebase_t *tb, const tb_anchor_t *anchor) {
+    if (tb->count > 0 && anchor->mono_ns <= tb->anchors[tb->count - 1].mono_ns) {
+        return 0;
+    }
+    if (tb->count == tb->capacity) {
+        size_t cap = tb->capacity ? tb->capacity * 2 : 16;
+        tb_anchor_t *a = (tb_anchor_t *) realloc(tb->anchors, sizeof(tb_anchor_t) * cap);
+        if (a == NULL) {
+            diag_error("out of memory");
+            return -1;
+        }
+        tb->anchors = a;
+        tb->capacity = cap;
+    }
+    tb->anchors[tb->count++] = *anchor;
+    return 0;
+}
+
+int64_t tb_mono_to_utc_ns(const timebase_t *tb, int64_t mono_ns) {
+    assert(tb->count > 0);
+    const tb_anchor_t *a = tb->anchors;
+    if (tb->count == 1) {
+        return a[0].real_ns + (mono_ns - a[0].mono_ns);
+    }
+
+    // Binary search for the segment [lo, lo + 1] containing mono_ns,
+    // clamped to the first or last segment for extrapolation
+    size_t lo = 0;
+    size_t hi = tb->count - 1;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a[mid].mono_ns <= mono_ns) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    double rate = (double)(a[hi].real_ns - a[lo].real_ns) / (double)(a[hi].mono_ns - a[lo].mono_ns);
+    return a[lo].real_ns + (int64_t)((double)(mono_ns - a[lo].mono_ns) * rate);
+}
+
+void tb_format_utc(int64_t utc_ns, char *buf, size_t len) {
+    time_t secs = (time_t)(utc_ns / 1000000000LL);
+    long usecs = (long)((utc_ns % 1000000000LL) / 1000);
+    if (usecs < 0) {
+        secs -= 1;
+        usecs += 1000000;
+    }
+    struct tm tm;
+    gmtime_r(&secs, &tm);
+    size_t n = strftime(buf, len, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buf + n, len - n, ".%06ldZ", usecs);
+}
@@ -0,0 +1,127 @@
+/**
+ * @file timebase.h
+ * @author Chesley Kraniak (ckraniak@live.com)
+ * @brief Absolute epoch anchoring for monotonic sample timestamps
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021, Chesley Kraniak, All Rights Reserved
+ *
+ * Sample timestamps are taken from CLOCK_MONOTONIC, which never jumps
+ * but has no relation to the wall clock. To let readings be lined up
+ * against video or other sensors, the reader periodically records an
+ * "anchor": a CLOCK_REALTIME reading paired with the CLOCK_MONOTONIC
+ * reading taken at (nearly) the same instant.
+ *
+ * Given a list of anchors, any monotonic time can be mapped to UTC by
+ * linear interpolation between the two surrounding anchors. This also
+ * corrects for drift between the two clocks (e.g. while NTP is slewing
+ * the wall clock), since each segment gets its own rate.
+ */
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief How often the reader should record a new anchor, in nanoseconds
+ */
+#define TB_ANCHOR_PERIOD_NS (60LL * 1000000000LL)
+
+/**
+ * @brief A CLOCK_MONOTONIC / CLOCK_REALTIME pair taken at the same instant
+ */
+typedef struct tb_anchor {
+    /**
+     * @brief The monotonic time of the anchor, in nanoseconds
+     */
+    int64_t mono_ns;
+
+    /**
+     * @brief The wall-clock time of the anchor, in nanoseconds since the UNIX epoch
+     */
+    int64_t real_ns;
+} tb_anchor_t;
+
+/**
+ * @brief A growable, time-ordered list of anchors
+ *
+ * @remarks As with filter_buffer_t, treat the members as private.
+ */
+typedef struct timebase {
+    tb_anchor_t *anchors;
+    size_t       count;
+    size_t       capacity;
+} timebase_t;
+
+/**
+ * @brief Reads CLOCK_MONOTONIC
+ *
+ * @return int64_t The current monotonic time, in nanoseconds
+ */
+int64_t tb_mono_ns(void);
+
+/**
+ * @brief Takes an anchor from the live system clocks
+ *
+ * @remarks The realtime clock is read between two monotonic reads, and
+ *          the midpoint is used. The tightest of a few attempts is kept
+ *          so that a preemption in the middle doesn't skew the anchor.
+ *
+ * @param anchor The location to write the anchor to
+ * @return int 0 on success, nonzero otherwise
+ */
+int tb_anchor_take(tb_anchor_t *anchor);
+
+/**
+ * @brief Initializes an empty timebase
+ *
+ * @param tb The timebase to initialize
+ */
+void tb_init(timebase_t *tb);
+
+/**
+ * @brief Releases the memory held by a timebase
+ *
+ * @param tb The timebase to free
+ */
+void tb_free(timebase_t *tb);
+
+/**
+ * @brief Appends an anchor to the timebase
+ *
+ * @remarks Anchors must be added in increasing monotonic order; anchors
+ *          that are not newer than the last one are ignored.
+ *
+ * @param tb The timebase to append to
+ * @param anchor The anchor to append
+ * @return int 0 on success, nonzero otherwise
+ */
+int tb_add_anchor(timebase_t *tb, const tb_anchor_t *anchor);
+
+/**
+ * @brief Maps a monotonic time to UTC
+ *
+ * @remarks Times between two anchors are interpolated; times outside of
+ *          the anchored range are extrapolated using the nearest segment's
+ *          rate. With a single anchor, the clocks are assumed to run at
+ *          the same rate.
+ *
+ * @param tb The timebase to convert with (must hold at least one anchor)
+ * @param mono_ns The monotonic time to convert, in nanoseconds
+ * @return int64_t The corresponding UTC time, in nanoseconds since the UNIX epoch
+ */
+int64_t tb_mono_to_utc_ns(const timebase_t *tb, int64_t mono_ns);
+
+/**
+ * @brief Formats a UTC time as ISO 8601 with microsecond resolution
+ *
+ * @param utc_ns The UTC time, in nanoseconds since the UNIX epoch
+ * @param buf The buffer to write to (at least 32 bytes)
+ * @param len The length of the buffer
+ */
+void tb_format_utc(int64_t utc_ns, char *buf, size_t len);
+
+#endif // TIMEBASE_H